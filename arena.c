@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* A type with the strictest alignment the arena has to honor */
+typedef union ArenaAlign
+{
+    long l;
+    double d;
+    void *p;
+} ArenaAlign;
+
+#define ARENA_ALIGN sizeof(ArenaAlign)
+#define ALIGN_UP(size) (((size) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+#define CHUNK_HEADER ALIGN_UP(sizeof(ArenaChunk))
+
+/**
+ * @brief Initializes an empty arena.
+ *
+ * @param arena The arena to initialize.
+ */
+void initArena(Arena *arena)
+{
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+}
+
+/**
+ * @brief Moves the arena to a chunk with room for an allocation.
+ *
+ * The chunk after the current one is reused if it is big enough; otherwise a new chunk is inserted
+ * before it. Requests larger than ARENA_CHUNK_SIZE get a chunk of their own size.
+ *
+ * @param arena The arena.
+ * @param size The aligned size of the allocation.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int nextChunk(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk = arena->current != NULL ? arena->current->next : arena->first;
+    ArenaChunk *newChunk;
+    size_t chunkSize;
+
+    if (chunk == NULL || chunk->size < size)
+    {
+        chunkSize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        newChunk = (ArenaChunk *)malloc(CHUNK_HEADER + chunkSize);
+        if (newChunk == NULL)
+        {
+            return 0;
+        }
+        newChunk->size = chunkSize;
+        newChunk->next = chunk;
+        if (arena->current != NULL)
+        {
+            arena->current->next = newChunk;
+        }
+        else
+        {
+            arena->first = newChunk;
+        }
+        chunk = newChunk;
+    }
+    arena->current = chunk;
+    arena->used = 0;
+    return 1;
+}
+
+/**
+ * @brief Allocates memory from an arena.
+ *
+ * @param arena The arena.
+ * @param size The number of bytes to allocate.
+ * @return The memory, or NULL if memory allocation failed.
+ */
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    char *memory;
+
+    size = ALIGN_UP(size);
+    if ((arena->current == NULL || size > arena->current->size - arena->used) && !nextChunk(arena, size))
+    {
+        return NULL;
+    }
+    memory = (char *)arena->current + CHUNK_HEADER + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+/**
+ * @brief Copies characters into an arena as a null-terminated string.
+ *
+ * @param arena The arena.
+ * @param text The characters to copy.
+ * @param length The number of characters to copy.
+ * @return The copy, or NULL if memory allocation failed.
+ */
+char *arenaCopy(Arena *arena, const char *text, size_t length)
+{
+    char *copy = (char *)arenaAlloc(arena, length + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/**
+ * @brief Releases everything allocated from an arena in constant time.
+ *
+ * @param arena The arena to reset.
+ */
+void resetArena(Arena *arena)
+{
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+/**
+ * @brief Returns the chunks of an arena to the system and leaves it empty.
+ *
+ * @param arena The arena to free.
+ */
+void freeArena(Arena *arena)
+{
+    ArenaChunk *chunk, *next;
+    for (chunk = arena->first; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        free(chunk);
+    }
+    initArena(arena);
+}
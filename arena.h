@@ -0,0 +1,71 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Bytes per arena chunk. A typical file interns a few hundred names of up to 31 characters and keeps
+ * a few macro bodies of a few lines each, which fits in one or two chunks. */
+#define ARENA_CHUNK_SIZE 16384
+
+/* A block of memory handed out by an arena; the memory follows the header */
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next; /* The next chunk, kept for reuse after a reset */
+    size_t size;             /* Number of bytes that follow the header */
+} ArenaChunk;
+
+/* Bump allocator: allocations are carved out of large chunks and released all at once */
+typedef struct Arena
+{
+    ArenaChunk *first;   /* The first chunk, or NULL if nothing was allocated yet */
+    ArenaChunk *current; /* The chunk allocations are carved from, or NULL before the first one */
+    size_t used;         /* Number of bytes used in the current chunk */
+} Arena;
+
+/**
+ * @brief Initializes an empty arena.
+ *
+ * No memory is allocated until the first allocation.
+ *
+ * @param arena The arena to initialize.
+ */
+void initArena(Arena *arena);
+
+/**
+ * @brief Allocates memory from an arena.
+ *
+ * The memory is suitably aligned for any type and stays valid until the arena is reset or freed.
+ *
+ * @param arena The arena.
+ * @param size The number of bytes to allocate.
+ * @return The memory, or NULL if memory allocation failed.
+ */
+void *arenaAlloc(Arena *arena, size_t size);
+
+/**
+ * @brief Copies characters into an arena as a null-terminated string.
+ *
+ * @param arena The arena.
+ * @param text The characters to copy. They do not need to be null-terminated.
+ * @param length The number of characters to copy.
+ * @return The copy, or NULL if memory allocation failed.
+ */
+char *arenaCopy(Arena *arena, const char *text, size_t length);
+
+/**
+ * @brief Releases everything allocated from an arena in constant time.
+ *
+ * The chunks are kept and reused by the next allocations.
+ *
+ * @param arena The arena to reset.
+ */
+void resetArena(Arena *arena);
+
+/**
+ * @brief Returns the chunks of an arena to the system and leaves it empty.
+ *
+ * @param arena The arena to free.
+ */
+void freeArena(Arena *arena);
+
+#endif /* ARENA_H */
@@ -1,21 +1,294 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "macro_parser.h"
 #include "assembler.h"
 #include "utils.h"
 #include "data.h"
-#include "first_pass.h"
-#include "second_pass.h"
 #include "file_builder.h"
+#include "text_buffer.h"
+#include "job_pool.h"
+#include "libassembler.h"
+#include "server.h"
+#include "cache.h"
+#include "source_file.h"
+#include "prelude.h"
+#include "include.h"
+
+/* A file given on the command line, together with the messages of its assembly */
+typedef struct AssemblyJob
+{
+    const char *baseName;             /* The file name without its extension */
+    const AssemblerOptions *options;  /* The command line options */
+    TextBuffer diagnostics;           /* Messages produced while assembling the file */
+    TextBuffer report;                /* Statistics of the file, when asked for */
+} AssemblyJob;
+
+/**
+ * @brief Assembles one source file and writes its output files.
+ *
+ * The source file is mapped into memory and assembled in place with the library; the intermediate
+ * texts never touch the disk. A file name of '-' reads the source from standard input instead. The macro-expanded '.am' file is written only when the --am option is given.
+ * With --cache, a source that was assembled before has its outputs restored from the cache.
+ * With --prelude, the macros and constants of the prelude are defined before the source.
+ * A source with .include directives is not cached, since its outputs depend on other files.
+ * With --stats, the time spent in each phase and the work done are reported.
+ *
+ * @param ctx The library context to assemble with.
+ * @param baseName The name of the source file without its '.as' extension.
+ * @param options The command line options.
+ * @param diagnostics Receives the messages produced while assembling.
+ * @param report Receives the statistics of the file, when they were asked for.
+ */
+void assembleFile(AsmContext *ctx, const char *baseName, const AssemblerOptions *options, TextBuffer *diagnostics, TextBuffer *report)
+{
+    SourceFile source;
+    AsmResult result;
+    AsmStats stats;
+    PhaseTimer timer;
+    long obBytes, entBytes, extBytes, binBytes = 0;
+    int cached = 0, status, useCache, fromStdin = strcmp(baseName, STDIN_NAME) == 0;
+    char fileName[MAX_FILENAME_LEN];
+    char sourceName[MAX_FILENAME_LEN];
+    char message[MAX_MESSAGE_LENGTH + MAX_FILENAME_LEN];
+    char key[CACHE_KEY_LENGTH + 1];
+
+    if (strlen(baseName) + strlen(EXTENTION) >= MAX_FILENAME_LEN)
+    {
+        sprintf(message, "File name too long: %.80s\n", baseName);
+        appendString(diagnostics, message);
+        return;
+    }
+
+    /* Map the source file, or read standard input. If the source cannot be read, skip to the next file. */
+    if (fromStdin)
+    {
+        strcpy(fileName, STDIN_BASE_NAME);
+        status = readSourceStream(&source, stdin);
+    }
+    else
+    {
+        strcpy(fileName, baseName);
+        strcat(fileName, EXTENTION); /* Append file extension */
+        strcpy(sourceName, fileName);
+        status = openSourceFile(&source, fileName);
+        if (status == SOURCE_OPEN_FAILED)
+        {
+            sprintf(message, "Couldn't open file: %s\n", fileName);
+            appendString(diagnostics, message);
+            closeSourceFile(&source);
+            return;
+        }
+        cutOffExtension(fileName);
+    }
+    if (status == SOURCE_READ_FAILED)
+    {
+        if (fromStdin)
+        {
+            sprintf(message, "Couldn't read standard input\n");
+        }
+        else
+        {
+            sprintf(message, "Couldn't read file: %s%s\n", fileName, EXTENTION);
+        }
+        appendString(diagnostics, message);
+        closeSourceFile(&source);
+        return;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+
+    /* On a cache hit the outputs are restored without assembling. The '.am' file is not cached. */
+    useCache = options->cacheDir != NULL && !mentionsInclude(source.data, source.length);
+    if (useCache)
+    {
+        computeCacheKey(source.data, source.length, options->prelude != NULL ? options->prelude->hash : NULL, key);
+        startPhase(&timer);
+        cached = !options->keepAm && restoreFromCache(options->cacheDir, key, fileName, options->binary, diagnostics, &stats.bytesWritten);
+        endPhase(&timer, &stats, ASM_PHASE_OUTPUT);
+    }
+
+    if (!cached)
+    {
+        asm_context_set_file_name(ctx, fromStdin ? NULL : sourceName);
+        asm_assemble_buffer(ctx, source.data, source.length, &result);
+        asm_context_set_file_name(ctx, NULL);
+        appendText(diagnostics, result.diagnostics, result.diagnosticsLength);
+        stats = result.stats;
+        startPhase(&timer);
+
+        /* Write the macro-expanded code only when it was asked for */
+        if (options->keepAm)
+        {
+            TextBuffer expanded;
+            initTextBuffer(&expanded);
+            expanded.data = (char *)result.expanded;
+            expanded.length = result.expandedLength;
+            strcat(fileName, AM_EXTENTION);
+            if (writeTextBuffer(&expanded, fileName))
+            {
+                stats.bytesWritten += (unsigned long)expanded.length;
+            }
+            cutOffExtension(fileName);
+        }
+
+        if (result.success &&
+            (obBytes = createObFile(&result, fileName)) >= 0 &&    /* Create the object file */
+            (entBytes = createEntryFile(&result, fileName)) >= 0 && /* Create the entry file */
+            (extBytes = createExtFile(&result, fileName)) >= 0 &&   /* Create the external file */
+            (!options->binary || (binBytes = createBinaryObjectFile(&result, fileName)) >= 0))
+        {
+            stats.bytesWritten += (unsigned long)(obBytes + entBytes + extBytes + binBytes);
+            if (useCache)
+            {
+                storeInCache(options->cacheDir, key, &result);
+            }
+        }
+        endPhase(&timer, &stats, ASM_PHASE_OUTPUT);
+    }
+    closeSourceFile(&source);
+
+    if (options->stats == STATS_TEXT)
+    {
+        formatStatsText(baseName, &stats, cached, report);
+    }
+    else if (options->stats == STATS_JSON)
+    {
+        formatStatsJson(baseName, &stats, cached, report);
+    }
+}
+
+/**
+ * @brief Assembles the file of a job in a context of its own and keeps its messages in the job.
+ *
+ * @param arg The AssemblyJob to run.
+ */
+static void runAssemblyJob(void *arg)
+{
+    AssemblyJob *job = (AssemblyJob *)arg;
+    AsmContext *ctx = asm_context_create();
+
+    initTextBuffer(&job->diagnostics);
+    initTextBuffer(&job->report);
+    if (ctx == NULL)
+    {
+        appendString(&job->diagnostics, "Memory allocation failed\n");
+        return;
+    }
+    asm_context_set_pass_threads(ctx, job->options->passThreads);
+    asm_context_set_prelude(ctx, job->options->prelude);
+    assembleFile(ctx, job->baseName, job->options, &job->diagnostics, &job->report);
+    asm_context_destroy(ctx);
+}
+
+/**
+ * @brief Prints the messages and statistics collected for a job and releases them.
+ *
+ * Messages go to stderr and statistics to stdout. JSON statistics of all jobs form a single array,
+ * which the caller closes after the last job.
+ *
+ * @param job The job whose output is printed.
+ * @param first Nonzero for the first job printed.
+ */
+static void printJobOutput(AssemblyJob *job, int first)
+{
+    if (job->diagnostics.length > 0)
+    {
+        fwrite(job->diagnostics.data, 1, job->diagnostics.length, stderr);
+    }
+    if (job->options->stats == STATS_JSON)
+    {
+        fputs(first ? "[\n  " : ",\n  ", stdout);
+    }
+    if (job->report.length > 0)
+    {
+        fwrite(job->report.data, 1, job->report.length, stdout);
+    }
+    freeTextBuffer(&job->diagnostics);
+    freeTextBuffer(&job->report);
+}
+
+/**
+ * @brief Reads the number of workers given to the -j or --pass-threads option.
+ *
+ * @param text The number, as written on the command line.
+ * @return The number of workers, or 0 if the text is not a positive number.
+ */
+static int parseJobCount(const char *text)
+{
+    int jobs;
+    if (text == NULL || !isNumeric(text) || *text == '-' || *text == '+')
+    {
+        return 0;
+    }
+    jobs = atoi(text);
+    return jobs > MAX_WORKERS ? MAX_WORKERS : jobs;
+}
+
+/**
+ * @brief Loads the prelude given to the --prelude option.
+ *
+ * The snapshot next to the prelude, named after it with a '.pre' suffix, is mapped when it was built
+ * from the same source by the same version of the assembler. Otherwise the prelude is assembled and
+ * the snapshot written again for the next run; this run uses the snapshot from memory.
+ *
+ * @param fileName The name of the prelude source.
+ * @param prelude Receives the prelude. Release it with closePrelude.
+ * @param snapshot Holds a snapshot built by this run; it must outlive the prelude.
+ * @return 1 on success, 0 after printing why if the prelude could not be read or has errors.
+ */
+static int preparePrelude(const char *fileName, Prelude *prelude, TextBuffer *snapshot)
+{
+    SourceFile source;
+    TextBuffer diagnostics;
+    char snapshotName[MAX_PRELUDE_NAME_LENGTH + sizeof(DOT_PRE_SUFFIX)];
+    char hash[PRELUDE_HASH_LENGTH + 1];
+    int ok;
+
+    if (strlen(fileName) > MAX_PRELUDE_NAME_LENGTH)
+    {
+        fprintf(stderr, "Prelude file name too long: %.80s\n", fileName);
+        return 0;
+    }
+    if (openSourceFile(&source, fileName) != SOURCE_OPENED)
+    {
+        fprintf(stderr, "Couldn't read prelude: %s\n", fileName);
+        closeSourceFile(&source);
+        return 0;
+    }
+    hashPrelude(source.data, source.length, hash);
+    strcpy(snapshotName, fileName);
+    strcat(snapshotName, DOT_PRE_SUFFIX);
+    if (openPrelude(prelude, snapshotName, hash))
+    {
+        closeSourceFile(&source);
+        return 1;
+    }
+
+    /* No snapshot, or one of another source or version: assemble the prelude */
+    initTextBuffer(&diagnostics);
+    ok = buildPrelude(source.data, source.length, hash, snapshot, &diagnostics);
+    closeSourceFile(&source);
+    if (diagnostics.length > 0)
+    {
+        fwrite(diagnostics.data, 1, diagnostics.length, stderr);
+    }
+    freeTextBuffer(&diagnostics);
+    if (!ok)
+    {
+        fprintf(stderr, "Errors detected in the prelude %s. Exiting...\n", fileName);
+        return 0;
+    }
+    strcpy(snapshotName, fileName);
+    createPreludeFile(snapshot, snapshotName); /* A snapshot that cannot be written is only rebuilt next time */
+    return loadPrelude(prelude, snapshot->data, snapshot->length, hash);
+}
 
 /**
  * @brief Entry point of the assembler program.
  *
- * Processes each file provided as a command-line argument by performing the following steps:
- * - Macro processing: Preprocesses the file to expand macros.
- * - First Pass: Generates a symbol table and calculates memory addresses.
- * - Second Pass: Generates machine code using the symbol table and addresses determined in the first pass.
+ * Assembles each file provided as a command-line argument. With -j N, up to N files are assembled
+ * at the same time on a pool of worker threads. The messages of each file are printed in the order
+ * the files were given. With --serve, the program instead runs as a resident server on a Unix socket.
  *
  * @param argc Number of command-line arguments.
  * @param argv Array of command-line arguments including program name and input files.
@@ -24,114 +297,174 @@
 
 int main(int argc, char *argv[])
 {
-    FILE *fp, *cp, *mc;
-    int i;
-    char *fileName, *copyName;
+    AssemblerOptions options;
+    AssemblyJob *jobs;
+    const char *socketPath = NULL;
+    const char *preludeName = NULL;
+    Prelude prelude;
+    TextBuffer snapshot;
+    int i, fileCount = 0;
 
-    /* Check if the correct number of arguments is provided */
-    if (argc < 2)
+    options.keepAm = 0;
+    options.jobs = 1;
+    options.passThreads = 1;
+    options.binary = 0;
+    options.cacheDir = NULL;
+    options.prelude = NULL;
+    options.stats = STATS_NONE;
+
+    jobs = malloc(sizeof(AssemblyJob) * (argc > 1 ? argc - 1 : 1));
+    if (!jobs)
     {
-        fprintf(stderr, "Usage: %s <file1> <file2> ... <fileN>\n", argv[0]);
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "Memory allocation failed\n");
+        return EXIT_FAILURE;
     }
 
-    /* Process each file provided as argument */
+    /* Separate the options from the files, so options may appear anywhere on the command line */
     for (i = 1; i < argc; i++)
     {
-        /* Allocate memory for file names */
-        fileName = malloc(MAX_FILENAME_LEN);
-        copyName = malloc(MAX_FILENAME_LEN);
-        if (!fileName || !copyName)
+        if (strcmp(argv[i], KEEP_AM_OPTION) == 0)
         {
-            fprintf(stderr, "Memory allocation failed\n");
-            return EXIT_FAILURE;
+            options.keepAm = 1;
         }
-
-        strcpy(fileName, argv[i]);
-        strcpy(copyName, argv[i]);
-        strcat(fileName, EXTENTION);      /* Append file extension */
-        strcat(copyName, COPY_EXTENTION); /* Append file extension */
-
-        /* Open the source file for reading. If the file cannot be opened, skip to the next file. */
-        fp = fopen(fileName, "r");
-        if (fp == NULL)
+        else if (strncmp(argv[i], FORMAT_OPTION, strlen(FORMAT_OPTION)) == 0)
         {
-            fprintf(stderr, "Couldn't open file: %s\n", fileName);
-            free(fileName);
-            free(copyName);
-            continue;
+            const char *format = argv[i] + strlen(FORMAT_OPTION);
+            if (strcmp(format, FORMAT_BINARY) == 0 || strcmp(format, FORMAT_TEXT) == 0)
+            {
+                options.binary = strcmp(format, FORMAT_BINARY) == 0;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown output format: %s\n", format);
+                free(jobs);
+                exit(EXIT_FAILURE);
+            }
         }
-        /* Open a new file for writing the preprocessed code */
-        cp = fopen(copyName, "w+");
-        if (cp == NULL)
+        else if (strcmp(argv[i], STATS_OPTION) == 0)
         {
-            fprintf(stderr, "Failed to create a copy of the file.\n");
-            free(fileName);
-            fclose(fp);
-            continue;
+            options.stats = STATS_TEXT;
         }
-        cutOffExtension(fileName);
+        else if (strcmp(argv[i], STATS_JSON_OPTION) == 0)
+        {
+            options.stats = STATS_JSON;
+        }
+        else if (strcmp(argv[i], CACHE_OPTION) == 0)
+        {
+            if (i + 1 == argc)
+            {
+                fprintf(stderr, "Missing cache directory for %s\n", CACHE_OPTION);
+                free(jobs);
+                exit(EXIT_FAILURE);
+            }
+            options.cacheDir = argv[++i];
+        }
+        else if (strcmp(argv[i], SERVE_OPTION) == 0)
+        {
+            if (i + 1 == argc)
+            {
+                fprintf(stderr, "Missing socket path for %s\n", SERVE_OPTION);
+                free(jobs);
+                exit(EXIT_FAILURE);
+            }
+            socketPath = argv[++i];
+        }
+        else if (strcmp(argv[i], PRELUDE_OPTION) == 0)
+        {
+            if (i + 1 == argc)
+            {
+                fprintf(stderr, "Missing prelude file for %s\n", PRELUDE_OPTION);
+                free(jobs);
+                exit(EXIT_FAILURE);
+            }
+            preludeName = argv[++i];
+        }
+        else if (strcmp(argv[i], PASS_THREADS_OPTION) == 0)
+        {
+            if ((options.passThreads = parseJobCount(i + 1 < argc ? argv[++i] : NULL)) == 0)
+            {
+                fprintf(stderr, "Invalid number of threads for %s\n", PASS_THREADS_OPTION);
+                free(jobs);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strncmp(argv[i], JOBS_OPTION, strlen(JOBS_OPTION)) == 0)
+        {
+            /* Accept both "-j N" and "-jN" */
+            const char *count = argv[i][strlen(JOBS_OPTION)] ? argv[i] + strlen(JOBS_OPTION) : (i + 1 < argc ? argv[++i] : NULL);
+            if ((options.jobs = parseJobCount(count)) == 0)
+            {
+                fprintf(stderr, "Invalid number of jobs for %s\n", JOBS_OPTION);
+                free(jobs);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            jobs[fileCount].baseName = argv[i];
+            jobs[fileCount].options = &options;
+            fileCount++;
+        }
+    }
 
-        /** Copy the content of the source file to the new file after preprocessing */
-        skipAndCopy(fp, cp);
-        rewind(cp);
-        fclose(fp); /** Close the original file after copying */
+    /* Serve requests over a socket instead of assembling the files on the command line */
+    if (socketPath != NULL)
+    {
+        free(jobs);
+        return runServer(socketPath);
+    }
 
-        /** Perform macro processing on the copied file */
-        macroParser(cp, fileName);
+    /* Check if the correct number of arguments is provided */
+    if (fileCount < 1)
+    {
+        fprintf(stderr, "Usage: %s [%s] [%s N] [%s N] [%s <dir>] [%s <file>] [%s[=json]] [%s%s|%s] <file1> <file2> ... <fileN>\n", argv[0], KEEP_AM_OPTION, JOBS_OPTION, PASS_THREADS_OPTION, CACHE_OPTION, PRELUDE_OPTION, STATS_OPTION, FORMAT_OPTION, FORMAT_TEXT, FORMAT_BINARY);
+        fprintf(stderr, "       %s %s <socket>\n", argv[0], SERVE_OPTION);
+        free(jobs);
+        exit(EXIT_FAILURE);
+    }
 
-        /** Open the file containing the macro-expanded code */
-        mc = fopen(fileName, "r");
-        if (mc == NULL)
+    /* Load the prelude once; every job reads the same one */
+    initTextBuffer(&snapshot);
+    if (preludeName != NULL)
+    {
+        if (!preparePrelude(preludeName, &prelude, &snapshot))
         {
-            fprintf(stderr, "couldn't open macro file %s\n", fileName);
-            free(fileName);
-            free(copyName);
-            fclose(cp); /** Ensure all files are closed */
-            continue;
+            freeTextBuffer(&snapshot);
+            free(jobs);
+            exit(EXIT_FAILURE);
         }
+        options.prelude = &prelude;
+    }
 
-        /** Print the content of the macro-expanded file for verification/debugging */
-        rewind(mc);
-        /** Perform the first pass of the assembler */
-        firstPass(mc);
-        if (errorFlag)
+    if (options.jobs <= 1)
+    {
+        /* Process each file in turn, printing its messages as soon as it is done */
+        for (i = 0; i < fileCount; i++)
         {
-            fprintf(stderr, "Errors detected in the first pass. Exiting...\n");
-            fclose(mc);
-            fclose(cp);
-            remove(copyName);
-            free(fileName);
-            free(copyName);
-
-            continue;
+            runAssemblyJob(&jobs[i]);
+            printJobOutput(&jobs[i], i == 0);
         }
-        rewind(mc);
-        /* Perform the second pass of the assembler */
-        secondPass(mc);
-        /** Perform the second pass of the assembler */
-        secondPass(mc);
-        if (errorFlag)
+    }
+    else
+    {
+        /* Assemble the files in parallel, then print their messages in command line order */
+        runJobs(jobs, sizeof(AssemblyJob), fileCount, options.jobs, runAssemblyJob);
+        for (i = 0; i < fileCount; i++)
         {
-            fprintf(stderr, "Errors detected in the second pass. Exiting...\n");
-            fclose(mc);
-            fclose(cp);
-            remove(copyName);
-            free(fileName);
-            free(copyName);
-
-            continue;
+            printJobOutput(&jobs[i], i == 0);
         }
-        cutOffExtension(fileName);
-        createObFile(fileName, memoryAddress); /* Create the object file */
-        createEntryFile(fileName);             /* Create the entry file */
-        createExtFile(fileName);               /* Create the external file */
-        fclose(mc);                            /* Close the macro file */
-        remove(copyName);                      /* Remove the copy file */
-        freeMemoryLines();                     /* Free memory allocated for memory lines */
-        free(fileName);
-        free(copyName);
+    }
+    if (options.stats == STATS_JSON)
+    {
+        fputs("\n]\n", stdout);
     }
 
+    if (options.prelude != NULL)
+    {
+        closePrelude(&prelude);
+    }
+    freeTextBuffer(&snapshot);
+    asm_clear_include_cache();
+    free(jobs);
     return EXIT_SUCCESS; /* Successful termination of the program */
 }
@@ -1,9 +1,46 @@
 #ifndef ASSEMBLER_H
 #define ASSEMBLER_H
 
+#include "data.h"
+#include "text_buffer.h"
+#include "libassembler.h"
+#include "stats.h"
+
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
 #define EXTENTION ".as"
-#define COPY_EXTENTION ".copy"
+#define AM_EXTENTION ".am"
+#define STDIN_NAME "-"          /* A file name that reads the source from standard input */
+#define STDIN_BASE_NAME "stdin" /* The name of the output files of standard input */
+#define KEEP_AM_OPTION "--am"
+#define JOBS_OPTION "-j"
+#define PASS_THREADS_OPTION "--pass-threads"
+#define FORMAT_OPTION "--format="
+#define FORMAT_TEXT "text"
+#define FORMAT_BINARY "bin"
+#define MAX_PRELUDE_NAME_LENGTH 200 /* Longest prelude file name, leaving room for its snapshot suffix */
+
+/* Options given on the command line that apply to every assembled file */
+typedef struct AssemblerOptions
+{
+    int keepAm; /* Write the macro-expanded source to a '.am' file */
+    int jobs;   /* Number of files assembled at the same time */
+    int passThreads; /* Number of threads the first pass of each file reads the source on */
+    int binary; /* Also write the binary object file '.bin' */
+    const char *cacheDir; /* Directory of the build cache, or NULL when caching is off */
+    const AsmPrelude *prelude; /* Macros and constants defined before every file, or NULL */
+    StatsFormat stats;    /* Format of the per-file statistics report */
+} AssemblerOptions;
+
+/**
+ * @brief Assembles one source file and writes its output files.
+ *
+ * @param ctx The library context to assemble with.
+ * @param baseName The name of the source file without its '.as' extension.
+ * @param options The command line options.
+ * @param diagnostics Receives the messages produced while assembling.
+ * @param report Receives the statistics of the file, when they were asked for.
+ */
+void assembleFile(AsmContext *ctx, const char *baseName, const AssemblerOptions *options, TextBuffer *diagnostics, TextBuffer *report);
 
-#endif
\ No newline at end of file
+#endif
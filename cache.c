@@ -0,0 +1,254 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "file_builder.h"
+#include "object_file.h"
+#include "text_buffer.h"
+#include "data.h"
+
+#define MAX_CACHE_PATH (MAX_FILENAME_LEN + CACHE_KEY_LENGTH + 16)
+
+/**
+ * @brief Computes the cache key of a source.
+ *
+ * @param source The source code.
+ * @param length The number of characters in the source.
+ * @param preludeHash The hash of the prelude defined before the source, or NULL if there is none.
+ * @param key Buffer of at least CACHE_KEY_LENGTH + 1 characters receiving the key.
+ */
+void computeCacheKey(const char *source, size_t length, const char *preludeHash, char key[])
+{
+    Sha256 sha;
+    sha256Init(&sha);
+    sha256Update(&sha, ASM_VERSION, sizeof(ASM_VERSION)); /* The null terminator separates the version from the source */
+    if (preludeHash != NULL)
+    {
+        sha256Update(&sha, preludeHash, strlen(preludeHash) + 1);
+    }
+    sha256Update(&sha, source, length);
+    sha256FinalHex(&sha, key);
+}
+
+/**
+ * @brief Builds the path of a file in the cache directory.
+ *
+ * @param path Buffer of MAX_CACHE_PATH characters receiving the path.
+ * @param cacheDir The cache directory.
+ * @param name The name of the file.
+ * @return 1 on success, 0 if the path is too long.
+ */
+static int cachePath(char path[], const char *cacheDir, const char *name)
+{
+    if (strlen(cacheDir) + strlen(name) + 2 > MAX_CACHE_PATH)
+    {
+        return 0;
+    }
+    sprintf(path, "%s/%s", cacheDir, name);
+    return 1;
+}
+
+/**
+ * @brief Reads the next section of a cache file.
+ *
+ * @param cursor The read position, moved past the section.
+ * @param end The end of the cache file.
+ * @param name The expected name of the section.
+ * @param data Receives the start of the section content.
+ * @param length Receives the length of the section content.
+ * @return 1 on success, 0 if the file is malformed.
+ */
+static int readSection(const char **cursor, const char *end, const char *name, const char **data, size_t *length)
+{
+    size_t nameLength = strlen(name);
+    const char *p = *cursor;
+    unsigned long value = 0;
+
+    if ((size_t)(end - p) < nameLength + 2 || strncmp(p, name, nameLength) != 0 || p[nameLength] != ' ')
+    {
+        return 0;
+    }
+    for (p += nameLength + 1; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        value = value * 10 + (unsigned long)(*p - '0');
+    }
+    if (p == end || *p != '\n' || (unsigned long)(end - p - 1) < value)
+    {
+        return 0;
+    }
+    *data = p + 1;
+    *length = (size_t)value;
+    *cursor = p + 1 + value;
+    return 1;
+}
+
+/**
+ * @brief Writes an output file named after the source file.
+ *
+ * The file is written as the assembler writes it, under a temporary name renamed into place, so a
+ * reader never sees a partial file.
+ *
+ * @param baseName The name of the source file without its extension.
+ * @param suffix The extension of the output file.
+ * @param data The content of the file.
+ * @param length The number of bytes in the content.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+static int writeOutput(const char *baseName, const char *suffix, const char *data, size_t length)
+{
+    char fileName[MAX_FILENAME_LEN + 8];
+    TextBuffer text;
+
+    if (strlen(baseName) >= MAX_FILENAME_LEN)
+    {
+        return 0;
+    }
+    strcpy(fileName, baseName);
+    text.data = (char *)data; /* A view of the cached bytes, which are only read */
+    text.length = length;
+    text.capacity = length;
+    text.position = 0;
+    return writeOutputFile(&text, fileName, suffix) >= 0;
+}
+
+/**
+ * @brief Restores the outputs of a source from the cache.
+ *
+ * @param cacheDir The cache directory.
+ * @param key The cache key of the source.
+ * @param baseName The name of the source file without its extension.
+ * @param binary Nonzero to also write the binary '.bin' object file.
+ * @param diagnostics Receives the messages recorded with the outputs.
+ * @param bytesWritten Incremented by the number of bytes of output files written.
+ * @return 1 on a hit, 0 on a miss.
+ */
+int restoreFromCache(const char *cacheDir, const char *key, const char *baseName, int binary, TextBuffer *diagnostics, unsigned long *bytesWritten)
+{
+    char path[MAX_CACHE_PATH];
+    const char *cursor, *end, *ob, *ent, *ext, *bin, *diag;
+    size_t obLength, entLength, extLength, binLength, diagLength;
+    TextBuffer entry;
+    FILE *fp;
+    int hit;
+
+    if (!cachePath(path, cacheDir, key) || (fp = fopen(path, "rb")) == NULL)
+    {
+        return 0;
+    }
+    initTextBuffer(&entry);
+    hit = appendFile(&entry, fp);
+    fclose(fp);
+
+    /* A malformed entry is treated as a miss and overwritten by the next store */
+    cursor = entry.data;
+    end = entry.data + entry.length;
+    hit = hit && entry.length >= strlen(CACHE_MAGIC) && strncmp(cursor, CACHE_MAGIC, strlen(CACHE_MAGIC)) == 0;
+    if (hit)
+    {
+        cursor += strlen(CACHE_MAGIC);
+        hit = readSection(&cursor, end, "OB", &ob, &obLength) &&
+              readSection(&cursor, end, "ENT", &ent, &entLength) &&
+              readSection(&cursor, end, "EXT", &ext, &extLength) &&
+              readSection(&cursor, end, "BIN", &bin, &binLength) &&
+              readSection(&cursor, end, "DIAG", &diag, &diagLength) && cursor == end;
+    }
+    if (hit)
+    {
+        hit = writeOutput(baseName, DOT_OB_SUFFIX, ob, obLength) &&
+              (entLength == 0 || writeOutput(baseName, DOT_ENT_SUFFIX, ent, entLength)) &&
+              (extLength == 0 || writeOutput(baseName, DOT_EXT_SUFFIX, ext, extLength)) &&
+              (!binary || writeOutput(baseName, DOT_BIN_SUFFIX, bin, binLength));
+    }
+    if (hit)
+    {
+        appendText(diagnostics, diag, diagLength);
+        *bytesWritten += (unsigned long)(obLength + entLength + extLength + (binary ? binLength : 0));
+    }
+    freeTextBuffer(&entry);
+    return hit;
+}
+
+/**
+ * @brief Appends a section of a cache file: a header line with its length, then its bytes.
+ *
+ * @param entry The cache file being built.
+ * @param name The name of the section.
+ * @param text The content of the section.
+ * @param length The number of bytes in the content.
+ */
+static void appendCacheSection(TextBuffer *entry, const char *name, const char *text, size_t length)
+{
+    char header[MAX_MESSAGE_LENGTH];
+    sprintf(header, "%s %lu\n", name, (unsigned long)length);
+    appendString(entry, header);
+    appendText(entry, text, length);
+}
+
+/**
+ * @brief Records the outputs of a successful assembly in the cache.
+ *
+ * @param cacheDir The cache directory.
+ * @param key The cache key of the source.
+ * @param result The output of the assembly.
+ */
+void storeInCache(const char *cacheDir, const char *key, const AsmResult *result)
+{
+    char path[MAX_CACHE_PATH], tempPath[MAX_CACHE_PATH], tempName[CACHE_KEY_LENGTH + 64];
+    TextBuffer entry, text;
+    int fd = -1, attempt, ok;
+
+    if (!result->success || !cachePath(path, cacheDir, key))
+    {
+        return;
+    }
+
+    initTextBuffer(&entry);
+    initTextBuffer(&text);
+    appendString(&entry, CACHE_MAGIC);
+    formatObFile(result, &text);
+    appendCacheSection(&entry, "OB", text.data, text.length);
+    clearTextBuffer(&text);
+    formatEntryFile(result, &text);
+    appendCacheSection(&entry, "ENT", text.data, text.length);
+    clearTextBuffer(&text);
+    formatExtFile(result, &text);
+    appendCacheSection(&entry, "EXT", text.data, text.length);
+    clearTextBuffer(&text);
+    formatObjectFile(result, &text);
+    appendCacheSection(&entry, "BIN", text.data, text.length);
+    appendCacheSection(&entry, "DIAG", result->diagnostics, result->diagnosticsLength);
+    freeTextBuffer(&text);
+
+    /* Write under a unique temporary name, then rename into place atomically. The file is created with
+     * the default permissions, 0666 less the umask, as output files are, so the processes of other users
+     * sharing the cache can read it; mkstemp would create it for its owner only. */
+    for (attempt = 0; fd < 0 && attempt < MAX_TEMP_ATTEMPTS; attempt++)
+    {
+        sprintf(tempName, ".tmp-%.64s-%ld-%d", key, (long)getpid(), attempt);
+        if (!cachePath(tempPath, cacheDir, tempName))
+        {
+            break;
+        }
+        fd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd < 0 && errno != EEXIST)
+        {
+            break;
+        }
+    }
+    if (fd >= 0)
+    {
+        ok = write(fd, entry.data, entry.length) == (ssize_t)entry.length;
+        ok = close(fd) == 0 && ok;
+        if (!ok || rename(tempPath, path) != 0)
+        {
+            unlink(tempPath);
+        }
+    }
+    freeTextBuffer(&entry);
+}
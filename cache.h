@@ -0,0 +1,71 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+#include "libassembler.h"
+#include "text_buffer.h"
+#include "sha256.h"
+
+#define CACHE_OPTION "--cache"
+#define CACHE_KEY_LENGTH SHA256_HEX_LENGTH
+#define CACHE_MAGIC "ASMCACHE 2\n"
+
+/*
+ * The cache is a directory holding one file per assembled source, named after its key. The key is
+ * the SHA-256 of the assembler version followed by the source bytes, so a new version never reuses
+ * outputs of an older one. With a prelude, the hash of the prelude source comes between the two.
+ * A cache file holds the sections of the outputs, one after the other with nothing in between:
+ *
+ *   ASMCACHE 2\n
+ *   OB <length>\n<bytes>
+ *   ENT <length>\n<bytes>
+ *   EXT <length>\n<bytes>
+ *   BIN <length>\n<bytes>
+ *   DIAG <length>\n<bytes>
+ *
+ * The BIN section holds the '.bin' object file, recorded whether or not it was asked for. A file that
+ * does not start with CACHE_MAGIC, or whose sections do not fill it exactly, is a miss.
+ *
+ * Files are written under a temporary name and renamed into place, so processes sharing the cache
+ * see either a complete file or none.
+ */
+
+/**
+ * @brief Computes the cache key of a source.
+ *
+ * @param source The source code.
+ * @param length The number of characters in the source.
+ * @param preludeHash The hash of the prelude defined before the source, or NULL if there is none.
+ * @param key Buffer of at least CACHE_KEY_LENGTH + 1 characters receiving the key.
+ */
+void computeCacheKey(const char *source, size_t length, const char *preludeHash, char key[]);
+
+/**
+ * @brief Restores the outputs of a source from the cache.
+ *
+ * On a hit, the '.ob' file and the non-empty '.ent' and '.ext' files are written next to the source,
+ * along with the '.bin' file when it is asked for, and the recorded messages are appended to diagnostics.
+ *
+ * @param cacheDir The cache directory.
+ * @param key The cache key of the source.
+ * @param baseName The name of the source file without its extension.
+ * @param binary Nonzero to also write the binary '.bin' object file.
+ * @param diagnostics Receives the messages recorded with the outputs.
+ * @param bytesWritten Incremented by the number of bytes of output files written.
+ * @return 1 on a hit, 0 on a miss.
+ */
+int restoreFromCache(const char *cacheDir, const char *key, const char *baseName, int binary, TextBuffer *diagnostics, unsigned long *bytesWritten);
+
+/**
+ * @brief Records the outputs of a successful assembly in the cache.
+ *
+ * Failures are silently ignored; the cache only ever saves work.
+ *
+ * @param cacheDir The cache directory.
+ * @param key The cache key of the source.
+ * @param result The output of the assembly.
+ */
+void storeInCache(const char *cacheDir, const char *key, const AsmResult *result);
+
+#endif /* CACHE_H */
@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "conditional.h"
+#include "keywords.h"
+#include "first_pass.h"
+#include "prelude.h"
+#include "utils.h"
+
+/* Comparison operators of an .if condition, in the order compareValues handles them */
+static const char *const conditionOperators[] = {"==", "!=", "<", "<=", ">", ">="};
+
+#define CONDITION_OPERATORS (int)(sizeof(conditionOperators) / sizeof(conditionOperators[0]))
+
+/**
+ * @brief Checks whether a character separates the words of a line, without ending it.
+ *
+ * @param c The character.
+ * @return Nonzero for a space or a tab.
+ */
+static int isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/**
+ * @brief Checks whether a text holds a conditional directive as the first word of a line.
+ *
+ * Only the dots of the text are examined: one starts a line's first word if nothing but blanks lies
+ * between it and the start of its line.
+ *
+ * @param text The text.
+ * @param length The number of characters in the text.
+ * @return 1 if a line of the text starts with .if, .ifdef, .else or .endif, 0 otherwise.
+ */
+int mentionsConditional(const char *text, size_t length)
+{
+    const char *end = text + length;
+    const char *dot, *lineStart, *lineEnd;
+
+    for (dot = text; (dot = memchr(dot, '.', (size_t)(end - dot))) != NULL; dot++)
+    {
+        for (lineStart = dot; lineStart > text && isBlank(lineStart[-1]); lineStart--)
+        {
+        }
+        if (lineStart == text || lineStart[-1] == '\n')
+        {
+            lineEnd = memchr(dot, '\n', (size_t)(end - dot));
+            if (conditionalType(dot, (size_t)((lineEnd != NULL ? lineEnd : end) - dot)) != INVALID_DIRECTIVE)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds the conditional directive a line starts with, without tokenizing the line.
+ *
+ * The first word is looked up in the keyword table, like the directives the lexer finds.
+ *
+ * @param text The line. It does not need to be null-terminated.
+ * @param length The number of characters of the line.
+ * @return IF_DIRECTIVE, IFDEF_DIRECTIVE, ELSE_DIRECTIVE or ENDIF_DIRECTIVE, or INVALID_DIRECTIVE for any other line.
+ */
+DirectiveType conditionalType(const char *text, size_t length)
+{
+    const Keyword *keyword;
+    size_t start = 0, end;
+
+    while (start < length && isBlank(text[start]))
+    {
+        start++;
+    }
+    if (start == length || text[start] != '.')
+    {
+        return INVALID_DIRECTIVE;
+    }
+    for (end = start; end < length && !isspace((unsigned char)text[end]); end++)
+    {
+    }
+    keyword = findKeyword(text + start, end - start);
+    if (keyword == NULL || keyword->kind != KEYWORD_DIRECTIVE ||
+        keyword->value < IF_DIRECTIVE || keyword->value > ENDIF_DIRECTIVE)
+    {
+        return INVALID_DIRECTIVE;
+    }
+    return (DirectiveType)keyword->value;
+}
+
+/**
+ * @brief Copies a line of a text into a null-terminated buffer, without its surrounding whitespace.
+ *
+ * @param text The line, inside the text.
+ * @param available The number of characters from the line to the end of the text.
+ * @param line Buffer of MAX_LINE_LENGTH characters. A longer line is cut.
+ */
+static void copyLine(const char *text, size_t available, char *line)
+{
+    const char *lineEnd = memchr(text, '\n', available);
+    size_t length = lineEnd != NULL ? (size_t)(lineEnd - text) : available;
+
+    length = length < MAX_LINE_LENGTH - 1 ? length : MAX_LINE_LENGTH - 1;
+    memcpy(line, text, length);
+    line[length] = '\0';
+    trimLine(line);
+}
+
+/**
+ * @brief Reports an error on a line of the source. The line number is only counted here, since errors are rare.
+ *
+ * @param ctx The assembler context.
+ * @param source The source.
+ * @param start Offset of the line in the source.
+ * @param message The error message.
+ */
+static void reportLineError(AssemblerContext *ctx, const TextBuffer *source, size_t start, const char *message)
+{
+    char line[MAX_LINE_LENGTH];
+    const char *p, *end = source->data + start;
+    int lineNumber = 1;
+
+    for (p = source->data; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++)
+    {
+        lineNumber++;
+    }
+    copyLine(source->data + start, source->length - start, line);
+    ctx->lineErrorFlag = 0;
+    handleError(ctx, message, lineNumber, line);
+}
+
+/**
+ * @brief Skips lines up to the .else or .endif of the innermost open conditional block.
+ *
+ * The lines are only checked for the directives that open and close nested blocks: they are not
+ * tokenized, stored or expanded, and the macros they define are not defined.
+ *
+ * @param ctx The assembler context.
+ * @param source The source, positioned after the line that starts the skipped lines.
+ * @param stop Receives the offset of the line the skip stopped at.
+ * @return ELSE_DIRECTIVE or ENDIF_DIRECTIVE, or INVALID_DIRECTIVE if the source ended first.
+ */
+static DirectiveType skipInactiveLines(AssemblerContext *ctx, TextBuffer *source, size_t *stop)
+{
+    const char *text;
+    size_t length;
+    DirectiveType type;
+    int nested = 0; /* Blocks opened by the skipped lines and not closed yet */
+
+    while ((text = bufferNextLine(source, source->length, &length)) != NULL)
+    {
+        ctx->linesRead++;
+        type = conditionalType(text, length);
+        if (type == IF_DIRECTIVE || type == IFDEF_DIRECTIVE)
+        {
+            nested++;
+        }
+        else if (type == ENDIF_DIRECTIVE && nested > 0)
+        {
+            nested--;
+        }
+        else if (type != INVALID_DIRECTIVE && nested == 0)
+        {
+            *stop = (size_t)(text - source->data);
+            return type;
+        }
+    }
+    return INVALID_DIRECTIVE;
+}
+
+/**
+ * @brief Skips the part of the innermost open conditional block that is not assembled.
+ *
+ * The lines after its .else are assembled, if it has one; otherwise the block ends at its .endif.
+ * A block the source ends inside stays open, for endConditions to report.
+ *
+ * @param ctx The assembler context.
+ * @param source The source, positioned after the line that starts the skipped part.
+ */
+static void skipInactiveBlock(AssemblerContext *ctx, TextBuffer *source)
+{
+    unsigned long elseBit = 1UL << (ctx->conditionDepth - 1);
+    DirectiveType type;
+    size_t stop;
+
+    while ((type = skipInactiveLines(ctx, source, &stop)) == ELSE_DIRECTIVE)
+    {
+        if (!(ctx->elseSeen & elseBit))
+        {
+            ctx->elseSeen |= elseBit;
+            return;
+        }
+        reportLineError(ctx, source, stop, "Duplicate .else in conditional block");
+    }
+    if (type == ENDIF_DIRECTIVE)
+    {
+        ctx->conditionDepth--;
+    }
+}
+
+/**
+ * @brief Reads an operand of a condition: a number, or the name of a constant defined with .define.
+ *
+ * @param ctx The assembler context.
+ * @param text The condition, from the operand on. It is advanced past the operand.
+ * @param value Receives the value of the operand.
+ * @return NULL on success, or the error message.
+ */
+static const char *readConditionOperand(AssemblerContext *ctx, const char **text, int *value)
+{
+    char operand[MAX_LINE_LENGTH];
+    const char *start = *text;
+    Symbol *symbol;
+    size_t length;
+
+    while (isBlank(*start))
+    {
+        start++;
+    }
+    length = strcspn(start, " \t=!<>");
+    if (length == 0)
+    {
+        return "Missing operand in condition";
+    }
+    memcpy(operand, start, length);
+    operand[length] = '\0';
+    *text = start + length;
+
+    if (isNumeric(operand))
+    {
+        *value = atoi(operand);
+        return NULL;
+    }
+    symbol = lookupSymbol(ctx, operand);
+    if (symbol == NULL || symbol->symbolType != mdefine)
+    {
+        return "Condition uses an undefined constant";
+    }
+    *value = (int)symbol->value;
+    return NULL;
+}
+
+/**
+ * @brief Compares two values with a comparison operator of a condition.
+ *
+ * @param left The value before the operator.
+ * @param op Index of the operator in conditionOperators.
+ * @param right The value after the operator.
+ * @return 1 if the comparison holds, 0 otherwise.
+ */
+static int compareValues(int left, int op, int right)
+{
+    switch (op)
+    {
+    case 0:
+        return left == right;
+    case 1:
+        return left != right;
+    case 2:
+        return left < right;
+    case 3:
+        return left <= right;
+    case 4:
+        return left > right;
+    default:
+        return left >= right;
+    }
+}
+
+/**
+ * @brief Evaluates the condition of an .if directive: an operand, true when it is not zero,
+ * or two operands compared with ==, !=, <, <=, > or >=.
+ *
+ * @param ctx The assembler context.
+ * @param text The condition, without trailing whitespace.
+ * @param holds Receives 1 if the condition holds, 0 otherwise.
+ * @return NULL on success, or the error message.
+ */
+static const char *evaluateCondition(AssemblerContext *ctx, const char *text, int *holds)
+{
+    const char *error;
+    int left, right, op;
+    size_t length;
+
+    if ((error = readConditionOperand(ctx, &text, &left)) != NULL)
+    {
+        return error;
+    }
+    while (isBlank(*text))
+    {
+        text++;
+    }
+    if (*text == '\0')
+    {
+        *holds = left != 0;
+        return NULL;
+    }
+
+    length = strspn(text, "=!<>");
+    for (op = 0; op < CONDITION_OPERATORS; op++)
+    {
+        if (strlen(conditionOperators[op]) == length && strncmp(conditionOperators[op], text, length) == 0)
+        {
+            break;
+        }
+    }
+    if (length == 0 || op == CONDITION_OPERATORS)
+    {
+        return "Invalid operator in condition";
+    }
+    text += length;
+    if ((error = readConditionOperand(ctx, &text, &right)) != NULL)
+    {
+        return error;
+    }
+    if (*text != '\0')
+    {
+        return "Extraneous text after condition";
+    }
+    *holds = compareValues(left, op, right);
+    return NULL;
+}
+
+/**
+ * @brief Evaluates the condition of an .ifdef directive: the name of a constant, which holds if the constant is defined.
+ *
+ * @param ctx The assembler context.
+ * @param text The condition, without trailing whitespace.
+ * @param holds Receives 1 if the constant is defined, 0 otherwise.
+ * @return NULL on success, or the error message.
+ */
+static const char *evaluateDefined(AssemblerContext *ctx, const char *text, int *holds)
+{
+    char name[MAX_LINE_LENGTH];
+    Symbol *symbol;
+    size_t length;
+
+    while (isBlank(*text))
+    {
+        text++;
+    }
+    length = strcspn(text, " \t");
+    if (length == 0)
+    {
+        return "Missing constant name after .ifdef";
+    }
+    if (text[length] != '\0')
+    {
+        return "Extraneous text after constant name";
+    }
+    memcpy(name, text, length);
+    name[length] = '\0';
+    symbol = lookupSymbol(ctx, name);
+    *holds = symbol != NULL && symbol->symbolType == mdefine;
+    return NULL;
+}
+
+/**
+ * @brief Prepares a context to evaluate the conditional blocks of a source.
+ *
+ * The symbol table is emptied and given the constants of the prelude; the first pass empties it again.
+ *
+ * @param ctx The assembler context.
+ */
+void beginConditions(AssemblerContext *ctx)
+{
+    initSymbolTable(ctx);
+    applyPreludeConstants(ctx);
+    ctx->conditionDepth = 0;
+    ctx->elseSeen = 0;
+}
+
+/**
+ * @brief Processes a line of the source if it is a conditional directive.
+ *
+ * An .if or .ifdef opens a block; when its condition does not hold, its lines are skipped up to its
+ * .else or .endif. An .else reached while the block is assembled skips the lines up to its .endif.
+ * A condition that cannot be evaluated is reported, and its block is skipped.
+ *
+ * @param ctx The assembler context.
+ * @param source The source, positioned after the line.
+ * @param text The line, inside the source.
+ * @param length The number of characters of the line.
+ * @return 1 if the line was a conditional directive, which is not part of the output, 0 otherwise.
+ */
+int processConditional(AssemblerContext *ctx, TextBuffer *source, const char *text, size_t length)
+{
+    char line[MAX_LINE_LENGTH];
+    DirectiveType type = conditionalType(text, length);
+    size_t start = (size_t)(text - source->data), stop;
+    const char *condition, *error;
+    unsigned long elseBit;
+    int holds = 0;
+
+    if (type == INVALID_DIRECTIVE)
+    {
+        return 0;
+    }
+    copyLine(text, length, line);
+    condition = line + strcspn(line, " \t"); /* The line starts with the directive */
+
+    if (type == IF_DIRECTIVE || type == IFDEF_DIRECTIVE)
+    {
+        error = type == IF_DIRECTIVE ? evaluateCondition(ctx, condition, &holds) : evaluateDefined(ctx, condition, &holds);
+        if (error != NULL)
+        {
+            reportLineError(ctx, source, start, error);
+        }
+        if (ctx->conditionDepth == MAX_CONDITION_DEPTH)
+        {
+            reportLineError(ctx, source, start, "Conditional blocks nested too deeply");
+            while (skipInactiveLines(ctx, source, &stop) == ELSE_DIRECTIVE)
+            {
+                /* The whole block is skipped, whatever its condition */
+            }
+            return 1;
+        }
+        ctx->conditionStarts[ctx->conditionDepth] = start;
+        ctx->elseSeen &= ~(1UL << ctx->conditionDepth);
+        ctx->conditionDepth++;
+        if (!holds)
+        {
+            skipInactiveBlock(ctx, source);
+        }
+        return 1;
+    }
+
+    if (*condition != '\0')
+    {
+        reportLineError(ctx, source, start, "Extraneous text after conditional directive");
+    }
+    if (ctx->conditionDepth == 0)
+    {
+        reportLineError(ctx, source, start, type == ELSE_DIRECTIVE ? "Unmatched .else" : "Unmatched .endif");
+        return 1;
+    }
+    if (type == ENDIF_DIRECTIVE)
+    {
+        ctx->conditionDepth--;
+        return 1;
+    }
+    elseBit = 1UL << (ctx->conditionDepth - 1);
+    if (ctx->elseSeen & elseBit)
+    {
+        reportLineError(ctx, source, start, "Duplicate .else in conditional block");
+    }
+    ctx->elseSeen |= elseBit;
+    skipInactiveBlock(ctx, source);
+    return 1;
+}
+
+/**
+ * @brief Defines the constants of the .define lines of a text, so the conditions after them see them.
+ *
+ * The lines are checked as the first pass checks them, with the error reporting of the context held
+ * off: an invalid definition is left for the first pass to report.
+ *
+ * @param ctx The assembler context.
+ * @param text The lines.
+ * @param length The number of characters of the lines.
+ */
+void noteDefinitions(AssemblerContext *ctx, const char *text, size_t length)
+{
+    char line[MAX_LINE_LENGTH];
+    char constantName[MAX_LINE_LENGTH];
+    const char *end = text + length, *next, *word;
+    int lineErrorFlag = ctx->lineErrorFlag;
+    int value;
+
+    for (; text < end; text = next)
+    {
+        next = memchr(text, '\n', (size_t)(end - text));
+        next = next != NULL ? next + 1 : end;
+        for (word = text; word < next && isBlank(*word); word++)
+        {
+        }
+        if ((size_t)(next - word) < 7 || strncmp(word, ".define", 7) != 0 ||
+            (size_t)(next - text) - (next[-1] == '\n') > MAX_LINE_LENGTH - 2)
+        {
+            continue; /* Not a definition, or too long for the first pass to accept */
+        }
+        copyLine(text, (size_t)(next - text), line);
+        ctx->lineErrorFlag = 1; /* handleError records nothing while it is set */
+        if (isValidConstantDefinition(ctx, line))
+        {
+            sscanf(line, ".define %[^=]=%d", constantName, &value);
+            trimLine(constantName);
+            addSymbol(ctx, constantName, mdefine, value);
+        }
+    }
+    ctx->lineErrorFlag = lineErrorFlag;
+}
+
+/**
+ * @brief Reports the conditional block a source ended inside of, if any.
+ *
+ * @param ctx The assembler context.
+ * @param source The source.
+ */
+void endConditions(AssemblerContext *ctx, const TextBuffer *source)
+{
+    if (ctx->conditionDepth > 0)
+    {
+        reportLineError(ctx, source, ctx->conditionStarts[ctx->conditionDepth - 1],
+                        "Missing .endif for this conditional block");
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef CONDITIONAL_H
+#define CONDITIONAL_H
+
+#include <stddef.h>
+
+#include "data.h"
+#include "text_buffer.h"
+
+/*
+ * Conditional assembly: '.if <condition>', '.ifdef <constant>', '.else' and '.endif' lines select the
+ * lines of the source that are assembled. They are evaluated by the macro parser, against the constants
+ * of the prelude and the .define lines read so far, so the lines of a block that is not assembled are
+ * dropped before any macro is defined or expanded. Those lines are only scanned for the directives that
+ * open and close nested blocks.
+ */
+
+/**
+ * @brief Checks whether a text holds a conditional directive as the first word of a line.
+ *
+ * @param text The text.
+ * @param length The number of characters in the text.
+ * @return 1 if a line of the text starts with .if, .ifdef, .else or .endif, 0 otherwise.
+ */
+int mentionsConditional(const char *text, size_t length);
+
+/**
+ * @brief Finds the conditional directive a line starts with, without tokenizing the line.
+ *
+ * @param text The line. It does not need to be null-terminated.
+ * @param length The number of characters of the line.
+ * @return IF_DIRECTIVE, IFDEF_DIRECTIVE, ELSE_DIRECTIVE or ENDIF_DIRECTIVE, or INVALID_DIRECTIVE for any other line.
+ */
+DirectiveType conditionalType(const char *text, size_t length);
+
+/**
+ * @brief Prepares a context to evaluate the conditional blocks of a source.
+ *
+ * The symbol table is emptied and given the constants of the prelude; the first pass empties it again.
+ *
+ * @param ctx The assembler context.
+ */
+void beginConditions(AssemblerContext *ctx);
+
+/**
+ * @brief Processes a line of the source if it is a conditional directive.
+ *
+ * An .if or .ifdef opens a block; when its condition does not hold, its lines are skipped up to its
+ * .else or .endif. An .else reached while the block is assembled skips the lines up to its .endif.
+ *
+ * @param ctx The assembler context.
+ * @param source The source, positioned after the line.
+ * @param text The line, inside the source.
+ * @param length The number of characters of the line.
+ * @return 1 if the line was a conditional directive, which is not part of the output, 0 otherwise.
+ */
+int processConditional(AssemblerContext *ctx, TextBuffer *source, const char *text, size_t length);
+
+/**
+ * @brief Defines the constants of the .define lines of a text, so the conditions after them see them.
+ *
+ * Nothing is reported: an invalid definition is left for the first pass to report.
+ *
+ * @param ctx The assembler context.
+ * @param text The lines.
+ * @param length The number of characters of the lines.
+ */
+void noteDefinitions(AssemblerContext *ctx, const char *text, size_t length);
+
+/**
+ * @brief Reports the conditional block a source ended inside of, if any.
+ *
+ * @param ctx The assembler context.
+ * @param source The source.
+ */
+void endConditions(AssemblerContext *ctx, const TextBuffer *source);
+
+#endif /* CONDITIONAL_H */
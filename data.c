@@ -5,201 +5,111 @@
 
 #include "data.h"
 #include "utils.h"
+#include "macro_parser.h"
+#include "keywords.h"
+
+/* Table containing all commands supported by the assembler: name, opcode, number of operands,
+ * the opcode bits of the first word, legal source addressing methods and legal destination addressing methods */
+const Command commandTable[CMD_NUM] = {
+    {"mov", 0, 2, 0 << 6, ANY_MODE, WRITABLE_MODES},
+    {"cmp", 1, 2, 1 << 6, ANY_MODE, ANY_MODE},
+    {"add", 2, 2, 2 << 6, ANY_MODE, WRITABLE_MODES},
+    {"sub", 3, 2, 3 << 6, ANY_MODE, WRITABLE_MODES},
+    {"not", 4, 1, 4 << 6, NO_MODE, WRITABLE_MODES},
+    {"clr", 5, 1, 5 << 6, NO_MODE, WRITABLE_MODES},
+    {"lea", 6, 2, 6 << 6, ADDRESS_MODES, WRITABLE_MODES},
+    {"inc", 7, 1, 7 << 6, NO_MODE, WRITABLE_MODES},
+    {"dec", 8, 1, 8 << 6, NO_MODE, WRITABLE_MODES},
+    {"jmp", 9, 1, 9 << 6, NO_MODE, JUMP_MODES},
+    {"bne", 10, 1, 10 << 6, NO_MODE, JUMP_MODES},
+    {"red", 11, 1, 11 << 6, NO_MODE, WRITABLE_MODES},
+    {"prn", 12, 1, 12 << 6, NO_MODE, ANY_MODE},
+    {"jsr", 13, 1, 13 << 6, NO_MODE, JUMP_MODES},
+    {"rts", 14, 0, 14 << 6, NO_MODE, NO_MODE},
+    {"hlt", 15, 0, 15 << 6, NO_MODE, NO_MODE}};
+
+/* Shape of an instruction whose operands use the given addressing methods, an absent operand counting
+ * as NO_OPERAND. Immediate, direct and register operands take one word and index operands two; two
+ * register operands share a single word. The mode bits of NO_OPERAND are 0. */
+#define SHAPE(src, dest, length) {length, ((src) & 0x03) << 4 | ((dest) & 0x03) << 2, (src) == REGISTER && (dest) == REGISTER}
+#define SHAPE_ROW(src, length) \
+    {SHAPE(src, IMMEDIATE, length + 1), SHAPE(src, DIRECT, length + 1), SHAPE(src, INDEX, length + 2), \
+     SHAPE(src, REGISTER, (src) == REGISTER ? length : length + 1), SHAPE(src, NO_OPERAND, length)}
+
+/* Shapes indexed by source and destination addressing method; the lengths are those of the source
+ * operand plus the first word */
+static const InstructionShape shapeTable[ADDRESSING_MODES][ADDRESSING_MODES] = {
+    SHAPE_ROW(IMMEDIATE, 2),
+    SHAPE_ROW(DIRECT, 2),
+    SHAPE_ROW(INDEX, 3),
+    SHAPE_ROW(REGISTER, 2),
+    SHAPE_ROW(NO_OPERAND, 1)};
 
-/* Array of reserved words used in the program */
-char *savedWords[] = {
-    "r1", "r2", "r3", "r4", "r5", "r6", "r7",
-    "mov", "cmp", "add", "sub", "not", "clr", "lea", "inc", "dec",
-    "jmp", "bne", "red", "prn", "jsr", "rts", "hlt",
-    "data", "string", "entry", "extern", "define", "mcr", "endmcr"};
-
-/* Array of register names in the CPU */
-char *registers[] = {"r1", "r2", "r3", "r4", "r5", "r6", "r7"};
-/* Table containing all commands supported by the assembler */
-Command commandTable[16];
-
-/* Global variables used in the assembly process */
-int IC = 0;                 /* Instruction counter */
-int DC = 0;                 /* Data counter */
-int L = 0;                  /* Line number (not used here) */
-int symbolCount = 0;        /* Number of symbols */
-int dataCount = 0;          /* Number of data entries */
-int labelCount = 0;         /* Number of labels */
-int commandCount = 0;       /* Number of commands */
-int labelFlag = 0;          /* Flag for label processing */
-int dataFlag = 0;           /* Flag for data processing */
-int commandFlag = 0;        /* Flag for command processing */
-int symbolFlag = 0;         /* Flag for symbol processing */
-int entryFlag = 0;          /* Flag for entry directive processing */
-int externFlag = 0;         /* Flag for extern directive processing */
-int lineNum = 0;            /* Current line number */
-int errorFlag = 0;          /* Flag for error detection */
-int lineErrorFlag = 0;      /* Flag for line error detection */
-int externalUsageCount = 0; /* External usage count */
-int memory[MAX_DATA];       /* Memory array for the assembler */
-
-MemoryEntry memoryLines[MAX_DATA];
-
-ExternalSymbolUsage externalUsages[MAX_EXTERNAL_USAGES];
-
-char *entrySymbols[MAX_SYMBOLS]; /* Array of entry symbols */
-
-int entryCount = 0; /* Tracker for the number of entry symbols */
-
-unsigned int memoryAddress[MAX_DATA];
-/* Data array for the assembler */
-
-/**
- * Initializes the command table with predefined assembly commands.
- */
-void initData()
-{
-    /* Initializing command table with command names, opcodes, and number of operands */
-
-    commandTable[0].cmdName = "mov";
-    commandTable[0].opCode = 0;
-    commandTable[0].numOfOps = 2;
-    commandTable[0].srcLegalAddrs[0] = 0;
-    commandTable[0].srcLegalAddrs[1] = 1;
-    commandTable[0].srcLegalAddrs[2] = 2;
-    commandTable[0].srcLegalAddrs[3] = 3;
-    commandTable[0].destLegalAddrs[0] = 1;
-    commandTable[0].destLegalAddrs[1] = 2;
-    commandTable[0].destLegalAddrs[2] = 3;
-
-    commandTable[1].cmdName = "cmp";
-    commandTable[1].opCode = 1;
-    commandTable[1].numOfOps = 2;
-    commandTable[1].srcLegalAddrs[0] = 0;
-    commandTable[1].srcLegalAddrs[1] = 1;
-    commandTable[1].srcLegalAddrs[2] = 2;
-    commandTable[1].srcLegalAddrs[3] = 3;
-    commandTable[1].destLegalAddrs[0] = 0;
-    commandTable[1].destLegalAddrs[1] = 1;
-    commandTable[1].destLegalAddrs[2] = 2;
-    commandTable[1].destLegalAddrs[3] = 3;
-
-    commandTable[2].cmdName = "add";
-    commandTable[2].opCode = 2;
-    commandTable[2].numOfOps = 2;
-    commandTable[2].srcLegalAddrs[0] = 0;
-    commandTable[2].srcLegalAddrs[1] = 1;
-    commandTable[2].srcLegalAddrs[2] = 2;
-    commandTable[2].srcLegalAddrs[3] = 3;
-    commandTable[2].destLegalAddrs[0] = 1;
-    commandTable[2].destLegalAddrs[1] = 2;
-    commandTable[2].destLegalAddrs[2] = 3;
-
-    commandTable[3].cmdName = "sub";
-    commandTable[3].opCode = 3;
-    commandTable[3].numOfOps = 2;
-    commandTable[3].srcLegalAddrs[0] = 0;
-    commandTable[3].srcLegalAddrs[1] = 1;
-    commandTable[3].srcLegalAddrs[2] = 2;
-    commandTable[3].srcLegalAddrs[3] = 3;
-    commandTable[3].destLegalAddrs[0] = 1;
-    commandTable[3].destLegalAddrs[1] = 2;
-    commandTable[3].destLegalAddrs[2] = 3;
-
-    commandTable[4].cmdName = "not";
-    commandTable[4].opCode = 4;
-    commandTable[4].numOfOps = 1;
-    commandTable[4].destLegalAddrs[0] = 1;
-    commandTable[4].destLegalAddrs[1] = 2;
-    commandTable[4].destLegalAddrs[2] = 3;
-
-    commandTable[5].cmdName = "clr";
-    commandTable[5].opCode = 5;
-    commandTable[5].numOfOps = 1;
-    commandTable[5].destLegalAddrs[0] = 1;
-    commandTable[5].destLegalAddrs[1] = 2;
-    commandTable[5].destLegalAddrs[2] = 3;
-
-    commandTable[6].cmdName = "lea";
-    commandTable[6].opCode = 6;
-    commandTable[6].numOfOps = 2;
-    commandTable[6].srcLegalAddrs[0] = 1;
-    commandTable[6].srcLegalAddrs[1] = 2;
-    commandTable[6].destLegalAddrs[0] = 1;
-    commandTable[6].destLegalAddrs[1] = 2;
-    commandTable[6].destLegalAddrs[2] = 3;
-
-    commandTable[7].cmdName = "inc";
-    commandTable[7].opCode = 7;
-    commandTable[7].numOfOps = 1;
-    commandTable[7].destLegalAddrs[0] = 1;
-    commandTable[7].destLegalAddrs[1] = 2;
-    commandTable[7].destLegalAddrs[2] = 3;
-
-    commandTable[8].cmdName = "dec";
-    commandTable[8].opCode = 8;
-    commandTable[8].numOfOps = 1;
-    commandTable[8].destLegalAddrs[0] = 1;
-    commandTable[8].destLegalAddrs[1] = 2;
-    commandTable[8].destLegalAddrs[2] = 3;
-
-    commandTable[9].cmdName = "jmp";
-    commandTable[9].opCode = 9;
-    commandTable[9].numOfOps = 1;
-    commandTable[9].destLegalAddrs[0] = 1;
-    commandTable[9].destLegalAddrs[1] = 3;
-
-    commandTable[10].cmdName = "bne";
-    commandTable[10].opCode = 10;
-    commandTable[10].numOfOps = 1;
-    commandTable[10].destLegalAddrs[0] = 1;
-    commandTable[10].destLegalAddrs[1] = 3;
-
-    commandTable[11].cmdName = "red";
-    commandTable[11].opCode = 11;
-    commandTable[11].numOfOps = 1;
-    commandTable[11].destLegalAddrs[0] = 1;
-    commandTable[11].destLegalAddrs[1] = 2;
-    commandTable[11].destLegalAddrs[2] = 3;
-
-    commandTable[12].cmdName = "prn";
-    commandTable[12].opCode = 12;
-    commandTable[12].numOfOps = 1;
-    commandTable[12].destLegalAddrs[0] = 0;
-    commandTable[12].destLegalAddrs[1] = 1;
-    commandTable[12].destLegalAddrs[2] = 2;
-    commandTable[12].destLegalAddrs[3] = 3;
-
-    commandTable[13].cmdName = "jsr";
-    commandTable[13].opCode = 13;
-    commandTable[13].numOfOps = 1;
-    commandTable[13].destLegalAddrs[0] = 1;
-    commandTable[13].destLegalAddrs[1] = 3;
-
-    commandTable[14].cmdName = "rts";
-    commandTable[14].opCode = 14;
-    commandTable[14].numOfOps = 0;
-
-    commandTable[15].cmdName = "hlt";
-    commandTable[15].opCode = 15;
-    commandTable[15].numOfOps = 0;
+/**
+ * @brief Allocates a new assembler context with empty tables.
+ *
+ * @return The new context, or NULL if memory allocation fails.
+ */
+AssemblerContext *createAssemblerContext()
+{
+    AssemblerContext *ctx = malloc(sizeof(AssemblerContext));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(AssemblerContext));
+    initArena(&ctx->arena);
+    initTextBuffer(&ctx->diagnostics);
+    return ctx;
+}
+
+/**
+ * @brief Releases everything owned by the context and clears it, so it can assemble another file.
+ *
+ * Everything the assembly of a file allocates comes from the arena of the context, so it is all
+ * released by a single reset. The arena chunks and the diagnostics buffer are kept for the next file.
+ *
+ * @param ctx The context to reset.
+ */
+void resetAssemblerContext(AssemblerContext *ctx)
+{
+    Arena arena = ctx->arena;
+    TextBuffer diagnostics = ctx->diagnostics;
+
+    memset(ctx, 0, sizeof(AssemblerContext));
+    resetArena(&arena);
+    ctx->arena = arena;
+    clearTextBuffer(&diagnostics);
+    ctx->diagnostics = diagnostics;
+}
+
+/**
+ * @brief Releases an assembler context and everything it owns.
+ *
+ * @param ctx The context to destroy. May be NULL.
+ */
+void destroyAssemblerContext(AssemblerContext *ctx)
+{
+    if (ctx != NULL)
+    {
+        freeArena(&ctx->arena);
+        freeTextBuffer(&ctx->diagnostics);
+        free(ctx);
+    }
 }
 
 /**
  * @brief Retrieves the opcode corresponding to a given command name.
  *
- * This function searches the command table for a command matching the provided token
- * and returns the associated opcode if found.
+ * The command name is looked up in the keyword table.
  *
  * @param token The command name to search for in the command table.
  * @return The opcode of the command if found, or -1 if the command does not exist.
  */
 int getOpcode(char *token)
 {
-    int i;
-    for (i = 0; i < MAX_COMMANDS; i++)
-    {
-        if (strcmp(token, commandTable[i].cmdName) == 0)
-        {
-            return commandTable[i].opCode;
-        }
-    }
-    return -1;
+    const Keyword *keyword = findKeyword(token, strlen(token));
+    return keyword != NULL && keyword->kind == KEYWORD_OPCODE ? keyword->value : -1;
 }
 
 /**
@@ -217,489 +127,799 @@ void printIstruction(Instruction *instruction)
     printf("Opcode: %d\n", instruction->opcode);    /* Print the opcode of the instruction */
     for (i = 0; i < MAX_OPERANDS; i++)              /* Loop through possible operands */
     {
-        if (instruction->operands[i] != NULL) /* Check if operand is not NULL */
+        if (instruction->operands[i].start != NULL) /* Check if operand is present */
         {
-            printf("Operand %d: %s\n", i, instruction->operands[i]); /* Print operand */
+            printf("Operand %d: %.*s\n", i, (int)instruction->operands[i].length, instruction->operands[i].start); /* Print operand */
         }
     }
 }
 
-/* Table containing all symbols found by the assembler */
-Symbol *symbolTable[MAX_SYMBOLS];
-
 /**
- * Generates a hash value for a symbol name.
+ * Generates a 32-bit hash value for a symbol name (FNV-1a followed by a final avalanche step).
  *
  * @param name The symbol name to hash.
  * @return The hash value for the symbol name.
  */
-unsigned int hashSymbolName(const char *name)
+unsigned long hashSymbolName(const char *name)
 {
-    unsigned int hashVal = 0;
+    unsigned long hashVal = 2166136261UL;
     for (; *name != '\0'; name++)
     {
-        hashVal = *name + 31 * hashVal;
+        hashVal = ((hashVal ^ (unsigned char)*name) * 16777619UL) & 0xFFFFFFFFUL;
     }
-    return hashVal % MAX_SYMBOLS;
+    /* Mix the high bits into the low bits, which select the slot */
+    hashVal ^= hashVal >> 16;
+    hashVal = (hashVal * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+    hashVal ^= hashVal >> 13;
+    hashVal = (hashVal * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+    hashVal ^= hashVal >> 16;
+    return hashVal;
 }
 
 /**
- * Initializes the symbol table by setting all entries to NULL.
+ * Doubles the number of slots of the name table, or allocates the first ones.
+ * The fixup chains move with their names. The old slots stay in the arena; they add up to less than
+ * the new ones.
+ *
+ * @param names The name table.
+ * @param arena The arena the slots are allocated from.
+ * @return 1 on success, 0 if memory allocation failed.
  */
-void initSymbolTable()
+static int growNameTable(NameTable *names, Arena *arena)
 {
-    int i;
-    for (i = 0; i < MAX_SYMBOLS; i++)
+    unsigned long slotCount = names->slots ? (names->slotMask + 1) * 2 : INITIAL_TABLE_SLOTS;
+    unsigned long slot, i;
+    char **slots = (char **)arenaAlloc(arena, slotCount * sizeof(char *));
+    FixupChain **chains = (FixupChain **)arenaAlloc(arena, slotCount * sizeof(FixupChain *));
+    unsigned char *entries = (unsigned char *)arenaAlloc(arena, slotCount);
+
+    if (slots == NULL || chains == NULL || entries == NULL)
+    {
+        return 0;
+    }
+    memset(slots, 0, slotCount * sizeof(char *));
+    memset(chains, 0, slotCount * sizeof(FixupChain *));
+    memset(entries, 0, slotCount);
+    if (names->slots != NULL)
+    {
+        for (i = 0; i <= names->slotMask; i++)
+        {
+            if (names->slots[i] != NULL)
+            {
+                slot = hashSymbolName(names->slots[i]) & (slotCount - 1);
+                while (slots[slot] != NULL)
+                {
+                    slot = (slot + 1) & (slotCount - 1);
+                }
+                slots[slot] = names->slots[i];
+                chains[slot] = names->chains[i];
+                entries[slot] = names->entries[i];
+            }
+        }
+    }
+    names->slots = slots;
+    names->chains = chains;
+    names->entries = entries;
+    names->slotMask = slotCount - 1;
+    return 1;
+}
+
+/**
+ * Finds the slot of a name in the name table, without adding it.
+ *
+ * @param names The name table.
+ * @param name The name to find.
+ * @param slot Receives the slot holding the name, or the empty slot it would be added at.
+ * @return 1 if the name is in the table, 0 otherwise.
+ */
+static int lookupNameSlot(const NameTable *names, const char *name, unsigned long *slot)
+{
+    if (names->slots == NULL)
+    {
+        return 0;
+    }
+    for (*slot = hashSymbolName(name) & names->slotMask; names->slots[*slot] != NULL; *slot = (*slot + 1) & names->slotMask)
+    {
+        if (strcmp(names->slots[*slot], name) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Finds the slot of a name in the name table, adding the name if needed.
+ *
+ * @param ctx The assembler context.
+ * @param name The name to find.
+ * @param slot Receives the slot holding the name.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int findNameSlot(AssemblerContext *ctx, const char *name, unsigned long *slot)
+{
+    NameTable *names = &ctx->names;
+
+    /* Keep the table at most half full so probe sequences stay short */
+    if ((names->count + 1) * 2 > (names->slots ? names->slotMask + 1 : 0) && !growNameTable(names, &ctx->arena))
+    {
+        reportMessage(ctx, "Memory allocation error\n");
+        return 0;
+    }
+    if (lookupNameSlot(names, name, slot))
+    {
+        return 1;
+    }
+    if ((names->slots[*slot] = arenaCopy(&ctx->arena, name, strlen(name))) == NULL)
+    {
+        reportMessage(ctx, "Memory allocation error\n");
+        return 0;
+    }
+    names->count++;
+    return 1;
+}
+
+/**
+ * Returns the interned copy of a name, adding it to the name table if needed.
+ * Equal names always return the same pointer, which stays valid until the context is reset.
+ *
+ * @param ctx The assembler context.
+ * @param name The name to intern.
+ * @return The interned name, or NULL if memory allocation fails.
+ */
+const char *internName(AssemblerContext *ctx, const char *name)
+{
+    unsigned long slot;
+    return findNameSlot(ctx, name, &slot) ? ctx->names.slots[slot] : NULL;
+}
+
+/**
+ * Initializes the symbol table to empty.
+ *
+ * @param ctx The assembler context.
+ */
+void initSymbolTable(AssemblerContext *ctx)
+{
+    SymbolTable *table = &ctx->symbolTable;
+    table->count = 0;
+    if (table->slots != NULL)
+    {
+        memset(table->slots, 0, sizeof(int) * (table->slotMask + 1));
+    }
+}
+
+/**
+ * Finds the slot of a name in the symbol table index.
+ *
+ * @param table The symbol table. Its index must be allocated.
+ * @param name The name to find.
+ * @param hash The hash of the name.
+ * @return The slot holding the symbol, or the empty slot where it would be inserted.
+ */
+static unsigned long findSymbolSlot(const SymbolTable *table, const char *name, unsigned long hash)
+{
+    unsigned long slot;
+    const Symbol *sym;
+
+    for (slot = hash & table->slotMask; table->slots[slot] != 0; slot = (slot + 1) & table->slotMask)
     {
-        symbolTable[i] = NULL;
+        sym = &table->symbols[table->slots[slot] - 1];
+        if (sym->hash == hash && (sym->symbolName == name || strcmp(sym->symbolName, name) == 0))
+        {
+            break;
+        }
     }
+    return slot;
 }
 
 /**
  * Looks up a symbol in the symbol table.
+ * Names interned with internName are matched by pointer, without comparing their characters.
+ *
+ * @param ctx The assembler context.
+ * @param name The name of the symbol to find.
+ * @return A pointer to the found symbol, valid until the next symbol is added, or NULL if not found.
+ */
+struct Symbol *lookupSymbol(AssemblerContext *ctx, const char *name)
+{
+    ctx->symbolLookups++;
+    return findSymbol(&ctx->symbolTable, name);
+}
+
+/**
+ * Finds a symbol in a symbol table, without counting the lookup in the statistics of the assembly.
  *
+ * @param table The symbol table.
  * @param name The name of the symbol to find.
- * @return A pointer to the found symbol or NULL if not found.
+ * @return A pointer to the found symbol, valid until the next symbol is added, or NULL if not found.
  */
-struct Symbol *lookupSymbol(const char *name)
+struct Symbol *findSymbol(SymbolTable *table, const char *name)
 {
-    struct Symbol *sym;
-    sym = symbolTable[hashSymbolName(name)];
-    while (sym != NULL)
+    int index;
+
+    if (table->count == 0)
+    {
+        return NULL;
+    }
+    index = table->slots[findSymbolSlot(table, name, hashSymbolName(name))];
+    return index != 0 ? &table->symbols[index - 1] : NULL;
+}
+
+/**
+ * Makes room for one more symbol, growing the symbol array and rebuilding the index when needed.
+ * Both grow by doubling in the arena, so the arrays they replace add up to less than the new ones.
+ *
+ * @param table The symbol table.
+ * @param arena The arena the arrays are allocated from.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int reserveSymbol(SymbolTable *table, Arena *arena)
+{
+    unsigned long slotCount = table->slots ? table->slotMask + 1 : 0;
+    int *slots;
+    int i;
+
+    if (table->count == table->capacity)
+    {
+        int capacity = table->capacity ? table->capacity * 2 : INITIAL_TABLE_SLOTS / 2;
+        Symbol *symbols = (Symbol *)arenaAlloc(arena, sizeof(Symbol) * capacity);
+        if (symbols == NULL)
+        {
+            return 0;
+        }
+        if (table->count > 0)
+        {
+            memcpy(symbols, table->symbols, sizeof(Symbol) * table->count);
+        }
+        table->symbols = symbols;
+        table->capacity = capacity;
+    }
+    /* Keep the index at most half full, rehashing from the stored hashes when it grows */
+    if ((unsigned long)(table->count + 1) * 2 > slotCount)
     {
-        if (strcmp(name, sym->symbolName) == 0)
+        slotCount = slotCount ? slotCount * 2 : INITIAL_TABLE_SLOTS;
+        if ((slots = (int *)arenaAlloc(arena, slotCount * sizeof(int))) == NULL)
+        {
+            return 0;
+        }
+        memset(slots, 0, slotCount * sizeof(int));
+        table->slots = slots;
+        table->slotMask = slotCount - 1;
+        for (i = 0; i < table->count; i++)
         {
-            return sym;
+            table->slots[findSymbolSlot(table, table->symbols[i].symbolName, table->symbols[i].hash)] = i + 1;
         }
-        sym = sym->next;
     }
-    return NULL;
+    return 1;
 }
 
 /**
  * Adds a symbol to the symbol table.
  *
+ * @param ctx The assembler context.
+ * @param name The name of the symbol to add.
+ * @param type The type of the symbol.
+ * @param value The value of the symbol.
+ */
+void addSymbol(AssemblerContext *ctx, const char *name, SymbolType type, unsigned int value)
+{
+    ctx->symbolLookups++; /* The check that the name is new */
+    addSymbolUncounted(ctx, name, type, value);
+}
+
+/**
+ * Adds a symbol to the symbol table, as addSymbol does, without counting the check that the name is new
+ * in the statistics of the assembly.
+ *
+ * @param ctx The assembler context.
  * @param name The name of the symbol to add.
  * @param type The type of the symbol.
  * @param value The value of the symbol.
  */
-void addSymbol(const char *name, SymbolType type, unsigned int value)
+void addSymbolUncounted(AssemblerContext *ctx, const char *name, SymbolType type, unsigned int value)
 {
-    unsigned int hashVal;
+    SymbolTable *table = &ctx->symbolTable;
+    const char *symbolName;
     Symbol *sym;
 
-    if ((sym = lookupSymbol(name)) == NULL)
+    if (findSymbol(table, name) == NULL)
     {
-        sym = (Symbol *)malloc(sizeof(*sym));
-        if (sym == NULL || (sym->symbolName = strdup((char *)name)) == NULL)
+        if (!reserveSymbol(table, &ctx->arena))
         {
-            fprintf(stderr, "Memory allocation error\n");
+            reportMessage(ctx, "Memory allocation error\n");
             return;
         }
+        if ((symbolName = internName(ctx, name)) == NULL)
+        {
+            return;
+        }
+        sym = &table->symbols[table->count];
+        sym->symbolName = symbolName;
         sym->symbolType = type;
         sym->value = value;
-        hashVal = hashSymbolName(name);
-        sym->next = symbolTable[hashVal];
-        symbolTable[hashVal] = sym;
+        sym->hash = hashSymbolName(symbolName);
+        sym->uses = NULL;
+        sym->useCount = 0;
+        sym->useCapacity = 0;
+        table->slots[findSymbolSlot(table, symbolName, sym->hash)] = ++table->count;
     }
     else
     {
-        fprintf(stderr, "%s already exists in the symbol table\n", name);
+        char message[MAX_MESSAGE_LENGTH];
+        sprintf(message, "%.80s already exists in the symbol table\n", name);
+        reportMessage(ctx, message);
     }
 }
 
 /**
  * Updates the type of a symbol in the symbol table.
  *
+ * @param ctx The assembler context.
  * @param symbolName The name of the symbol whose type is to be updated.
  * @param type The new type for the symbol.
  */
-void updateSymbolType(char *symbolName, int type)
+void updateSymbolType(AssemblerContext *ctx, char *symbolName, int type)
 {
     Symbol *sym;
-    sym = lookupSymbol(symbolName);
+    sym = lookupSymbol(ctx, symbolName);
     if (sym != NULL)
     {
         sym->symbolType = type;
     }
     else
     {
-        fprintf(stderr, "Symbol '%s' not found\n", symbolName);
+        char message[MAX_MESSAGE_LENGTH];
+        sprintf(message, "Symbol '%.80s' not found\n", symbolName);
+        reportMessage(ctx, message);
     }
 }
 
 /**
  * Updates the values of all symbols of type 'data' in the symbol table.
  * The new value is calculated based on a global counter `IC`.
+ *
+ * @param ctx The assembler context.
  */
-void updateSymbolValues()
+void updateSymbolValues(AssemblerContext *ctx)
 {
     int i;
-    Symbol *sym;
-    for (i = 0; i < MAX_SYMBOLS; i++)
+    for (i = 0; i < ctx->symbolTable.count; i++)
     {
-        sym = symbolTable[i];
-        while (sym != NULL)
+        if (ctx->symbolTable.symbols[i].symbolType == data)
         {
-            if (sym->symbolType == data)
-            {
-                sym->value += IC + 100;
-            }
-            sym = sym->next;
+            ctx->symbolTable.symbols[i].value += ctx->IC + 100;
         }
     }
 }
 
 /**
  * Records the usage of an external symbol at a specific address.
+ * The list of uses lives in the arena and doubles when it is full.
  *
- * @param symbolName The name of the external symbol used.
+ * @param ctx The assembler context.
+ * @param symbol The external symbol used.
  * @param address The address where the symbol is used.
  */
-void recordExternalSymbolUsage(char *symbolName, int address)
+void recordExternalSymbolUsage(AssemblerContext *ctx, Symbol *symbol, int address)
 {
-    if (externalUsageCount < MAX_EXTERNAL_USAGES)
-    {
-        externalUsages[externalUsageCount].symbolName = strdup(symbolName);
-        externalUsages[externalUsageCount].address = address;
-        externalUsageCount++;
-    }
-    else
+    int newCapacity;
+    int *uses;
+
+    if (symbol->useCount == symbol->useCapacity)
     {
-        fprintf(stderr, "Reached maximum limit of external symbol usages\n");
+        newCapacity = symbol->useCapacity ? symbol->useCapacity * 2 : 8;
+        if ((uses = (int *)arenaAlloc(&ctx->arena, newCapacity * sizeof(int))) == NULL)
+        {
+            reportMessage(ctx, "Memory allocation error\n");
+            return;
+        }
+        if (symbol->useCount > 0)
+        {
+            memcpy(uses, symbol->uses, symbol->useCount * sizeof(int));
+        }
+        symbol->uses = uses;
+        symbol->useCapacity = newCapacity;
     }
+    symbol->uses[symbol->useCount++] = address;
 }
 
 /**
- * Adds a label to the entrySymbols array.
- * Assumes the label does not already exist in the array.
+ * Marks a label as declared by an .entry directive.
  *
+ * @param ctx The assembler context.
  * @param label The label to add.
  */
-void addEntryLabel(char *label)
+void addEntryLabel(AssemblerContext *ctx, char *label)
 {
-    if (entryCount < MAX_SYMBOLS)
+    unsigned long slot;
+    if (findNameSlot(ctx, label, &slot))
     {
-        entrySymbols[entryCount] = strdup(label); /* Duplicate and store the label */
-        entryCount++;                             /* Increment the count of stored labels */
-    }
-    else
-    {
-        /* Handle the case where the symbol limit is reached */
-        fprintf(stderr, "Maximum number of entry symbols reached.\n");
+        ctx->names.entries[slot] = 1;
     }
 }
 
 /**
  * Checks if a label is already an entry label.
+ * The name table is only searched, so checking a name does not add it.
  *
+ * @param ctx The assembler context.
  * @param label The label to check.
  * @return True if the label is found, False otherwise.
  */
-int isEntryLabel(char *label)
+int isEntryLabel(AssemblerContext *ctx, char *label)
 {
-    int i;
-    for (i = 0; i < entryCount; i++)
-    {
-        if (strcmp(entrySymbols[i], label) == 0)
-        {
-            return 1; /* Label found */
-        }
-    }
-    return 0; /* Label not found */
+    unsigned long slot;
+    return lookupNameSlot(&ctx->names, label, &slot) && ctx->names.entries[slot];
 }
 
 /* Print the contents of the symbol table */
-void printSymbolTable()
+void printSymbolTable(AssemblerContext *ctx)
 {
     int i;
     Symbol *sym;
     printf("Symbol Table Content:\n");
-    for (i = 0; i < MAX_SYMBOLS; i++)
+    for (i = 0; i < ctx->symbolTable.count; i++)
     {
-        sym = symbolTable[i];
-        if (sym != NULL)
-        {
-            printf("Bucket %d:\n", i);
-            while (sym != NULL)
-            {
-                printf("  Name: '%s'\n", sym->symbolName);
-                printf("  Type: %d\n", sym->symbolType);
-                printf("  Value: %u\n", sym->value);
-                sym = sym->next;
-            }
-        }
+        sym = &ctx->symbolTable.symbols[i];
+        printf("  Name: '%s'\n", sym->symbolName);
+        printf("  Type: %d\n", sym->symbolType);
+        printf("  Value: %u\n", sym->value);
     }
 }
 /**
  * @brief Checks if a given word is a reserved word in the assembler.
  *
- * This function iterates through an array of reserved words and compares each with the provided
- * word. If a match is found, the function returns 1, indicating the word is reserved.
+ * The word is looked up in the keyword table, which marks the reserved words.
  *
  * @param word The word to check against the list of reserved words.
  * @return 1 if the word is a reserved word, 0 otherwise.
  */
 int isReservedWord(char *word)
 {
-    int i;
-    for (i = 0; i < MAX_RESERVED_WORDS; i++)
+    const Keyword *keyword = findKeyword(word, strlen(word));
+    return keyword != NULL && keyword->reserved;
+}
+
+void printExternSymbolUsage(AssemblerContext *ctx)
+{
+    int i, j;
+    const Symbol *sym;
+    printf("External Symbol Usage:\n");
+    for (i = 0; i < ctx->symbolTable.count; i++)
     {
-        if (strcmp(word, savedWords[i]) == 0)
+        sym = &ctx->symbolTable.symbols[i];
+        for (j = 0; j < sym->useCount; j++)
         {
-            return 1;
+            printf("Symbol: %s, Address: %d\n", sym->symbolName, sym->uses[j]);
         }
     }
-    return 0;
+}
+/**
+ * @brief Clears the memory image and its addressing types before a first pass.
+ *
+ * @param ctx The assembler context.
+ */
+void initMemoryImage(AssemblerContext *ctx)
+{
+    memset(ctx->image, 0, sizeof(ctx->image));                          /* Words that are never written are 0 */
+    memset(ctx->wordTypes, INVALID_ADDRESSING, sizeof(ctx->wordTypes)); /* No word has a type yet */
 }
 
 /**
- * @brief Displays the content of memory up to the combined count of instruction and data counters.
+ * @brief Records that a word of the image holds the address of a symbol.
  *
- * Iterates through the memory array from 0 to the sum of IC (Instruction Counter) and DC (Data Counter),
- * printing each memory cell's index and value.
+ * The word is linked into the fixup chain of the symbol, which is patched by the second pass once
+ * every symbol is defined. The chain is found through the slot of the name in the name table, so
+ * recording a fixup costs one hash of the name.
+ *
+ * @param ctx The assembler context.
+ * @param address The index of the word in the image.
+ * @param name The name of the symbol.
+ * @return The interned name of the symbol, or NULL if memory allocation fails.
  */
-void printMemory()
+const char *addFixup(AssemblerContext *ctx, int address, const char *name)
 {
-    int i;
-    printf("Memory Content:\n");
-    for (i = 0; i < IC + DC; i++) /* Loop through memory array up to IC + DC */
+    unsigned long slot;
+    FixupChain *chain;
+    Fixup *fixup;
+
+    if (!findNameSlot(ctx, name, &slot))
+    {
+        return NULL;
+    }
+    if ((chain = ctx->names.chains[slot]) == NULL)
+    {
+        if ((chain = (FixupChain *)arenaAlloc(&ctx->arena, sizeof(FixupChain))) == NULL)
+        {
+            reportMessage(ctx, "Memory allocation error\n");
+            return NULL;
+        }
+        chain->symbol = ctx->names.slots[slot];
+        chain->fixups = NULL;
+        chain->lastFixup = NULL;
+        chain->next = NULL;
+        if (ctx->lastFixupChain != NULL)
+        {
+            ctx->lastFixupChain->next = chain;
+        }
+        else
+        {
+            ctx->fixupChains = chain;
+        }
+        ctx->lastFixupChain = chain;
+        ctx->names.chains[slot] = chain;
+    }
+    if ((fixup = (Fixup *)arenaAlloc(&ctx->arena, sizeof(Fixup))) == NULL)
+    {
+        reportMessage(ctx, "Memory allocation error\n");
+        return NULL;
+    }
+    fixup->address = address;
+    fixup->next = NULL;
+    if (chain->lastFixup != NULL)
     {
-        printf("Memory[%d]: %d\n", i, memory[i]);
+        chain->lastFixup->next = fixup;
     }
+    else
+    {
+        chain->fixups = fixup;
+    }
+    chain->lastFixup = fixup;
+    return chain->symbol;
 }
 
-void printExternSymbolUsage()
+/**
+ * @brief Queues a name of an .entry directive, to be resolved once every symbol is defined.
+ *
+ * @param ctx The assembler context.
+ * @param name The name of the symbol.
+ * @param lineNum The line of the directive, for error messages.
+ */
+void queueEntry(AssemblerContext *ctx, const char *name, int lineNum)
 {
-    int i;
-    printf("External Symbol Usage:\n");
-    for (i = 0; i < externalUsageCount; i++)
+    QueuedEntry *queued = (QueuedEntry *)arenaAlloc(&ctx->arena, sizeof(QueuedEntry));
+
+    if (queued == NULL)
+    {
+        reportMessage(ctx, "Memory allocation error\n");
+        return;
+    }
+    if ((queued->name = internName(ctx, name)) == NULL)
     {
-        printf("Symbol: %s, Address: %d\n", externalUsages[i].symbolName, externalUsages[i].address);
+        return;
     }
+    queued->lineNum = lineNum;
+    queued->symbol = -1;
+    queued->next = NULL;
+    if (ctx->lastQueuedEntry != NULL)
+    {
+        ctx->lastQueuedEntry->next = queued;
+    }
+    else
+    {
+        ctx->entryQueue = queued;
+    }
+    ctx->lastQueuedEntry = queued;
 }
+
 /**
- * @brief Initializes the memory lines array used in the assembler.
+ * @brief Maps the lines from a line of the text of a stage on to a line of a file.
+ *
+ * A line that continues the last span is not recorded, so a run of lines copied from one file takes
+ * a single span. The spans grow by doubling in the arena.
  *
- * Allocates memory for each 'Word' in the memoryLines array and sets initial values.
- * If memory allocation fails, the function will terminate the program.
+ * @param ctx The assembler context.
+ * @param map The map of the stage.
+ * @param firstLine The first line mapped, after the lines mapped so far.
+ * @param fileName The file the line comes from, or NULL for the source itself.
+ * @param fileLine The line of the file.
+ * @param advance 1 if the following lines follow it in the file, 0 if they come from the same line.
  */
-void initMemoryLines()
+void addLineSpan(AssemblerContext *ctx, LineMap *map, int firstLine, const char *fileName, int fileLine, int advance)
 {
-    int i;
-    for (i = 0; i < MAX_DATA; i++) /* Iterate over the memoryLines array up to MAX_DATA */
+    LineSpan *last = map->count > 0 ? &map->spans[map->count - 1] : NULL;
+    LineSpan *spans;
+
+    if (last != NULL && last->advance && advance && last->fileName == fileName &&
+        last->fileLine + (firstLine - last->firstLine) == fileLine)
     {
-        memoryLines[i].word = malloc(sizeof(Word)); /* Allocate memory for each word */
-        if (memoryLines[i].word == NULL)            /* Check if memory allocation was successful */
+        return;
+    }
+    if (last != NULL && last->firstLine == firstLine) /* The last span turned out to have no lines */
+    {
+        map->count--;
+    }
+    else if (map->count == map->capacity)
+    {
+        int capacity = map->capacity ? map->capacity * 2 : INITIAL_TABLE_SLOTS;
+        if ((spans = (LineSpan *)arenaAlloc(&ctx->arena, sizeof(LineSpan) * capacity)) == NULL)
         {
-            fprintf(stderr, "Memory allocation failed\n");
-            exit(EXIT_FAILURE); /* Terminate program on failed memory allocation */
+            reportMessage(ctx, "Memory allocation error\n");
+            return;
         }
-        memoryLines[i].word->value = 0; /* Initialize the value of the word */
-        memoryLines[i].type = -1;       /* Set default type to -1 indicating unused or invalid */
-        memoryLines[i].value = 0;       /* Set default value to 0 */
-        memoryLines[i].symbol = NULL;   /* No associated symbol initially */
-    }
+        if (map->count > 0)
+        {
+            memcpy(spans, map->spans, sizeof(LineSpan) * map->count);
+        }
+        map->spans = spans;
+        map->capacity = capacity;
+    }
+    map->spans[map->count].firstLine = firstLine;
+    map->spans[map->count].fileLine = fileLine;
+    map->spans[map->count].advance = advance;
+    map->spans[map->count].fileName = fileName;
+    map->count++;
 }
 
 /**
- * @brief Frees allocated memory for each word in the memoryLines array.
+ * @brief Finds the file and the line a line of the text of a stage comes from.
  *
- * Iterates through the memoryLines array and frees the memory allocated for each word,
- * then sets the pointer to NULL to avoid dangling references.
+ * @param map The map of the stage.
+ * @param lineNumber The line, counted in the text of the stage.
+ * @param fileName Receives the file, or NULL for the source itself.
+ * @return The line of the file.
  */
-void freeMemoryLines()
+int findLineOrigin(const LineMap *map, int lineNumber, const char **fileName)
 {
-    int i;
-    for (i = 0; i < MAX_DATA; i++) /* Loop through each entry in the memoryLines array */
+    int low = 0, high = map->count - 1, middle;
+    const LineSpan *span;
+
+    *fileName = NULL;
+    if (map->count == 0 || lineNumber < map->spans[0].firstLine)
+    {
+        return lineNumber;
+    }
+    while (low < high) /* The last span starting at or before the line */
     {
-        free(memoryLines[i].word);  /* Free the allocated memory for the word */
-        memoryLines[i].word = NULL; /* Set the pointer to NULL after freeing */
+        middle = (low + high + 1) / 2;
+        if (map->spans[middle].firstLine <= lineNumber)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
     }
+    span = &map->spans[low];
+    *fileName = span->fileName;
+    return span->fileLine + span->advance * (lineNumber - span->firstLine);
 }
 
 /**
- * @brief Displays the content of memory lines based on their addressing types.
+ * @brief Displays the words of the image based on their addressing types.
  *
- * Iterates through the memory lines up to the sum of IC (Instruction Counter) and DC (Data Counter),
- * printing each memory line's type and value or binary representation depending on the addressing type.
+ * Iterates through the image up to the sum of IC (Instruction Counter) and DC (Data Counter),
+ * printing each word's type and binary representation.
+ *
+ * @param ctx The assembler context.
  */
-void printMemoryLines()
+void printMemoryLines(AssemblerContext *ctx)
 {
     int i;
     printf("Memory Content:\n");
-    for (i = 0; i < IC + DC; i++)
+    for (i = 0; i < ctx->IC + ctx->DC; i++)
     {
-        switch (memoryLines[i].type) /* Determine the type of addressing used */
+        switch (ctx->wordTypes[i]) /* Determine the type of addressing used */
         {
         case IMMEDIATE_ADDRESSING:
             printf("MemoryLines[%d] IMMEDIATE: ", i);
-            printWordAsBinary(*memoryLines[i].word);
+            printAsBinary(ctx->image[i]);
             break;
         case INDEX_ADDRESSING:
             printf("MemoryLines[%d] INDEX: ", i);
-
-            printAsBinary(memoryLines[i].value);
+            printAsBinary(ctx->image[i]);
             break;
         case INDEX_ADDRESSING_VALUE:
             printf("MemoryLines[%d] INDEX VALUE: ", i);
-            printWordAsBinary(*memoryLines[i].word);
+            printAsBinary(ctx->image[i]);
             break;
         case REGISTER_ADDRESSING:
             printf("MemoryLines[%d] REGISTER: ", i);
-            printWordAsBinary(*memoryLines[i].word);
+            printAsBinary(ctx->image[i]);
             break;
         case DIRECT_ADDRESSING:
             printf("MemoryLines[%d] DIRECT: ", i);
-            printAsBinary(memoryLines[i].value);
+            printAsBinary(ctx->image[i]);
             break;
         case INSTRUCTION_ADDRESSING:
             printf("MemoryLines[%d] INSTRUCTION: ", i);
-            printFirstWordAsBinary(*memoryLines[i].word);
+            printFirstWordAsBinary(ctx->image[i]);
             break;
         default:
             printf("MemoryLines[%d]: ", i);
-            printAsBinary(memoryLines[i].value);
-            break;
-        }
-    }
-}
-/**
- * @brief Stores the values from memory lines into the memory address array based on addressing type.
- *
- * Iterates through combined memory lines determined by the Instruction Counter (IC) and Data Counter (DC),
- * storing values in the memory address array. The type of value stored depends on the addressing method of the line.
- */
-void storeMemoryLine()
-{
-    int i;
-    unsigned int binaryValue;
-    for (i = 0; i < IC + DC; i++)
-    {
-        switch (memoryLines[i].type)
-        {
-        case IMMEDIATE_ADDRESSING:
-        case INDEX_ADDRESSING_VALUE:
-        case REGISTER_ADDRESSING:
-            memoryAddress[i] = memoryLines[i].word->value;
-            break;
-        case DIRECT_ADDRESSING:
-        case INDEX_ADDRESSING:
-            memoryAddress[i] = memoryLines[i].value;
-            break;
-        case INSTRUCTION_ADDRESSING:
-            binaryValue = getFirstWordAsBinary(*memoryLines[i].word);
-            memoryAddress[i] = binaryValue;
-            break;
-        default:
-            memoryAddress[i] = memoryLines[i].value;
+            printAsBinary(ctx->image[i]);
             break;
         }
     }
 }
 
 /**
- * @brief Converts the components of a Word structure into a binary format.
- *
- * This function takes each field of the Word's bit-fields and positions them into a single
- * unsigned integer according to their respective bit positions in the assembler's binary format.
+ * @brief Encodes the first word of an instruction and looks up its shape.
  *
- * @param word The Word structure to convert.
- * @return The unsigned integer representing the binary format of the Word.
+ * @param word The word of the image to set.
+ * @param opcode The opcode of the instruction.
+ * @param srcMode The addressing method of the source operand, or NO_OPERAND.
+ * @param destMode The addressing method of the destination operand, or NO_OPERAND.
+ * @return The shape of the instruction; its length is 0 if the methods are not legal for the opcode.
  */
-unsigned int getFirstWordAsBinary(Word word)
+InstructionShape encodeFirstWord(Word *word, int opcode, Addressing srcMode, Addressing destMode)
 {
-    unsigned int result = 0;         /* Initialize result to zero */
-    result |= word.bits.na << 10;    /* Shift 'na' bits and add to result */
-    result |= word.bits.opcode << 6; /* Shift 'opcode' bits and add to result */
-    result |= word.bits.srcOp << 4;  /* Shift 'source operand' bits and add to result */
-    result |= word.bits.desOp << 2;  /* Shift 'destination operand' bits and add to result */
-    result |= word.bits.ARE;         /* Add 'ARE' bits directly */
-    return result;                   /* Return the composed binary result */
+    const Command *command = &commandTable[opcode];
+    InstructionShape shape = shapeTable[srcMode][destMode];
+
+    /* Both methods must be in the legal sets of the command */
+    shape.length *= (command->srcModes >> srcMode) & (command->destModes >> destMode) & 1;
+    *word = (Word)(command->opcodeBits | shape.modeBits); /* The ARE bits stay 0 */
+    return shape;
 }
 
 /**
- * @brief Displays the content of the memory address array.
+ * @brief Displays the content of the memory image.
  *
- * Iterates through the memory address array from 0 to the sum of the Instruction Counter (IC)
+ * Iterates through the image from 0 to the sum of the Instruction Counter (IC)
  * and Data Counter (DC), printing each address and its corresponding value in binary format.
+ *
+ * @param ctx The assembler context.
  */
-void printMemoryAddress()
+void printMemoryAddress(AssemblerContext *ctx)
 {
     int i;
     printf("Memory Address Content:\n");
-    for (i = 0; i < IC + DC; i++)
+    for (i = 0; i < ctx->IC + ctx->DC; i++)
     {
-        printf("%d : %d : ", i + 100, memoryAddress[i]);
-        printAsBinary(memoryAddress[i]); /* Print the binary representation of the memory address */
+        printf("%d : %d : ", i + 100, ctx->image[i]);
+        printAsBinary(ctx->image[i]); /* Print the binary representation of the word */
     }
 }
 
 /**
- * @brief Prints the binary representation of a Word structure.
+ * @brief Prints the binary representation of the first word of an instruction.
  *
- * This function sequentially prints the binary bits of each field within a Word's bit-fields:
- * 'na', 'opcode', 'srcOp', 'desOp', and 'ARE', displaying the complete binary format of the word.
+ * This function sequentially prints the bits of each field of the word:
+ * the unused bits, 'opcode', 'srcOp', 'desOp', and 'ARE', displaying the complete binary format of the word.
  *
- * @param word The Word structure whose binary representation is to be printed.
+ * @param word The word whose binary representation is to be printed.
  */
 void printFirstWordAsBinary(Word word)
 {
     int i;
     printf("Binary: ");
 
-    for (i = 3; i >= 0; i--)
+    for (i = 13; i >= 10; i--)
     {
-        printf("%d", (word.bits.na >> i) & 1);
+        printf("%d", (word >> i) & 1);
     }
 
-    for (i = 3; i >= 0; i--)
+    for (i = 9; i >= 6; i--)
     {
-        printf("%d", (word.bits.opcode >> i) & 1);
+        printf("%d", (word >> i) & 1);
     }
 
-    for (i = 1; i >= 0; i--)
+    for (i = 5; i >= 4; i--)
     {
-        printf("%d", (word.bits.srcOp >> i) & 1);
+        printf("%d", (word >> i) & 1);
     }
 
-    for (i = 1; i >= 0; i--)
+    for (i = 3; i >= 2; i--)
     {
-        printf("%d", (word.bits.desOp >> i) & 1);
+        printf("%d", (word >> i) & 1);
     }
 
     for (i = 1; i >= 0; i--)
     {
-        printf("%d", (word.bits.ARE >> i) & 1);
+        printf("%d", (word >> i) & 1);
     }
 
     printf("\n");
 }
 
 /**
- * Prints the binary representation of a Word.
- * The function converts the 'value' field of the Word structure into a 14-bit binary string and prints it.
- *
- * @param word The Word structure whose value is to be printed in binary form.
- */
-void printWordAsBinary(Word word)
-{
-    int i;
-    printf("Binary: ");
-    for (i = 13; i >= 0; i--)
-    {
-        printf("%d", (word.value >> i) & 1);
-    }
-    printf("\n");
-}
-
-/**
- * @brief Prints the binary representation of the full word value from a Word structure.
+ * @brief Prints the 14-bit binary representation of a value.
  *
- * This function outputs the 14-bit binary representation of the 'value' field in the Word structure,
- * displaying it as a binary string from the most significant bit to the least significant bit.
+ * The value is displayed as a binary string from the most significant bit to the least significant bit.
  *
- * @param word The Word structure whose full word value is to be printed in binary.
+ * @param value The value to print in binary.
  */
 void printAsBinary(int value)
 {
@@ -712,19 +932,18 @@ void printAsBinary(int value)
     printf("\n");
 }
 /**
- * @brief Sets the immediate value and ARE bits in a Word's value field.
+ * @brief Sets an immediate value and ARE bits in a word.
  *
- * This function configures a Word structure by setting its value field with an immediate
- * value shifted by two positions and combined with the ARE (Assembler Relocation Entries) bits.
+ * This function sets the word to an immediate value shifted by two positions and combined
+ * with the ARE (Assembler Relocation Entries) bits.
  * It processes the immediate value to handle negative numbers appropriately within a 12-bit limit.
  *
- * @param word Pointer to the Word structure to be modified.
+ * @param word The word of the image to set.
  * @param immediateValue The immediate value to encode into the word.
  * @param areBits The A, R, E bits to set in the lower two bits of the word.
  */
 void setImmediateValue(Word *word, int immediateValue, unsigned int areBits)
 {
-    word->value = 0; /* Reset the word value */
     areBits &= 0x03; /* Ensure ARE bits are within the lowest two bits range */
                      /* Adjust immediateValue for negative inputs within a 12-bit representation */
     if (immediateValue < 0)
@@ -733,18 +952,18 @@ void setImmediateValue(Word *word, int immediateValue, unsigned int areBits)
     }
     immediateValue &= 0xFFF; /* Mask to ensure the value fits in 12 bits */
 
-    word->value = (immediateValue << 2) | areBits; /* Set word value with immediate value and ARE bits */
+    *word = (Word)((immediateValue << 2) | areBits); /* Set the word to the immediate value and ARE bits */
 }
 
 /**
- * @brief Configures a Word structure to encode register numbers and their presence.
+ * @brief Sets a word to encode register numbers and their presence.
  *
- * This function sets up the Word's value to represent source and destination register numbers
+ * This function sets the word to represent source and destination register numbers
  * based on provided flags indicating their presence. It positions the register numbers in the
  * word value based on predefined bit positions: source register at bits 5-7 and destination register
  * at bits 2-4.
  *
- * @param word Pointer to the Word structure to be modified.
+ * @param word The word of the image to set.
  * @param srcRegNum Source register number.
  * @param destRegNum Destination register number.
  * @param hasSrc Flag indicating if the source register is to be encoded.
@@ -753,20 +972,21 @@ void setImmediateValue(Word *word, int immediateValue, unsigned int areBits)
 
 void setRegisterValue(Word *word, int srcRegNum, int destRegNum, int hasSrc, int hasDest)
 {
-    word->value = 0; /* Initialize word value to zero */
+    unsigned int value = 0; /* Start from an empty word */
 
     srcRegNum &= 0x07;  /* Mask source register number to ensure it is within 0 to 7 */
     destRegNum &= 0x07; /* Mask destination register number similarly */
 
     if (hasSrc)
     {
-        word->value |= (srcRegNum << 5); /* Encode source register number starting at bit 5 */
+        value |= (srcRegNum << 5); /* Encode source register number starting at bit 5 */
     }
 
     if (hasDest)
     {
-        word->value |= (destRegNum << 2); /* Encode destination register number starting at bit 2 */
+        value |= (destRegNum << 2); /* Encode destination register number starting at bit 2 */
     }
+    *word = (Word)value;
 }
 
 /**
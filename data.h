@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "text_buffer.h"
+#include "arena.h"
+
 /* Constant definitions for assembler limits */
 #define MAX_LABEL_LENGTH 31
 #define MAX_SYMBOLS 100
@@ -12,80 +15,75 @@
 #define MIN_12BIT_VALUE -2048
 #define MAX_12BIT_VALUE 2047
 #define MAX_LABELS 100
-#define MAX_COMMANDS 100
 #define MAX_LINE_LENGTH 81
 #define CMD_NUM 16
 #define MAX_OPERANDS 2
 #define MAX_SYMBOLS 100
-#define MAX_RESERVED_WORDS 27
 #define MAX_FILENAME_LEN 260
-#define MAX_EXTERNAL_USAGES 1000
-
-/* Global variables for assembler state */
-extern int IC;                 /* Instruction Counter */
-extern int DC;                 /* Data Counter */
-extern int L;                  /* Line number in the source code */
-extern int symbolCount;        /* Number of symbols */
-extern int dataCount;          /* Number of data entries */
-extern int labelCount;         /* Number of labels */
-extern int commandCount;       /* Number of commands */
-extern int labelFlag;          /* Flag for label detection */
-extern int dataFlag;           /* Flag for data detection */
-extern int commandFlag;        /* Flag for command detection */
-extern int symbolFlag;         /* Flag for symbol detection */
-extern int entryFlag;          /* Flag for entry detection */
-extern int externFlag;         /* Flag for extern detection */
-extern int lineNum;            /* Current line number being processed */
-extern int errorFlag;          /* Flag for error detection */
-extern int lineErrorFlag;      /* Flag for line error detection */
-extern int externalUsageCount; /* Number of external symbols used in the program */
-extern int entryCount;         /* Tracker for the number of entry symbols */
-extern int memory[MAX_DATA];   /* Memory array for the assembler */
-
-/* Array of saved words used by the assembler */
-extern char *savedWords[];
+#define INITIAL_TABLE_SLOTS 64 /* Initial number of slots of the symbol and name tables; a power of two */
+#define MAX_MESSAGE_LENGTH 160
+#define MAX_CONDITION_DEPTH 32 /* Number of conditional blocks that can be open at once */
+
+typedef enum Addressings
+{
+    IMMEDIATE = 0,
+    DIRECT = 1,
+    INDEX = 2,
+    REGISTER = 3,
+    NO_OPERAND = 4, /* The instruction has no operand in this position */
+    INVALID = -1
+} Addressing;
+
+#define ADDRESSING_MODES 5 /* Number of Addressing values an operand position can take, NO_OPERAND included */
+
+/* Sets of addressing methods, one bit per Addressing value */
+#define MODE_BIT(mode) (1u << (mode))
+#define ANY_MODE (MODE_BIT(IMMEDIATE) | MODE_BIT(DIRECT) | MODE_BIT(INDEX) | MODE_BIT(REGISTER))
+#define WRITABLE_MODES (MODE_BIT(DIRECT) | MODE_BIT(INDEX) | MODE_BIT(REGISTER))
+#define JUMP_MODES (MODE_BIT(DIRECT) | MODE_BIT(REGISTER))
+#define ADDRESS_MODES (MODE_BIT(DIRECT) | MODE_BIT(INDEX))
+#define NO_MODE MODE_BIT(NO_OPERAND)
 
 /* Structure defining a command in the assembler */
 typedef struct Command
 {
-    const char *cmdName;   /* Name of the command */
-    int opCode;            /* Opcode of the command */
-    int numOfOps;          /* Number of operands the command takes */
-    int srcLegalAddrs[4];  /* Legal addressing methods for source operand */
-    int destLegalAddrs[4]; /* Legal addressing methods for destination operand */
+    const char *cmdName;     /* Name of the command */
+    int opCode;              /* Opcode of the command */
+    int numOfOps;            /* Number of operands the command takes */
+    unsigned int opcodeBits; /* The opcode at its position in the first word */
+    unsigned int srcModes;   /* Legal addressing methods for source operand, NO_MODE if there is none */
+    unsigned int destModes;  /* Legal addressing methods for destination operand, NO_MODE if there is none */
 } Command;
 
-extern Command commandTable[CMD_NUM]; /* Table of assembler commands */
+extern const Command commandTable[CMD_NUM]; /* Table of assembler commands */
 
-typedef struct ParsedInstruction
+/* How an instruction is laid out in memory, given the addressing methods of its operands */
+typedef struct InstructionShape
 {
-    char *name;
-    int opcode;
-    char *operands[MAX_OPERANDS];
-} Instruction;
+    unsigned char length;       /* Number of words, the first word included; 0 if the methods are illegal */
+    unsigned char modeBits;     /* The addressing methods at their position in the first word */
+    unsigned char registerPair; /* Nonzero if both operands are registers sharing one word */
+} InstructionShape;
 
-typedef enum Addressings
+/* A run of characters inside a line; it is not null-terminated */
+typedef struct StringView
 {
-    IMMEDIATE = 0,
-    DIRECT = 1,
-    INDEX = 2,
-    REGISTER = 3,
-    INVALID = -1
-} Addressing;
+    const char *start; /* First character, or NULL for an absent string */
+    size_t length;     /* Number of characters */
+} StringView;
 
-/* Union defining a word in the assembler's memory */
-typedef union Word
+typedef struct ParsedInstruction
 {
-    struct
-    {
-        unsigned int na : 4;     /* Not used */
-        unsigned int opcode : 4; /* Opcode part of the word */
-        unsigned int srcOp : 2;  /* Source operand addressing mode */
-        unsigned int desOp : 2;  /* Destination operand addressing mode */
-        unsigned int ARE : 2;    /* A,R,E fields for assembler relocation */
-    } bits;
-    unsigned int value; /* The full word value */
-} Word;
+    const char *name;                /* Name of the instruction, from the command table */
+    int opcode;
+    StringView operands[MAX_OPERANDS]; /* The operands, inside the source line */
+    Addressing modes[MAX_OPERANDS];    /* Addressing method of each operand */
+} Instruction;
+
+/* A 14-bit word of the assembler's memory. The first word of an instruction holds, from the top:
+ * 4 unused bits, the opcode (4 bits), the source and destination addressing modes (2 bits each)
+ * and the A,R,E bits (2 bits). */
+typedef unsigned short Word;
 
 typedef enum AddressingMethod
 {
@@ -98,19 +96,45 @@ typedef enum AddressingMethod
     INVALID_ADDRESSING
 } AddressingMethod;
 
-typedef struct MemoryEntry
+/* A word of the image that holds the address of a symbol, patched once the symbol is resolved */
+typedef struct Fixup
 {
-    Word *word;
-    AddressingMethod type;
-    int needEncoding;
-    int value;
-    char *symbol;
-    unsigned int address;
-} MemoryEntry;
+    int address;        /* Index of the word in the image */
+    struct Fixup *next; /* The next word waiting for the same symbol */
+} Fixup;
 
-extern MemoryEntry memoryLines[MAX_DATA]; /* Memory array for the assembler */
+/* The words waiting for the address of one symbol */
+typedef struct FixupChain
+{
+    const char *symbol;      /* Interned name of the symbol */
+    Fixup *fixups;           /* The words to patch, in increasing address order */
+    Fixup *lastFixup;        /* The last word of fixups */
+    struct FixupChain *next; /* The chain of the next symbol, in the order they were first used */
+} FixupChain;
 
-extern unsigned int memoryAddress[MAX_DATA]; /* Memory array for the assembler */
+/* A name of an .entry directive, queued by the first pass and resolved once every symbol is defined */
+typedef struct QueuedEntry
+{
+    const char *name;         /* Interned name of the symbol */
+    int lineNum;              /* Line of the directive */
+    int symbol;               /* Index of the symbol in the symbol table once resolved, -1 before */
+    struct QueuedEntry *next; /* The next queued name */
+} QueuedEntry;
+
+/* A word of data, logged by a chunk of a split first pass together with the instruction counter it was
+ * stored at, so the merged image can place it where a single pass would have */
+typedef struct DataWord
+{
+    Word value; /* The word */
+    int IC;     /* Instruction counter when the word was stored */
+} DataWord;
+
+/* A name an operand looked up without finding it, in a chunk of a split first pass */
+typedef struct MissedName
+{
+    const char *name;        /* The name, copied into the arena */
+    struct MissedName *next; /* The next name missed */
+} MissedName;
 
 /* Enumeration for different types of symbols */
 typedef enum
@@ -118,29 +142,79 @@ typedef enum
     data,     /* Data symbol */
     code,     /* Code symbol */
     external, /* External symbol */
-    entry,    /* Entry symbol */
     mdefine   /* Macro definition */
 } SymbolType;
 
-typedef struct externalSymbolUsage
-{
-    char *symbolName;
-    int address;
-} ExternalSymbolUsage;
-extern ExternalSymbolUsage externalUsages[MAX_EXTERNAL_USAGES];
-
-extern char *entrySymbols[MAX_SYMBOLS]; /* Array of entry symbols */
-
 /* Structure defining a symbol in the symbol table */
 typedef struct Symbol
 {
-    const char *symbolName; /* Name of the symbol */
+    const char *symbolName; /* Name of the symbol, interned in the name table */
     SymbolType symbolType;  /* Type of the symbol */
     unsigned int value;     /* Value of the symbol */
-    struct Symbol *next;    /* Pointer to the next symbol in the table */
+    unsigned long hash;     /* Hash of the name, computed once when the symbol is added */
+    int *uses;              /* Addresses of the words using an external symbol, in increasing order */
+    int useCount;           /* Number of uses */
+    int useCapacity;        /* Number of uses allocated */
 } Symbol;
 
-extern Symbol *symbolTable[MAX_SYMBOLS]; /* The symbol table */
+/* Symbol table: the symbols are stored contiguously in the order they were added, and found through an
+ * open-addressing index that grows with the number of symbols */
+typedef struct SymbolTable
+{
+    Symbol *symbols;        /* The symbols, in the order they were added */
+    int count;              /* Number of symbols */
+    int capacity;           /* Number of symbols allocated */
+    int *slots;             /* Index into symbols for each slot, or -1 for an empty slot */
+    unsigned long slotMask; /* Number of slots minus one; the number of slots is a power of two */
+} SymbolTable;
+
+/* Set of names, each stored once, so that equal names interned in it share one pointer */
+typedef struct NameTable
+{
+    char **slots;           /* The names, in open-addressing slots; NULL for an empty slot */
+    FixupChain **chains;    /* For each slot, the words waiting for the name; NULL if there are none */
+    unsigned char *entries; /* For each slot, nonzero if an .entry directive declared the name, to report conflicting directives */
+    unsigned long count;    /* Number of names */
+    unsigned long slotMask; /* Number of slots minus one; the number of slots is a power of two */
+} NameTable;
+
+
+/* A slot of the macro table. The hash of the name is kept beside the macro, so a probe only reads the
+ * macro when the hashes match. */
+typedef struct MacroSlot
+{
+    unsigned long hash;  /* Hash of the name of the macro */
+    struct Macro *macro; /* The macro, or NULL for an empty slot */
+} MacroSlot;
+
+/* Macro table: open addressing over slots that double in the arena to stay at most half full, with
+ * counters of the probes made, to check that lookups stay short */
+typedef struct MacroTable
+{
+    MacroSlot *slots;           /* The slots; NULL until the first macro is added */
+    unsigned long slotMask;     /* Number of slots minus one; the number of slots is a power of two */
+    unsigned long count;        /* Number of macros */
+    unsigned long lookups;      /* Lookups made in a table that was not empty */
+    unsigned long probes;       /* Slots examined by the lookups */
+    unsigned long longestProbe; /* Most slots examined by one lookup */
+} MacroTable;
+
+/* Lines of the text of a stage that come from one place. A span runs up to the first line of the next one. */
+typedef struct LineSpan
+{
+    int firstLine;        /* First line of the span, counted in the text of the stage */
+    int fileLine;         /* Line of the file the first line of the span comes from */
+    int advance;          /* 1 if the lines follow each other in the file, 0 if they all come from fileLine */
+    const char *fileName; /* The included file, or NULL for the source itself */
+} LineSpan;
+
+/* The lines of the text of a stage, mapped back to the files they were read from */
+typedef struct LineMap
+{
+    LineSpan *spans; /* The spans, in increasing order of their first line */
+    int count;       /* Number of spans */
+    int capacity;    /* Number of spans allocated */
+} LineMap;
 
 /* Enumeration for different types of directives */
 typedef enum
@@ -150,24 +224,82 @@ typedef enum
     ENTRY_DIRECTIVE,
     EXTERN_DIRECTIVE,
     DEFINE_DIRECTIVE,
+    IF_DIRECTIVE,
+    IFDEF_DIRECTIVE,
+    ELSE_DIRECTIVE,
+    ENDIF_DIRECTIVE,
     INVALID_DIRECTIVE
 } DirectiveType;
 
-/* Structure defining a translation unit in the translation table */
-typedef struct Translation
+/* State of the assembly of a single file. Every stage reads and updates the context it is given,
+ * so several files can be assembled at the same time, each with a context of its own. */
+typedef struct AssemblerContext
 {
-    int decimalAddress; /* Decimal address of the word */
-    Word *word;         /* Pointer to the word being translated */
-} Translation;
+    int IC;                                           /* Instruction Counter */
+    int DC;                                           /* Data Counter */
+    int L;                                            /* Number of words of the current instruction */
+    int lineNum;                                      /* Current line number being processed */
+    int errorFlag;                                    /* Flag for error detection */
+    int lineErrorFlag;                                /* Flag for line error detection */
+    int symbolFlag;                                   /* Flag for symbol detection */
+    Word image[MAX_DATA];                             /* Encoded memory image: instructions, then data */
+    unsigned char wordTypes[MAX_DATA];                /* AddressingMethod of each word of the image */
+    FixupChain *fixupChains;                          /* Words waiting for the address of a symbol, per symbol */
+    FixupChain *lastFixupChain;                       /* The last chain of fixupChains */
+    QueuedEntry *entryQueue;                          /* Names of .entry directives waiting to be resolved */
+    QueuedEntry *lastQueuedEntry;                     /* The last name of entryQueue */
+    SymbolTable symbolTable;                          /* The symbol table */
+    NameTable names;                                  /* Interned symbol names */
+    MacroTable macros;                                /* The macro table */
+    unsigned char macroInitials[32];                  /* Bit set of the first characters of the macro names */
+    unsigned long macroLengths;                       /* Bit set of the lengths of the macro names; bit 31 stands for any longer one */
+    Arena arena;                                      /* Memory of the file being assembled, released at once */
+    TextBuffer diagnostics;                           /* Error messages reported while assembling */
+    unsigned long linesRead;                          /* Source lines read by the macro parser */
+    unsigned long instructionLines;                   /* Instruction lines encoded by the first pass */
+    unsigned long symbolLookups;                      /* Symbol table lookups */
+    unsigned long macroExpansions;                    /* Macro uses expanded */
+    int chunked;                                      /* Nonzero when reading a chunk that does not start the source */
+    int chunkConflict;                                /* Nonzero if the chunk used the value of a label, or overflowed dataLog */
+    MissedName *missedNames;                          /* Names the chunk looked up without finding them */
+    DataWord *dataLog;                                /* Data words stored by the chunk, or NULL when not logged */
+    int dataLogCapacity;                              /* Number of words dataLog holds */
+    const struct AsmPrelude *prelude;                 /* Macros and constants defined before the source, or NULL */
+    LineMap includeMap;                               /* Lines of the source once its .include directives are expanded */
+    LineMap expandedMap;                              /* Lines of the source once its macros are expanded */
+    const LineMap *lineMap;                           /* The map of the line numbers being reported, or NULL if they need none */
+    int conditionDepth;                               /* Number of conditional blocks open at the current line */
+    unsigned long elseSeen;                           /* Bit set of the open conditional blocks past their .else */
+    size_t conditionStarts[MAX_CONDITION_DEPTH];      /* Offset of the .if or .ifdef line of each open conditional block */
+} AssemblerContext;
 
 /* Function prototypes for operations on the assembler's data structures */
-void initData();
+
+/**
+ * @brief Allocates a new assembler context with empty tables.
+ *
+ * @return The new context, or NULL if memory allocation fails.
+ */
+AssemblerContext *createAssemblerContext();
+
+/**
+ * @brief Releases everything owned by the context and clears it, so it can assemble another file.
+ *
+ * @param ctx The context to reset.
+ */
+void resetAssemblerContext(AssemblerContext *ctx);
+
+/**
+ * @brief Releases an assembler context and everything it owns.
+ *
+ * @param ctx The context to destroy. May be NULL.
+ */
+void destroyAssemblerContext(AssemblerContext *ctx);
 
 /**
  * @brief Retrieves the opcode corresponding to a given command name.
  *
- * This function searches the command table for a command matching the provided token
- * and returns the associated opcode if found.
+ * The command name is looked up in the keyword table.
  *
  * @param token The command name to search for in the command table.
  * @return The opcode of the command if found, or -1 if the command does not exist.
@@ -184,145 +316,212 @@ int getOpcode(char *token); /* Get the opcode for a command */
 void printIstruction(Instruction *instruction);
 
 /**
- * Generates a hash value for a symbol name.
+ * Generates a 32-bit hash value for a symbol name (FNV-1a followed by a final avalanche step).
  *
  * @param name The symbol name to hash.
  * @return The hash value for the symbol name.
  */
-unsigned int hashSymbolName(const char *name);
+unsigned long hashSymbolName(const char *name);
 
 /**
- * Initializes the symbol table by setting all entries to NULL.
+ * Returns the interned copy of a name, adding it to the name table if needed.
+ * Equal names always return the same pointer, which stays valid until the context is reset.
+ *
+ * @param ctx The assembler context.
+ * @param name The name to intern.
+ * @return The interned name, or NULL if memory allocation fails.
+ */
+const char *internName(AssemblerContext *ctx, const char *name);
+
+/**
+ * Initializes the symbol table to empty.
+ *
+ * @param ctx The assembler context.
  */
-void initSymbolTable();
+void initSymbolTable(AssemblerContext *ctx);
 
 /**
  * Looks up a symbol in the symbol table.
+ * Names interned with internName are matched by pointer, without comparing their characters.
  *
+ * @param ctx The assembler context.
  * @param name The name of the symbol to find.
- * @return A pointer to the found symbol or NULL if not found.
+ * @return A pointer to the found symbol, valid until the next symbol is added, or NULL if not found.
  */
-struct Symbol *lookupSymbol(const char *name);
+struct Symbol *lookupSymbol(AssemblerContext *ctx, const char *name);
+
+/**
+ * Finds a symbol in a symbol table, without counting the lookup in the statistics of the assembly.
+ * Used by checks made on the side of the assembly, such as those of a split first pass.
+ *
+ * @param table The symbol table.
+ * @param name The name of the symbol to find.
+ * @return A pointer to the found symbol, valid until the next symbol is added, or NULL if not found.
+ */
+struct Symbol *findSymbol(SymbolTable *table, const char *name);
 
 /**
  * Adds a symbol to the symbol table.
  *
+ * @param ctx The assembler context.
  * @param name The name of the symbol to add.
  * @param type The type of the symbol.
  * @param value The value of the symbol.
  */
-void addSymbol(const char *name, SymbolType type, unsigned int value);
+void addSymbol(AssemblerContext *ctx, const char *name, SymbolType type, unsigned int value);
+
+/**
+ * Adds a symbol to the symbol table, as addSymbol does, without counting the check that the name is new
+ * in the statistics of the assembly. Used for symbols copied from the chunks of a split first pass, whose
+ * own lookups are already counted.
+ *
+ * @param ctx The assembler context.
+ * @param name The name of the symbol to add.
+ * @param type The type of the symbol.
+ * @param value The value of the symbol.
+ */
+void addSymbolUncounted(AssemblerContext *ctx, const char *name, SymbolType type, unsigned int value);
 
 /**
  * Prints the entire symbol table.
+ *
+ * @param ctx The assembler context.
  */
-void printSymbolTable();
+void printSymbolTable(AssemblerContext *ctx);
 /**
  * Prints the usage of all external symbols.
+ *
+ * @param ctx The assembler context.
  */
-void printExternSymbolUsage();
+void printExternSymbolUsage(AssemblerContext *ctx);
 /**
  * Updates the values of all symbols of type 'data' in the symbol table.
  * The new value is calculated based on a global counter `IC`.
+ *
+ * @param ctx The assembler context.
  */
-void updateSymbolValues();
+void updateSymbolValues(AssemblerContext *ctx);
 /**
  * Records the usage of an external symbol at a specific address.
+ * The address is appended to the list of uses of the symbol, which grows as needed.
  *
- * @param symbolName The name of the external symbol used.
+ * @param ctx The assembler context.
+ * @param symbol The external symbol used.
  * @param address The address where the symbol is used.
  */
-void recordExternalSymbolUsage(char *symbolName, int address);
+void recordExternalSymbolUsage(AssemblerContext *ctx, Symbol *symbol, int address);
 
 /**
- * Adds a label to the entrySymbols array.
- * Assumes the label does not already exist in the array.
+ * Marks a label as declared by an .entry directive.
+ * The mark is kept with the name of the label, so the label does not need to be defined yet.
  *
+ * @param ctx The assembler context.
  * @param label The label to add.
  */
-void addEntryLabel(char *label);
+void addEntryLabel(AssemblerContext *ctx, char *label);
 
 /**
  * Checks if a label is already an entry label.
  *
+ * @param ctx The assembler context.
  * @param label The label to check.
  * @return True if the label is found, False otherwise.
  */
-int isEntryLabel(char *label);
+int isEntryLabel(AssemblerContext *ctx, char *label);
 /**
  * Updates the type of a symbol in the symbol table.
  *
+ * @param ctx The assembler context.
  * @param symbolName The name of the symbol whose type is to be updated.
  * @param type The new type for the symbol.
  */
-void updateSymbolType(char *symbolName, int type);
+void updateSymbolType(AssemblerContext *ctx, char *symbolName, int type);
 
 /**
  * @brief Checks if a given word is a reserved word in the assembler.
  *
- * This function iterates through an array of reserved words and compares each with the provided
- * word. If a match is found, the function returns 1, indicating the word is reserved.
+ * The word is looked up in the keyword table, which marks the reserved words.
  *
  * @param word The word to check against the list of reserved words.
  * @return 1 if the word is a reserved word, 0 otherwise.
  */
 int isReservedWord(char *word);
 /**
- * @brief Displays the content of memory up to the combined count of instruction and data counters.
+ * @brief Displays the words of the image based on their addressing types.
+ *
+ * Iterates through the image up to the sum of IC (Instruction Counter) and DC (Data Counter),
+ * printing each word's type and binary representation.
  *
- * Iterates through the memory array from 0 to the sum of IC (Instruction Counter) and DC (Data Counter),
- * printing each memory cell's index and value.
+ * @param ctx The assembler context.
  */
-void printMemory();
+void printMemoryLines(AssemblerContext *ctx);
 /**
- * @brief Displays the content of memory lines based on their addressing types.
+ * @brief Clears the memory image and its addressing types before a first pass.
  *
- * Iterates through the memory lines up to the sum of IC (Instruction Counter) and DC (Data Counter),
- * printing each memory line's type and value or binary representation depending on the addressing type.
+ * @param ctx The assembler context.
  */
-void printMemoryLines();
+void initMemoryImage(AssemblerContext *ctx);
 /**
- * @brief Initializes the memory lines array used in the assembler.
+ * @brief Records that a word of the image holds the address of a symbol.
  *
- * Allocates memory for each 'Word' in the memoryLines array and sets initial values.
- * If memory allocation fails, the function will terminate the program.
+ * The word is linked into the fixup chain of the symbol, which is patched by the second pass once
+ * every symbol is defined.
+ *
+ * @param ctx The assembler context.
+ * @param address The index of the word in the image.
+ * @param name The name of the symbol.
+ * @return The interned name of the symbol, or NULL if memory allocation fails.
  */
-void initMemoryLines();
+const char *addFixup(AssemblerContext *ctx, int address, const char *name);
 /**
- * @brief Frees allocated memory for each word in the memoryLines array.
+ * @brief Queues a name of an .entry directive, to be resolved once every symbol is defined.
  *
- * Iterates through the memoryLines array and frees the memory allocated for each word,
- * then sets the pointer to NULL to avoid dangling references.
+ * @param ctx The assembler context.
+ * @param name The name of the symbol.
+ * @param lineNum The line of the directive, for error messages.
+ */
+void queueEntry(AssemblerContext *ctx, const char *name, int lineNum);
+/**
+ * @brief Maps the lines from a line of the text of a stage on to a line of a file.
+ *
+ * @param ctx The assembler context.
+ * @param map The map of the stage.
+ * @param firstLine The first line mapped, after the lines mapped so far.
+ * @param fileName The file the line comes from, or NULL for the source itself.
+ * @param fileLine The line of the file.
+ * @param advance 1 if the following lines follow it in the file, 0 if they come from the same line.
  */
-void freeMemoryLines();
+void addLineSpan(AssemblerContext *ctx, LineMap *map, int firstLine, const char *fileName, int fileLine, int advance);
 /**
- * Prints the binary representation of a Word.
- * The function converts the 'value' field of the Word structure into a 14-bit binary string and prints it.
+ * @brief Finds the file and the line a line of the text of a stage comes from.
  *
- * @param word The Word structure whose value is to be printed in binary form.
+ * @param map The map of the stage.
+ * @param lineNumber The line, counted in the text of the stage.
+ * @param fileName Receives the file, or NULL for the source itself.
+ * @return The line of the file.
  */
-void printWordAsBinary(const Word word);
+int findLineOrigin(const LineMap *map, int lineNumber, const char **fileName);
 /**
- * @brief Sets the immediate value and ARE bits in a Word's value field.
+ * @brief Sets an immediate value and ARE bits in a word.
  *
- * This function configures a Word structure by setting its value field with an immediate
- * value shifted by two positions and combined with the ARE (Assembler Relocation Entries) bits.
+ * This function sets the word to an immediate value shifted by two positions and combined
+ * with the ARE (Assembler Relocation Entries) bits.
  * It processes the immediate value to handle negative numbers appropriately within a 12-bit limit.
  *
- * @param word Pointer to the Word structure to be modified.
+ * @param word The word of the image to set.
  * @param immediateValue The immediate value to encode into the word.
  * @param areBits The A, R, E bits to set in the lower two bits of the word.
  */
 void setImmediateValue(Word *word, int immediateValue, unsigned int areBits);
 /**
- * @brief Configures a Word structure to encode register numbers and their presence.
+ * @brief Sets a word to encode register numbers and their presence.
  *
- * This function sets up the Word's value to represent source and destination register numbers
+ * This function sets the word to represent source and destination register numbers
  * based on provided flags indicating their presence. It positions the register numbers in the
  * word value based on predefined bit positions: source register at bits 5-7 and destination register
  * at bits 2-4.
  *
- * @param word Pointer to the Word structure to be modified.
+ * @param word The word of the image to set.
  * @param srcRegNum Source register number.
  * @param destRegNum Destination register number.
  * @param hasSrc Flag indicating if the source register is to be encoded.
@@ -342,45 +541,42 @@ void setRegisterValue(Word *word, int srcRegNum, int destRegNum, int hasSrc, int
 int computeFourteenBitValue(int value);
 
 /**
- * @brief Prints the binary representation of the full word value from a Word structure.
+ * @brief Prints the 14-bit binary representation of a value.
  *
- * This function outputs the 14-bit binary representation of the 'value' field in the Word structure,
- * displaying it as a binary string from the most significant bit to the least significant bit.
+ * The value is displayed as a binary string from the most significant bit to the least significant bit.
  *
- * @param word The Word structure whose full word value is to be printed in binary.
+ * @param value The value to print in binary.
  */
 void printAsBinary(int value);
 /**
- * @brief Prints the binary representation of a Word structure.
+ * @brief Prints the binary representation of the first word of an instruction.
  *
- * This function sequentially prints the binary bits of each field within a Word's bit-fields:
- * 'na', 'opcode', 'srcOp', 'desOp', and 'ARE', displaying the complete binary format of the word.
+ * This function sequentially prints the bits of each field of the word:
+ * the unused bits, 'opcode', 'srcOp', 'desOp', and 'ARE', displaying the complete binary format of the word.
  *
- * @param word The Word structure whose binary representation is to be printed.
+ * @param word The word whose binary representation is to be printed.
  */
 void printFirstWordAsBinary(Word word);
 /**
- * @brief Converts the components of a Word structure into a binary format.
+ * @brief Encodes the first word of an instruction and looks up its shape.
  *
- * This function takes each field of the Word's bit-fields and positions them into a single
- * unsigned integer according to their respective bit positions in the assembler's binary format.
+ * The legality of the addressing methods, the length of the instruction and the mode bits of the first
+ * word all come from precomputed tables, so the word is a single OR; the ARE bits are 0 (absolute).
  *
- * @param word The Word structure to convert.
- * @return The unsigned integer representing the binary format of the Word.
+ * @param word The word of the image to set.
+ * @param opcode The opcode of the instruction.
+ * @param srcMode The addressing method of the source operand, or NO_OPERAND.
+ * @param destMode The addressing method of the destination operand, or NO_OPERAND.
+ * @return The shape of the instruction; its length is 0 if the methods are not legal for the opcode.
  */
-unsigned int getFirstWordAsBinary(Word word);
+InstructionShape encodeFirstWord(Word *word, int opcode, Addressing srcMode, Addressing destMode);
 /**
- * @brief Displays the content of the memory address array.
+ * @brief Displays the content of the memory image.
  *
- * Iterates through the memory address array from 0 to the sum of the Instruction Counter (IC)
+ * Iterates through the image from 0 to the sum of the Instruction Counter (IC)
  * and Data Counter (DC), printing each address and its corresponding value in binary format.
- */
-void printMemoryAddress();
-/**
- * @brief Stores the values from memory lines into the memory address array based on addressing type.
  *
- * Iterates through combined memory lines determined by the Instruction Counter (IC) and Data Counter (DC),
- * storing values in the memory address array. The type of value stored depends on the addressing method of the line.
+ * @param ctx The assembler context.
  */
-void storeMemoryLine();
+void printMemoryAddress(AssemblerContext *ctx);
 #endif /* DATA_H */
@@ -1,189 +1,283 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "file_builder.h"
+#include "object_file.h"
 #include "utils.h"
 #include <stdio.h>
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-/**
-  @brief Get Memory address and build an '.ob' file from them.
+/* The encoded base-4 digits of every byte, most significant digit first: '*', '#', '%' and '!' stand for 0 to 3 */
+#define ENCODED_DIGIT(digit) ((digit) == 0 ? '*' : (digit) == 1 ? '#' : (digit) == 2 ? '%' : '!')
+#define ENCODED_BYTE(n) {ENCODED_DIGIT((n) >> 6 & 3), ENCODED_DIGIT((n) >> 4 & 3), ENCODED_DIGIT((n) >> 2 & 3), ENCODED_DIGIT((n) & 3)}
+#define ENCODED_4(n) ENCODED_BYTE(n), ENCODED_BYTE((n) + 1), ENCODED_BYTE((n) + 2), ENCODED_BYTE((n) + 3)
+#define ENCODED_16(n) ENCODED_4(n), ENCODED_4((n) + 4), ENCODED_4((n) + 8), ENCODED_4((n) + 12)
+#define ENCODED_64(n) ENCODED_16(n), ENCODED_16((n) + 16), ENCODED_16((n) + 32), ENCODED_16((n) + 48)
 
-  @param ob_filename The name of the '.ob' file.
-  @param memory_address Address of first memory word.
+static const char encodedBytes[256][4] = {ENCODED_64(0), ENCODED_64(64), ENCODED_64(128), ENCODED_64(192)};
+
+#define ADDRESS_DIGITS 4      /* Addresses are padded with zeros to this many digits */
+#define MAX_ADDRESS_DIGITS 10 /* Digits of the largest unsigned address */
+
+/**
+ * @brief Writes an address in decimal, padded with zeros to ADDRESS_DIGITS digits.
+ *
+ * @param out Receives the digits; it is not null-terminated.
+ * @param address The address to write.
+ * @return The number of characters written.
  */
-void createObFile(char *ob_filename, unsigned int memory_address[])
+static int formatAddress(char *out, unsigned int address)
 {
-    FILE *ob_file;
-    int i;
-    int base4[BASE_4_DIGITS];
-    strcat(ob_filename, DOT_OB_SUFFIX);
-    ob_file = fopen(ob_filename, "w");
-    if (ob_file == NULL)
+    char digits[MAX_ADDRESS_DIGITS];
+    int count = 0, i;
+
+    do
     {
-        fprintf(stderr, "Failed to open file.\n");
-        return;
+        digits[count++] = (char)('0' + address % 10);
+        address /= 10;
+    } while (address > 0);
+    while (count < ADDRESS_DIGITS)
+    {
+        digits[count++] = '0';
     }
+    for (i = 0; i < count; i++)
+    {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/**
+ * @brief Formats the content of an '.ob' file: the IC and DC counts, then each memory word.
+ *
+ * Each word is rendered straight into the buffer: its 14 bits are 7 base-4 digits, the top 3 coming
+ * from the encoding of its high byte and the bottom 4 from its low byte.
+ *
+ * @param result The output of the assembly.
+ * @param text The buffer the content is appended to.
+ */
+void formatObFile(const AsmResult *result, TextBuffer *text)
+{
+    int i;
+    int count = result->instructionCount + result->dataCount;
+    unsigned int word;
+    char line[MAX_LINE_LENGTH];
+    char *out;
 
     /* Write IC and DC counts to the first line */
-    fprintf(ob_file, " %4d %-4d \n", IC, DC);
+    sprintf(line, " %4d %-4d \n", result->instructionCount, result->dataCount);
+    appendString(text, line);
 
-    /* Write memory addresses and contents to the file */
-    for (i = 0; i < IC + DC; i++)
+    /* Each line is the address, two spaces, the encoded word and a newline */
+    if (!reserveText(text, text->length + (size_t)count * (MAX_ADDRESS_DIGITS + 2 + BASE_4_DIGITS + 1)))
     {
-
-        decimalToBase4(memory_address[i], base4);
-        fprintf(ob_file, "%04d  ", i + 100);
-        fprintf(ob_file, "%4s\n", base4ToEncoded(base4));
+        return;
     }
-
-    cutOffExtension(ob_filename);
-    fclose(ob_file);
+    out = text->data + text->length;
+    for (i = 0; i < count; i++)
+    {
+        word = result->image[i];
+        out += formatAddress(out, (unsigned int)(i + result->baseAddress));
+        out[0] = ' ';
+        out[1] = ' ';
+        memcpy(out + 2, encodedBytes[word >> 8 & 0x3F] + 1, 3); /* The high byte holds the top 6 bits */
+        memcpy(out + 5, encodedBytes[word & 0xFF], 4);
+        out[9] = '\n';
+        out += 2 + BASE_4_DIGITS + 1;
+    }
+    text->length = out - text->data;
+    text->data[text->length] = '\0';
 }
 
 /**
- * @brief Get the entry symbols and their addresses and build an '.ent' file from them.
+ * @brief Formats the content of an '.ent' file: each entry symbol and its address.
  *
- * @param ent_filename The name of the '.ent' file.
+ * @param result The output of the assembly.
+ * @param text The buffer the content is appended to.
  */
-void createEntryFile(char *ent_filename)
+void formatEntryFile(const AsmResult *result, TextBuffer *text)
 {
-    FILE *ent_file = NULL; /* Declare file pointer */
     int i;
+    char line[MAX_LINE_LENGTH + MAX_LABEL_LENGTH];
 
-    /* Check each bucket in the symbol table */
-    for (i = 0; i < MAX_SYMBOLS; i++)
+    for (i = 0; i < result->entryCount; i++)
     {
-        Symbol *current = symbolTable[i];
-        while (current != NULL)
-        {
-            /* If the symbol type is 'entry', we process it */
-            if (current->symbolType == entry)
-            {
-                if (ent_file == NULL)
-                { /* File is opened only if an entry symbol is found */
-                    strcat(ent_filename, DOT_ENT_SUFFIX);
-                    ent_file = fopen(ent_filename, "w");
-                    if (ent_file == NULL)
-                    {
-                        fprintf(stderr, "Failed to open file.\n");
-                        return;
-                    }
-                }
-                fprintf(ent_file, "%s  %04u\n", current->symbolName, current->value);
-            }
-            current = current->next; /* Move to next symbol in the list */
-        }
+        sprintf(line, "%.31s  %04u\n", result->entries[i].name, (unsigned int)result->entries[i].address);
+        appendString(text, line);
     }
+}
+
+/**
+ * @brief Formats the content of an '.ext' file: each use of an external symbol and its address.
+ *
+ * @param result The output of the assembly.
+ * @param text The buffer the content is appended to.
+ */
+void formatExtFile(const AsmResult *result, TextBuffer *text)
+{
+    int i;
+    char line[MAX_LINE_LENGTH + MAX_LABEL_LENGTH];
 
-    if (ent_file != NULL)
+    for (i = 0; i < result->externCount; i++)
     {
-        fclose(ent_file); /* Only close the file if it was opened */
+        sprintf(line, "%-4.31s  %04d\n", result->externs[i].name, result->externs[i].address);
+        appendString(text, line);
     }
-    cutOffExtension(ent_filename);
 }
+
 /**
- * @brief Get the external symbols and their addresses and build an '.ext' file from them.
+ * @brief Writes formatted content to a file named after the source file.
  *
- * @param ext_filename The name of the '.ext' file.
-
-*/
-void createExtFile(char *ext_filename)
+ * The content goes to a temporary file in a single write, which is then renamed over the output file,
+ * so a reader sees either the old file or the complete new one. The temporary file is created
+ * exclusively with the default permissions, trying another name if it exists already. A name of
+ * MAX_FILENAME_LEN characters or more, suffix included, is reported instead of being cut short.
+ *
+ * @param text The content to write.
+ * @param filename The name of the file without its extension.
+ * @param suffix The extension of the file.
+ * @return The number of bytes written, or -1 if the file could not be written.
+ */
+long writeOutputFile(const TextBuffer *text, char *filename, const char *suffix)
 {
-    FILE *ext_file = NULL; /* Declare file pointer */
-    int i, j;
+    char tempName[MAX_FILENAME_LEN + 64]; /* The name of the file, then a process id, a counter and ".tmp" */
+    int fd = -1, attempt, ok;
 
-    /* Concatenate the filename with the extension only once */
-    strcat(ext_filename, DOT_EXT_SUFFIX);
-
-    /* Check each bucket in the symbol table */
-    for (i = 0; i < MAX_SYMBOLS; i++)
+    strcat(filename, suffix);
+    if (strlen(filename) >= MAX_FILENAME_LEN)
+    {
+        fprintf(stderr, "File name too long: %s\n", filename);
+        cutOffExtension(filename);
+        return -1;
+    }
+    for (attempt = 0; fd < 0 && attempt < MAX_TEMP_ATTEMPTS; attempt++)
     {
-        Symbol *current = symbolTable[i];
-        while (current != NULL)
+        sprintf(tempName, "%s.%ld-%d.tmp", filename, (long)getpid(), attempt);
+        fd = open(tempName, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd < 0 && errno != EEXIST)
         {
-            /* If the symbol type is 'external', we process it */
-            if (current->symbolType == external)
-            {
-                if (ext_file == NULL)
-                { /* File is opened only if an external symbol is found */
-                    ext_file = fopen(ext_filename, "w");
-                    if (ext_file == NULL)
-                    {
-                        fprintf(stderr, "Failed to open file.\n");
-                        return;
-                    }
-                }
-                for (j = 0; j < externalUsageCount; j++)
-                {
-                    if (strcmp(externalUsages[j].symbolName, current->symbolName) == 0)
-                    {
-                        fprintf(ext_file, "%-4s  %04d\n", externalUsages[j].symbolName, externalUsages[j].address + 100);
-                    }
-                }
-            }
-            current = current->next; /* Move to next symbol in the list */
+            break;
         }
     }
-    if (ext_file != NULL)
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to open file %s\n", filename);
+        cutOffExtension(filename);
+        return -1;
+    }
+    ok = text->length == 0 || write(fd, text->data, text->length) == (ssize_t)text->length;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tempName, filename) != 0)
     {
-        fclose(ext_file); /* Only close the file if it was opened */
+        unlink(tempName);
+        ok = 0;
     }
-    cutOffExtension(ext_filename);
+    cutOffExtension(filename);
+    return ok ? (long)text->length : -1;
 }
 
 /**
- * @brief Transform an decimal array to base4 array.
- *
- * @param decimal The decimal array.
+  @brief Get Memory address and build an '.ob' file from them.
+
+  @param result The output of the assembly.
+  @param ob_filename The name of the '.ob' file.
+  @return The number of bytes written, or -1 if the file could not be written.
  */
-void decimalToBase4(int decimal, int base4[])
+long createObFile(const AsmResult *result, char *ob_filename)
 {
-    int i;
-    int index = BASE_4_DIGITS - 1; /* Start from the last element to match MSB on left */
+    TextBuffer text;
+    long written;
+    initTextBuffer(&text);
+    formatObFile(result, &text);
+    written = writeOutputFile(&text, ob_filename, DOT_OB_SUFFIX);
+    freeTextBuffer(&text);
+    return written;
+}
 
-    /* Initialize base4 array to zero */
-    for (i = 0; i < BASE_4_DIGITS; i++)
+/**
+ * @brief Build a binary '.bin' object file from the output of an assembly.
+ *
+ * The file holds the same image, entries and externs as the text files, in the layout described in
+ * object_file.h, so a loader can map it and use it without parsing.
+ *
+ * @param result The output of the assembly.
+ * @param bin_filename The name of the '.bin' file.
+ * @return The number of bytes written, or -1 if the file could not be written.
+ */
+long createBinaryObjectFile(const AsmResult *result, char *bin_filename)
+{
+    TextBuffer text;
+    long written = -1;
+    initTextBuffer(&text);
+    if (formatObjectFile(result, &text))
     {
-        base4[i] = 0;
+        written = writeOutputFile(&text, bin_filename, DOT_BIN_SUFFIX);
     }
+    freeTextBuffer(&text);
+    return written;
+}
 
-    /* Convert decimal to base 4 */
-    while (decimal > 0 && index >= 0)
+/**
+ * @brief Get the entry symbols and their addresses and build an '.ent' file from them.
+ *
+ * The file is created only if there are entry symbols.
+ *
+ * @param result The output of the assembly.
+ * @param ent_filename The name of the '.ent' file.
+ * @return The number of bytes written, or -1 if the file could not be written.
+ */
+long createEntryFile(const AsmResult *result, char *ent_filename)
+{
+    TextBuffer text;
+    long written;
+    if (result->entryCount == 0)
     {
-        base4[index--] = decimal % 4;
-        decimal /= 4;
+        return 0;
     }
+    initTextBuffer(&text);
+    formatEntryFile(result, &text);
+    written = writeOutputFile(&text, ent_filename, DOT_ENT_SUFFIX);
+    freeTextBuffer(&text);
+    return written;
 }
 /**
- * @brief Transform an base4 array to encoded strings array.
+ * @brief Get the external symbols and their addresses and build an '.ext' file from them.
  *
- * @param base4 The base4 array.
- */
-char *base4ToEncoded(const int base4[])
+ * The file is created only if external symbols are used.
+ *
+ * @param result The output of the assembly.
+ * @param ext_filename The name of the '.ext' file.
+ * @return The number of bytes written, or -1 if the file could not be written.
+*/
+long createExtFile(const AsmResult *result, char *ext_filename)
 {
-    int i;
-    static char encoded[BASE_4_DIGITS + 1]; /* Static allocation to avoid memory management */
-
-    /* Convert base 4 digits to encoded characters */
-    for (i = 0; i < BASE_4_DIGITS; i++)
+    TextBuffer text;
+    long written;
+    if (result->externCount == 0)
     {
-        switch (base4[i])
-        {
-        case 0:
-            encoded[i] = '*';
-            break;
-        case 1:
-            encoded[i] = '#';
-            break;
-        case 2:
-            encoded[i] = '%';
-            break;
-        case 3:
-            encoded[i] = '!';
-            break;
-        }
+        return 0;
     }
+    initTextBuffer(&text);
+    formatExtFile(result, &text);
+    written = writeOutputFile(&text, ext_filename, DOT_EXT_SUFFIX);
+    freeTextBuffer(&text);
+    return written;
+}
 
-    encoded[BASE_4_DIGITS] = '\0'; /* Null-terminate the string */
-    return encoded;
-}
\ No newline at end of file
+/**
+ * @brief Write a prelude snapshot to a '.pre' file next to its prelude.
+ *
+ * The snapshot replaces the old one in a single rename, so a run mapping it sees either one whole.
+ *
+ * @param snapshot The snapshot, as built by buildPrelude.
+ * @param pre_filename The name of the prelude; the '.pre' suffix is added to it.
+ * @return The number of bytes written, or -1 if the file could not be written.
+ */
+long createPreludeFile(const TextBuffer *snapshot, char *pre_filename)
+{
+    return writeOutputFile(snapshot, pre_filename, DOT_PRE_SUFFIX);
+}
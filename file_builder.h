@@ -2,11 +2,16 @@
 #define FILE_BUILDER_H
 
 #include "data.h"
+#include "libassembler.h"
+#include "text_buffer.h"
 
 #define DOT_ENT_SUFFIX ".ent"
 #define DOT_EXT_SUFFIX ".ext"
 #define DOT_OB_SUFFIX ".ob"
+#define DOT_BIN_SUFFIX ".bin"
+#define DOT_PRE_SUFFIX ".pre"
 #define MAX_FILE_NAME_LENGTH 200
+#define MAX_TEMP_ATTEMPTS 100 /* Temporary names tried before giving up on an output file */
 #define MACRO_DEF_STR_LENGTH 4
 #define MAX_LINE_LENGTH 81
 #define FOUR_CHARS_INDENTATION 4
@@ -14,41 +19,87 @@
 #define BINARY_DIGITS 14
 #define BASE_4_DIGITS 7
 
+/**
+ * @brief Formats the content of an '.ob' file: the IC and DC counts, then each memory word.
+ *
+ * @param result The output of the assembly.
+ * @param text The buffer the content is appended to.
+ */
+void formatObFile(const AsmResult *result, TextBuffer *text);
+
+/**
+ * @brief Formats the content of an '.ent' file: each entry symbol and its address.
+ *
+ * @param result The output of the assembly.
+ * @param text The buffer the content is appended to.
+ */
+void formatEntryFile(const AsmResult *result, TextBuffer *text);
+
+/**
+ * @brief Formats the content of an '.ext' file: each use of an external symbol and its address.
+ *
+ * @param result The output of the assembly.
+ * @param text The buffer the content is appended to.
+ */
+void formatExtFile(const AsmResult *result, TextBuffer *text);
+
+/**
+ * @brief Writes formatted content to a file named after the source file.
+ *
+ * The content goes to a temporary file, which is then renamed over the output file, so a reader sees
+ * either the old file or the complete new one.
+ *
+ * @param text The content to write.
+ * @param filename The name of the file without its extension, in a buffer of MAX_FILENAME_LEN + 8
+ *                 characters; the extension is appended and removed again.
+ * @param suffix The extension of the file.
+ * @return The number of bytes written, or -1 if the file could not be written.
+ */
+long writeOutputFile(const TextBuffer *text, char *filename, const char *suffix);
+
 /**
   @brief Get Memory address and build an '.ob' file from them.
 
+  @param result The output of the assembly.
   @param ob_filename The name of the '.ob' file.
-  @param memory_address Address of first memory word.
+  @return The number of bytes written, or -1 if the file could not be written.
  */
-void createObFile(char *, unsigned int memory_address[]);
+long createObFile(const AsmResult *result, char *ob_filename);
+
+/**
+ * @brief Build a binary '.bin' object file from the output of an assembly.
+ *
+ * @param result The output of the assembly.
+ * @param bin_filename The name of the '.bin' file.
+ * @return The number of bytes written, or -1 if the file could not be written.
+ */
+long createBinaryObjectFile(const AsmResult *result, char *bin_filename);
 
 /**
  * @brief Get the entry symbols and their addresses and build an '.ent' file from them.
  *
+ * @param result The output of the assembly.
  * @param ent_filename The name of the '.ent' file.
+ * @return The number of bytes written, or -1 if the file could not be written.
  */
-void createEntryFile(char *ent_filename);
+long createEntryFile(const AsmResult *result, char *ent_filename);
 
 /**
  * @brief Get the external symbols and their addresses and build an '.ext' file from them.
  *
+ * @param result The output of the assembly.
  * @param ext_filename The name of the '.ext' file.
-
+ * @return The number of bytes written, or -1 if the file could not be written.
 */
-void createExtFile(char *ext_filename);
-
-/**
- * @brief Transform an decimal array to base4 array.
- *
- * @param decimal The decimal array.
- */
-void decimalToBase4(int decimal, int base4[]);
+long createExtFile(const AsmResult *result, char *ext_filename);
 
 /**
- * @brief Transform an base4 array to encoded strings array.
+ * @brief Write a prelude snapshot to a '.pre' file next to its prelude.
  *
- * @param base4 The base4 array.
+ * @param snapshot The snapshot, as built by buildPrelude.
+ * @param pre_filename The name of the prelude; the '.pre' suffix is added to it.
+ * @return The number of bytes written, or -1 if the file could not be written.
  */
-char *base4ToEncoded(const int base4[]);
+long createPreludeFile(const TextBuffer *snapshot, char *pre_filename);
 
 #endif /* FILE_BUILDER_H */
\ No newline at end of file
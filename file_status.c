@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "file_status.h"
+
+/**
+ * @brief Reads the status of a file.
+ *
+ * @param path The path of the file.
+ * @param status Receives the status; every field is zero if the path names no file.
+ */
+void readFileStatus(const char *path, FileStatus *status)
+{
+    struct stat info;
+
+    memset(status, 0, sizeof(FileStatus));
+    if (stat(path, &info) == 0)
+    {
+        status->exists = 1;
+        status->device = info.st_dev;
+        status->inode = info.st_ino;
+        status->size = info.st_size;
+        status->modified = info.st_mtim.tv_sec;
+        status->modifiedNanos = info.st_mtim.tv_nsec;
+    }
+}
+
+/**
+ * @brief Checks whether two statuses name the same file.
+ *
+ * @param first The first status.
+ * @param second The second status.
+ * @return Nonzero if both name an existing file, the same one.
+ */
+int isSameFile(const FileStatus *first, const FileStatus *second)
+{
+    return first->exists && second->exists && first->device == second->device && first->inode == second->inode;
+}
+
+/**
+ * @brief Checks whether two statuses describe the same version of the same file.
+ *
+ * @param first The first status.
+ * @param second The second status.
+ * @return Nonzero if nothing changed from one to the other.
+ */
+int isSameVersion(const FileStatus *first, const FileStatus *second)
+{
+    return first->exists == second->exists && first->device == second->device && first->inode == second->inode &&
+           first->size == second->size && first->modified == second->modified &&
+           first->modifiedNanos == second->modifiedNanos;
+}
@@ -0,0 +1,44 @@
+#ifndef FILE_STATUS_H
+#define FILE_STATUS_H
+
+#include <sys/types.h>
+
+/* What identifies a version of a file on disk: the file itself, by device and inode, and its size and
+ * modification time, to the nanosecond where the file system records it */
+typedef struct FileStatus
+{
+    int exists;         /* Nonzero if the path named a file */
+    dev_t device;       /* Device holding the file */
+    ino_t inode;        /* Inode of the file, which identifies it whatever path names it */
+    off_t size;         /* Size of the file */
+    time_t modified;    /* Modification time of the file, in seconds */
+    long modifiedNanos; /* Nanoseconds of the modification time */
+} FileStatus;
+
+/**
+ * @brief Reads the status of a file.
+ *
+ * @param path The path of the file.
+ * @param status Receives the status; every field is zero if the path names no file.
+ */
+void readFileStatus(const char *path, FileStatus *status);
+
+/**
+ * @brief Checks whether two statuses name the same file.
+ *
+ * @param first The first status.
+ * @param second The second status.
+ * @return Nonzero if both name an existing file, the same one.
+ */
+int isSameFile(const FileStatus *first, const FileStatus *second);
+
+/**
+ * @brief Checks whether two statuses describe the same version of the same file.
+ *
+ * @param first The first status.
+ * @param second The second status.
+ * @return Nonzero if nothing changed from one to the other.
+ */
+int isSameVersion(const FileStatus *first, const FileStatus *second);
+
+#endif /* FILE_STATUS_H */
@@ -6,6 +6,7 @@
 #include "utils.h"
 #include "first_pass.h"
 #include "data.h"
+#include "prelude.h"
 
 /**
  * Performs the first pass of the assembler over the source file.
@@ -13,42 +14,61 @@
  * set the initial code (IC) and data counters (DC). It handles different types of lines such as labels,
  * directives, and instructions, and performs error checking on line lengths and definitions.
  *
- * @param fp Pointer to the source file being read.
+ * @param ctx The assembler context.
+ * @param source The macro-expanded source text being read.
  */
 
-void firstPass(FILE *fp)
+void firstPass(AssemblerContext *ctx, TextBuffer *source)
 {
-    char line[MAX_LINE_LENGTH];
-    IC = 0; /* Instruction Counter initialized */
-    DC = 0; /* Data Counter initialized */
+    ctx->IC = 0; /* Instruction Counter initialized */
+    ctx->DC = 0; /* Data Counter initialized */
 
     /* Initialize necessary data structures for assembling process */
-    initData();
-    initSymbolTable();
-    initMemoryLines();
+    initSymbolTable(ctx);
+    initMemoryImage(ctx);
+    applyPreludeConstants(ctx);
+
+    firstPassLines(ctx, source);
+    ctx->lineErrorFlag = 0;    /* Reset line-specific error flag */
+    updateSymbolValues(ctx); /* Update symbol values based on accumulated data and instruction counts */
+}
+
+/**
+ * Reads lines of the source into the context, from its current counters and line number on.
+ *
+ * @param ctx The assembler context.
+ * @param source The lines to read.
+ */
+void firstPassLines(AssemblerContext *ctx, TextBuffer *source)
+{
+    char line[MAX_LINE_LENGTH];
+    const char *text;  /* The current line, inside the source */
+    size_t length;     /* Number of characters of the line, newline included */
+    LineTokens tokens; /* The tokens of the current line */
 
     /* Process each line of the source file */
-    while (fgets(line, MAX_LINE_LENGTH, fp) != NULL)
+    while ((text = bufferNextLine(source, source->length, &length)) != NULL)
     {
-        lineErrorFlag = 0; /* Reset line-specific error flag for the new line */
-        lineNum++;
+        ctx->lineErrorFlag = 0; /* Reset line-specific error flag for the new line */
+        ctx->lineNum++;
 
-        /* Check if line exceeds the limit */
-        if (strlen(line) == MAX_LINE_LENGTH - 1 && line[MAX_LINE_LENGTH - 2] != '\n')
+        /* Check if line exceeds the limit: its content, without the newline, must leave room for one */
+        if (length - (text[length - 1] == '\n') > MAX_LINE_LENGTH - 2)
         {
-            int ch;
-            handleError("Line length exceeds the limit", lineNum, line);
-            while ((ch = fgetc(fp)) != '\n' && ch != EOF)
-                ;
-
+            memcpy(line, text, MAX_LINE_LENGTH - 1);
+            line[MAX_LINE_LENGTH - 1] = '\0';
+            handleError(ctx, "Line length exceeds the limit", ctx->lineNum, line);
             continue;
         }
+        memcpy(line, text, length); /* The parsers split the line in place */
+        line[length] = '\0';
 
         /* Trimming line to remove possible trailing whitespaces */
         trimLine(line);
+        tokenizeLine(line, &tokens);
 
         /* Determine the type of the line and process accordingly */
-        switch (getLineType(line))
+        switch (classifyLine(ctx, &tokens, 0))
         {
         case LINE_BLANK:
         case LINE_COMMENT:
@@ -57,75 +77,71 @@ void firstPass(FILE *fp)
 
         case LINE_DEFINITION:
             /* Line detected with .define - Process constant definitions */
-            processDefinition(line);
+            processDefinition(ctx, line);
+            break;
+
+        case LINE_CONDITIONAL:
+            /* The macro parser evaluates the conditional lines that start a line, so this one came from a macro body */
+            handleError(ctx, "Conditional directive must start a line of the source", ctx->lineNum, line);
             break;
 
         case LINE_LABEL:
         {
-            char symbolName[MAX_LINE_LENGTH];     /* Buffer to store the extracted symbol name */
-            char *symbolPos;                      /* Pointer to locate the symbol in the line */
-            sscanf(line, "%[^:]", symbolName);    /* Extract the symbol name from the label, stopping at the colon */
-            symbolPos = strstr(line, symbolName); /* Find the position of the symbol name in the line */
-            symbolFlag = 1;                       /* Flag to indicate that a symbol is being processed */
-            if (symbolPos)
+            char symbolName[MAX_LINE_LENGTH]; /* Buffer to store the extracted symbol name */
+            char *remainingLine;              /* The line after the label */
+            LineType remainingType;           /* Type of the line after the label */
+            copyToken(&tokens.tokens[0], symbolName);
+            ctx->symbolFlag = 1; /* Flag to indicate that a symbol is being processed */
+            /* The rest of the line starts at its second token */
+            remainingLine = tokens.count > 1 ? (char *)tokens.tokens[1].start : line + strlen(line);
+            remainingType = classifyLine(ctx, &tokens, 1);
+
+            if (remainingType == LINE_BLANK)
             {
-                char *remainingLine = symbolPos + strlen(symbolName) + 1; /* Move past the symbol name in the line */
-
-                trimLine(remainingLine); /* Trim the remaining line to remove leading/trailing whitespace */
-
-                if (getLineType(remainingLine) == LINE_BLANK)
-                {
-                    handleError("Missing instruction/action after label", lineNum, line); /* Error for labels without instructions */
-                }
-                else if (getLineType(remainingLine) == LINE_DIRECTIVE)
-                {
-                    if (getDirectiveType(remainingLine) == DATA_DIRECTIVE || getDirectiveType(remainingLine) == STRING_DIRECTIVE)
-                    {
-                        if (lookupSymbol(symbolName) == NULL) /* Check if symbol is not yet defined */
-                        {
-                            addSymbol(symbolName, data, DC); /* Add symbol as a data type if not defined */
-                        }
-                        else
-                        {
-
-                            handleError("Symbol already exists", lineNum, line); /* Error if symbol is already defined */
-                        }
-                    }
-                    if (lineErrorFlag == 0) /* Process directive if no previous errors */
-                    {
-                        processDirective(remainingLine);
-                    }
-                }
-                else if (symbolFlag == 1)
+                handleError(ctx, "Missing instruction/action after label", ctx->lineNum, line); /* Error for labels without instructions */
+            }
+            else if (remainingType == LINE_CONDITIONAL)
+            {
+                handleError(ctx, "A label cannot precede a conditional directive", ctx->lineNum, line);
+            }
+            else if (remainingType == LINE_DIRECTIVE)
+            {
+                if (tokens.tokens[1].value == DATA_DIRECTIVE || tokens.tokens[1].value == STRING_DIRECTIVE)
                 {
-
-                    if (lookupSymbol(symbolName) == NULL)
+                    if (lookupSymbol(ctx, symbolName) == NULL) /* Check if symbol is not yet defined */
                     {
-                        addSymbol(symbolName, code, IC + 100); /* Add symbol as code type with an offset */
+                        addSymbol(ctx, symbolName, data, ctx->DC); /* Add symbol as a data type if not defined */
                     }
                     else
                     {
 
-                        handleError("Symbol already defined", lineNum, line);
+                        handleError(ctx, "Symbol already exists", ctx->lineNum, line); /* Error if symbol is already defined */
                     }
-                    if (lineErrorFlag == 0 && getLineType(remainingLine) == LINE_INSTRUCTION) /* Process instruction if no errors */
-                    {
-
-                        if (isValidInstruction(remainingLine))
-                        {
+                }
+                if (ctx->lineErrorFlag == 0) /* Process directive if no previous errors */
+                {
+                    processDirective(ctx, remainingLine, (DirectiveType)tokens.tokens[1].value);
+                }
+            }
+            else
+            {
 
-                            processInstruction(remainingLine);
-                        }
-                    }
-                    else if (getLineType(remainingLine) != LINE_INSTRUCTION)
-                    {
-                        handleError("Invalid instruction", lineNum, line);
-                    }
+                if (lookupSymbol(ctx, symbolName) == NULL)
+                {
+                    addSymbol(ctx, symbolName, code, ctx->IC + 100); /* Add symbol as code type with an offset */
                 }
                 else
                 {
 
-                    handleError("Invalid line", lineNum, line);
+                    handleError(ctx, "Symbol already defined", ctx->lineNum, line);
+                }
+                if (ctx->lineErrorFlag == 0 && remainingType == LINE_INSTRUCTION) /* Process instruction if no errors */
+                {
+                    processInstruction(ctx, remainingLine, &tokens, 1);
+                }
+                else if (remainingType != LINE_INSTRUCTION)
+                {
+                    handleError(ctx, "Invalid instruction", ctx->lineNum, line);
                 }
             }
             break;
@@ -133,86 +149,156 @@ void firstPass(FILE *fp)
 
         case LINE_DIRECTIVE:
             /* Handle directives such as .data, .string, etc., */
-            processDirective(line);
+            processDirective(ctx, line, (DirectiveType)tokens.tokens[0].value);
+            if (tokens.tokens[0].value == ENTRY_DIRECTIVE)
+            {
+                queueEntries(ctx, &tokens); /* Resolved once every symbol is defined */
+            }
             break;
 
         case LINE_INSTRUCTION:
             /* Handle instructions that need to be translated into machine code */
-            processInstruction(line);
+            processInstruction(ctx, line, &tokens, 0);
             break;
 
         case INVALID_LINE:
-            handleError("Invalid line", lineNum, line);
+            handleError(ctx, "Invalid line", ctx->lineNum, line);
             break;
         default:
             break;
         }
-        symbolFlag = 0; /* Reset symbol flag for next line processing */
+        ctx->symbolFlag = 0; /* Reset symbol flag for next line processing */
     }
-    lineErrorFlag = 0;    /* Reset line-specific error flag */
-    updateSymbolValues(); /* Update symbol values based on accumulated data and instruction counts */
 }
 
 /* ############################### start HELPERS code ############################### */
 
 /**
- * Extracts and returns the first word from a given line of text.
- * This function skips any leading whitespace and captures the first sequence of non-whitespace characters.
+ * Checks that the memory image has room for one more word, and reports an overflow if it does not.
  *
- * @param line A constant character pointer to the line from which the first word is to be extracted.
- * @return A pointer to a static buffer containing the first word of the line.
+ * @param ctx The assembler context.
+ * @param text The text to report the error with.
+ * @return 1 if the word fits, 0 if the image is full.
  */
-char *getFirstWord(const char *line)
+static int hasRoomForWord(AssemblerContext *ctx, char *text)
 {
-    static char firstWord[MAX_LINE_LENGTH]; /* Static buffer to hold the first word */
-    int i = 0;                              /* Index for placing characters into firstWord */
+    if (ctx->IC + ctx->DC < MAX_DATA)
+    {
+        return 1;
+    }
+    handleError(ctx, "Memory image overflow", ctx->lineNum, text);
+    return 0;
+}
 
-    /* Skip leading whitespace */
-    while (isspace((unsigned char)*line))
+/**
+ * Stores a word of data after the data stored so far.
+ * A chunk of a split first pass also logs the word with the instruction counter it was stored at.
+ *
+ * @param ctx The assembler context.
+ * @param value The word to store.
+ * @param line The line of the directive, for the error message.
+ * @return 1 on success, 0 if the image is full.
+ */
+static int storeDataWord(AssemblerContext *ctx, Word value, char *line)
+{
+    if (!hasRoomForWord(ctx, line))
     {
-        line++;
+        return 0;
     }
-    /* Capture the first word until a space or string end is encountered */
-    while (*line && !isspace((unsigned char)*line) && i < MAX_LINE_LENGTH - 1)
+    ctx->image[ctx->DC + ctx->IC] = value;
+    if (ctx->dataLog != NULL && ctx->DC < ctx->dataLogCapacity)
     {
-        firstWord[i++] = *line++;
+        ctx->dataLog[ctx->DC].value = value;
+        ctx->dataLog[ctx->DC].IC = ctx->IC;
     }
+    else if (ctx->dataLog != NULL)
+    {
+        ctx->chunkConflict = 1; /* The word could not be placed in the merged image */
+    }
+    ctx->DC++;
+    return 1;
+}
 
-    firstWord[i] = '\0'; /* Null-terminate the extracted word */
-    return firstWord;    /* Return the static buffer containing the first word */
+/**
+ * Looks up a symbol named by an operand.
+ * A chunk of a split first pass does not see the labels of the chunks before it, so it remembers the names
+ * it does not find, and notes when it uses the value of a label, which depends on where the chunk lands.
+ *
+ * @param ctx The assembler context.
+ * @param name The name of the symbol.
+ * @param usesValue Nonzero if the operand is encoded with the value of the symbol.
+ * @return The symbol, or NULL if it is not defined.
+ */
+static Symbol *lookupOperandSymbol(AssemblerContext *ctx, const char *name, int usesValue)
+{
+    Symbol *symbol = lookupSymbol(ctx, name);
+    MissedName *missed;
+
+    if (!ctx->chunked)
+    {
+        return symbol;
+    }
+    if (symbol == NULL)
+    {
+        missed = (MissedName *)arenaAlloc(&ctx->arena, sizeof(MissedName));
+        if (missed == NULL || (missed->name = arenaCopy(&ctx->arena, name, strlen(name))) == NULL)
+        {
+            ctx->chunkConflict = 1; /* The name cannot be checked against the other chunks */
+            return NULL;
+        }
+        missed->next = ctx->missedNames;
+        ctx->missedNames = missed;
+    }
+    else if (usesValue && (symbol->symbolType == code || symbol->symbolType == data))
+    {
+        ctx->chunkConflict = 1;
+    }
+    return symbol;
 }
 
 /**
- * Determines the type of a line.
+ * Determines the type of a line from its tokens.
+ * Only the tokens from the given one on are considered, so the text after a label can be classified
+ * without scanning it again.
  *
- * @param line The line to analyze.
+ * @param ctx The assembler context.
+ * @param tokens The tokens of the line.
+ * @param first Index of the first token to consider.
  * @return The type of the line.
  */
-LineType getLineType(char *line)
+LineType classifyLine(AssemblerContext *ctx, const LineTokens *tokens, int first)
 {
+    const Token *token;
+    char *line; /* The text being classified, for error messages */
 
     /* Check if the line is blank */
-    if (line[0] == '\n' || line[0] == '\0' || isspace((unsigned char)line[0]))
+    if (first >= tokens->count)
     {
         return LINE_BLANK;
     }
+    token = &tokens->tokens[first];
+    line = (char *)token->start;
     /* Check if the line is a comment */
     if (line[0] == ';')
     {
         return LINE_COMMENT;
     }
     /* Check if the line is a directive */
-    if (line[0] == '.')
+    if (token->kind == TOKEN_DIRECTIVE)
     {
-        DirectiveType directiveType = getDirectiveType(line);
-        if (directiveType == INVALID_DIRECTIVE)
+        if (token->value == INVALID_DIRECTIVE)
         {
+            handleError(ctx, "Invalid directive", ctx->lineNum, line);
             return INVALID_LINE;
         }
-        if (directiveType == DEFINE_DIRECTIVE)
+        if (token->value == DEFINE_DIRECTIVE)
         {
             return LINE_DEFINITION;
         }
+        if (token->value >= IF_DIRECTIVE && token->value <= ENDIF_DIRECTIVE)
+        {
+            return LINE_CONDITIONAL;
+        }
         else
         {
             return LINE_DIRECTIVE;
@@ -220,14 +306,19 @@ LineType getLineType(char *line)
     }
 
     /* Check if the line contains a symbol */
-    if (isLabel(line))
+    if (isLabel(ctx, tokens, first))
     {
         return LINE_LABEL;
     }
 
-    /* Check if the line represents an instruction */
-    if (isInstruction(line))
+    /* Check if the line represents an instruction; a mismatch in case is reported */
+    if (token->kind == TOKEN_MNEMONIC)
     {
+        if (strncmp(token->start, commandTable[token->value].cmdName, token->length) != 0)
+        {
+            handleError(ctx, "Instruction case mismatch\n", ctx->lineNum, line);
+            return INVALID_LINE;
+        }
         return LINE_INSTRUCTION;
     }
     /* If none of the above conditions are met, the line is invalid */
@@ -235,56 +326,50 @@ LineType getLineType(char *line)
 }
 
 /**
- * Checks if the provided line of assembly code begins with a valid label.
+ * Checks if the given token starts the line with a valid label.
  * A label starts with an alphabet character, followed by alphanumeric characters, up to 31 characters long,
  * and ends with a ':' without any preceding spaces.
  *
- * @param line A character pointer to the line to be checked for a label.
+ * @param ctx The assembler context.
+ * @param tokens The tokens of the line.
+ * @param first Index of the token to check.
  * @return Returns 1 if a valid label is present and it is not a reserved word, otherwise returns 0.
  */
-int isLabel(char *line)
+int isLabel(AssemblerContext *ctx, const LineTokens *tokens, int first)
 {
-    char label[33]; /* Array to hold potential label */
-    int i = 0;
-    int errLabel = 0;
-    char *colonPos = strchr(line, ':');  /* Pointer to the colon character in the line */
-    errLabel = colonPos == NULL ? 0 : 1; /* Check if the colon character is present in the line */
+    const Token *token = &tokens->tokens[first];
+    char *line = (char *)token->start; /* The text being checked, for error messages */
+    char label[MAX_LINE_LENGTH];       /* Array to hold the label */
+    int errLabel = tokens->colonCount > first; /* Check if a colon follows in the line; each label before this one took one */
 
     /* Ensure the first character is alphabetic */
     if (!isalpha((unsigned char)line[0]))
     {
         if (errLabel == 1)
         {
-            handleError("Invalid label: Label must start with an alphabetic character", lineNum, line);
+            handleError(ctx, "Invalid label: Label must start with an alphabetic character", ctx->lineNum, line);
         }
         return 0;
     }
 
-    /* Collect label characters */
-    while (isalnum((unsigned char)line[i]) && i < 31)
-    { /* Check for alphanumeric and limit length to 31 */
-        label[i] = line[i];
-        i++;
-    }
-
-    /* Check for the ':' immediately after the alphanumeric characters */
-    if (line[i] != ':' || (i > 0 && line[i - 1] == ' '))
+    /* Check for the ':' immediately after at most 31 alphanumeric characters */
+    if (token->kind != TOKEN_LABEL || token->length > MAX_LABEL_LENGTH)
     {
         if (errLabel == 1)
         {
-            handleError("Invalid label: Label must end with a colon", lineNum, line);
+            handleError(ctx, "Invalid label: Label must end with a colon", ctx->lineNum, line);
         }
         return 0;
     }
 
-    label[i] = '\0'; /* Null-terminate the label string */
+    copyToken(token, label);
 
     /* Check if the label is a reserved word */
     if (isReservedWord(label))
     {
         if (errLabel == 1)
         {
-            handleError("Invalid label: Label cannot be a reserved word", lineNum, line);
+            handleError(ctx, "Invalid label: Label cannot be a reserved word", ctx->lineNum, line);
         }
         return 0;
     }
@@ -301,26 +386,26 @@ int isLabel(char *line)
  * This function parses a definition line that specifies a constant,
  * and if valid, adds it to the symbol table with its associated value.
  *
+ * @param ctx The assembler context.
  * @param line A character pointer to the definition line to process.
  */
 
-void processDefinition(char *line)
+void processDefinition(AssemblerContext *ctx, char *line)
 {
-    if (isValidConstantDefinition(line))
+    if (isValidConstantDefinition(ctx, line))
     {
-        /* Allocate memory for constant name with size based on MAX_LINE_LENGTH */
-        char *constantName = (char *)malloc(MAX_LINE_LENGTH * sizeof(char));
+        char constantName[MAX_LINE_LENGTH]; /* The symbol table keeps its own copy of the name */
         int value;
 
         /* Parse the line to extract constant name and its integer value */
         sscanf(line, ".define %[^=]=%d", constantName, &value);
         trimLine(constantName);                  /* Remove any leading or trailing spaces from constant name */
-        addSymbol(constantName, mdefine, value); /* Add the constant name and value to the symbol table */
+        addSymbol(ctx, constantName, mdefine, value); /* Add the constant name and value to the symbol table */
     }
     else
     {
         /* Handle the error if the definition line is invalid */
-        handleError("Invalid constant definition", lineNum, line);
+        handleError(ctx, "Invalid constant definition", ctx->lineNum, line);
     }
 }
 
@@ -329,13 +414,14 @@ void processDefinition(char *line)
  * This function checks the syntax and uniqueness of a constant definition within the assembly source.
  * It also validates that the defined value is within the permissible range for constants.
  *
+ * @param ctx The assembler context.
  * @param line A character pointer to the string containing the potential constant definition.
  * @return An integer 1 if the constant definition is valid, otherwise 0.
  */
-int isValidConstantDefinition(char *line)
+int isValidConstantDefinition(AssemblerContext *ctx, char *line)
 {
     char lineCopy[MAX_LINE_LENGTH]; /* Buffer to hold a copy of the line */
-    char *constantPart, *valuePart;
+    char *constantPart, *valuePart, *savePtr;
     int value;
     char *start;
 
@@ -351,7 +437,7 @@ int isValidConstantDefinition(char *line)
     else
     {
 
-        handleError("Error: Line does not start with '.define '", lineNum, line);
+        handleError(ctx, "Error: Line does not start with '.define '", ctx->lineNum, line);
 
         return 0;
     }
@@ -360,13 +446,13 @@ int isValidConstantDefinition(char *line)
     trimLine(start);
 
     /* Attempt to split at the first occurrence of '=' */
-    constantPart = strtok(start, "=");
-    valuePart = strtok(NULL, "");
+    constantPart = strTokR(start, "=", &savePtr);
+    valuePart = strTokR(NULL, "", &savePtr);
 
     if (constantPart == NULL || valuePart == NULL)
     {
 
-        handleError("Invalid constant definition: Missing '=' or incomplete definition", lineNum, line);
+        handleError(ctx, "Invalid constant definition: Missing '=' or incomplete definition", ctx->lineNum, line);
 
         return 0;
     }
@@ -378,19 +464,19 @@ int isValidConstantDefinition(char *line)
     /* Ensure value part is numeric and convert it */
     if (!isNumeric(valuePart))
     {
-        if (lineErrorFlag == 0)
+        if (ctx->lineErrorFlag == 0)
         {
-            handleError("Invalid constant definition: Number format error", lineNum, line);
+            handleError(ctx, "Invalid constant definition: Number format error", ctx->lineNum, line);
         }
         return 0;
     }
     value = atoi(valuePart);
 
     /* Check constant name for validity */
-    if (isReservedWord(constantPart) || lookupSymbol(constantPart) != NULL)
+    if (isReservedWord(constantPart) || lookupSymbol(ctx, constantPart) != NULL)
     {
 
-        handleError("Invalid constant definition: Reserved word used or symbol already defined", lineNum, line);
+        handleError(ctx, "Invalid constant definition: Reserved word used or symbol already defined", ctx->lineNum, line);
 
         return 0;
     }
@@ -399,7 +485,7 @@ int isValidConstantDefinition(char *line)
     if (value < MIN_12BIT_VALUE || value > MAX_12BIT_VALUE)
     {
 
-        handleError("Invalid constant definition: Value out of range", lineNum, line);
+        handleError(ctx, "Invalid constant definition: Value out of range", ctx->lineNum, line);
 
         return 0;
     }
@@ -411,42 +497,64 @@ int isValidConstantDefinition(char *line)
 /* ############################################################################################# */
 /* ############################### start LINE_DIRECTIVE code ############################### */
 
+/**
+ * Skips the directive name at the start of a line and the character following it.
+ * A line holding only the directive yields an empty string rather than a pointer past its end.
+ *
+ * @param line The directive line.
+ * @param offset Number of characters to skip.
+ * @return The arguments of the directive.
+ */
+static char *skipDirectiveName(char *line, size_t offset)
+{
+    size_t length = strlen(line);
+    return line + (length < offset ? length : offset);
+}
+
 /**
  * Processes a directive line from an assembly language input.
- * Based on the type of directive identified by `getDirectiveType`, it executes the relevant processing function or handles errors.
+ * Based on the type of directive found by the lexer, it executes the relevant processing function or handles errors.
  *
+ * @param ctx The assembler context.
  * @param line A character pointer to the directive line to be processed.
+ * @param type The type of the directive.
  */
-void processDirective(char *line)
+void processDirective(AssemblerContext *ctx, char *line, DirectiveType type)
 {
-    /* Switch on the type of directive determined by getDirectiveType function */
-    switch (getDirectiveType(line))
+    /* Switch on the type of directive */
+    switch (type)
     {
     case DATA_DIRECTIVE:
-        processDataDirective(line); /* Call to process data directive */
+        processDataDirective(ctx, line); /* Call to process data directive */
         /* ! Refactor */
         break;
     case STRING_DIRECTIVE:
-        processDataDirective(line); /* Call to process string directive */
+        processDataDirective(ctx, line); /* Call to process string directive */
         /* ! Refactor */
         break;
     case DEFINE_DIRECTIVE:
     case ENTRY_DIRECTIVE:
         /* Add symbol declared as an entry to the record list */
-        processEntryDirective(line);
+        processEntryDirective(ctx, line);
         break;
     case EXTERN_DIRECTIVE:
-        if (symbolFlag == 1) /* Check condition based on symbolFlag */
+        if (ctx->symbolFlag == 1) /* Check condition based on symbolFlag */
         {
             break;
         }
         else
         {
-            processExternDirective(line); /* Call to process extern directive */
+            processExternDirective(ctx, line); /* Call to process extern directive */
             break;
         }
+    case IF_DIRECTIVE:
+    case IFDEF_DIRECTIVE:
+    case ELSE_DIRECTIVE:
+    case ENDIF_DIRECTIVE:
+        /* Conditional lines are evaluated by the macro parser, and classified apart by the first pass */
+        break;
     case INVALID_DIRECTIVE:
-        handleError("Invalid directive", lineNum, line); /* Handle invalid directive */
+        handleError(ctx, "Invalid directive", ctx->lineNum, line); /* Handle invalid directive */
         break;
     }
 }
@@ -455,11 +563,13 @@ void processDirective(char *line)
  * Processes lines containing data or string directives in an assembly program.
  * This function parses the line to extract and handle numerical data or string literals based on the directive type.
  *
+ * @param ctx The assembler context.
  * @param line The line containing the data directive to process.
  */
-void processDataDirective(char *line)
+void processDataDirective(AssemblerContext *ctx, char *line)
 {
-    char *token; /* Token for parsing the data elements */
+    char *token;   /* Token for parsing the data elements */
+    char *savePtr; /* Position of the tokenizer within the line */
     /* Check if the line starts with '.data' directive */
 
     if (strncmp(line, ".data", 5) == 0)
@@ -469,46 +579,45 @@ void processDataDirective(char *line)
         int lastCharIndex;
         strcpy(buffer, line);
         /* Validate correct comma usage */
-        checkCommas = buffer + 6; /* Start checking after .data directive */
+        checkCommas = skipDirectiveName(buffer, 6); /* Start checking after .data directive */
         trimLine(checkCommas);    /* Trim whitespace around the line */
         lastCharIndex = strlen(checkCommas) - 1;
 
         if (checkCommas[0] == ',' || checkCommas[lastCharIndex] == ',' || strstr(checkCommas, ",,") != NULL)
         {
-            handleError("Improper use of commas in .data directive", lineNum, line);
+            handleError(ctx, "Improper use of commas in .data directive", ctx->lineNum, line);
             return; /* Exit if comma validation fails */
         }
-        token = strtok(checkCommas, ","); /* Start tokenizing the line after the directive */
+        token = strTokR(checkCommas, ",", &savePtr); /* Start tokenizing the line after the directive */
         if (token == NULL)
         {
-            handleError("Missing data in .data directive", lineNum, line);
+            handleError(ctx, "Missing data in .data directive", ctx->lineNum, line);
         }
         while (token != NULL)
         {
             Symbol *symbol;               /* Pointer to a symbol structure */
             trimLine(token);              /* Trim whitespace around the token */
-            symbol = lookupSymbol(token); /* Check if the token is a known symbol */
+            symbol = lookupSymbol(ctx, token); /* Check if the token is a known symbol */
             /* If the token is a defined symbol, store its value in memory */
             if (symbol && symbol->symbolType == mdefine)
             {
-                memory[DC + IC] = symbol->value;
-
-                memoryLines[DC + IC].value = computeFourteenBitValue(symbol->value);
-                DC++;
+                if (!storeDataWord(ctx, (Word)computeFourteenBitValue(symbol->value), line))
+                {
+                    return;
+                }
             }
             else if (isNumeric(token)) /* If the token is a numeric value, store it directly */
             {
-                memory[DC + IC] = atoi(token);
-
-                memoryLines[DC + IC].value = computeFourteenBitValue(atoi(token));
-
-                DC++;
+                if (!storeDataWord(ctx, (Word)computeFourteenBitValue(atoi(token)), line))
+                {
+                    return;
+                }
             }
             else /* Handle the error case where the token is neither a defined symbol nor a valid number */
             {
-                handleError("Undefined symbol or invalid number in .data directive", lineNum, line);
+                handleError(ctx, "Undefined symbol or invalid number in .data directive", ctx->lineNum, line);
             }
-            token = strtok(NULL, ","); /* Continue to the next token */
+            token = strTokR(NULL, ",", &savePtr); /* Continue to the next token */
         }
     }
     else if (strncmp(line, ".string", 7) == 0) /* Handle the '.string' directive */
@@ -547,89 +656,42 @@ void processDataDirective(char *line)
                 if (!isLegalCharacter(*c))
                 {
 
-                    handleError("Illegal character found in string", lineNum, line);
+                    handleError(ctx, "Illegal character found in string", ctx->lineNum, line);
                     return; /* Exit the function if illegal character is found */
                 }
 
-                memory[DC + IC] = (unsigned char)*c;
-
-                memoryLines[DC + IC].value = computeFourteenBitValue((unsigned char)*c);
-
-                DC++;
+                if (!storeDataWord(ctx, (Word)computeFourteenBitValue((unsigned char)*c), line))
+                {
+                    return;
+                }
             }
-            memory[DC + IC] = '\0';
-
-            memoryLines[DC + IC].value = computeFourteenBitValue('\0');
-            DC++;
+            storeDataWord(ctx, (Word)computeFourteenBitValue('\0'), line);
         }
         else /* Handle invalid string directive */
         {
-            handleError("Invalid string directive", lineNum, line);
+            handleError(ctx, "Invalid string directive", ctx->lineNum, line);
         }
     }
 }
 
-/**
- * Identifies the type of directive based on the first word of a given line from an assembly source.
- * This function determines the directive type such as data, string, entry, extern, or invalid.
- *
- * @param line A character pointer to the directive line to identify.
- * @return An enumeration value of type DirectiveType corresponding to the directive found.
- */
-DirectiveType getDirectiveType(char *line)
-{
-    char *directiveName; /* Pointer to store the first word from the line */
-
-    directiveName = getFirstWord(line); /* Retrieve the first word from the line */
-
-    /* Check for '.data' directive and return corresponding type */
-    if (strcmp(directiveName, ".data") == 0)
-    {
-        return DATA_DIRECTIVE;
-    }
-    /* Check for '.string' directive and return corresponding type */
-    if (strcmp(directiveName, ".string") == 0)
-    {
-        return STRING_DIRECTIVE;
-    }
-    /* Check for '.entry' directive and return corresponding type */
-    if (strcmp(directiveName, ".entry") == 0)
-    {
-        return ENTRY_DIRECTIVE;
-    }
-    /* Check for '.extern' directive and return corresponding type */
-    if (strcmp(directiveName, ".extern") == 0)
-    {
-        return EXTERN_DIRECTIVE;
-    }
-    if (strcmp(directiveName, ".define") == 0)
-    {
-        return DEFINE_DIRECTIVE;
-    }
-    /* If none of the known directives match, return invalid directive type */
-    else
-    {
-        handleError("Invalid directive", lineNum, line);
-        return INVALID_DIRECTIVE;
-    }
-}
-
 /**
  * Processes a line designated as an extern directive in assembly source code.
  * This function tokenizes the line to extract and handle each symbol declared as external.
  *
+ * @param ctx The assembler context.
  * @param line A character pointer to the extern directive line to be processed.
  */
 
-void processExternDirective(char *line)
+void processExternDirective(AssemblerContext *ctx, char *line)
 {
     char buffer[MAX_LINE_LENGTH];    /* Buffer to store the line */
-    char *token;                     /* Token for parsing symbols from the directive */
-    strcpy(buffer, line);            /* Copy the line to the buffer */
-    token = strtok(buffer + 7, ","); /* Begin tokenizing after the directive keyword */
+    char *token;                                /* Token for parsing symbols from the directive */
+    char *savePtr;                              /* Position of the tokenizer within the buffer */
+    strcpy(buffer, line);                       /* Copy the line to the buffer */
+    token = strTokR(skipDirectiveName(buffer, 7), ",", &savePtr); /* Begin tokenizing after the directive keyword */
     if (token == NULL)
     {
-        handleError("Missing symbol in .extern directive", lineNum, line);
+        handleError(ctx, "Missing symbol in .extern directive", ctx->lineNum, line);
     }
     /* Iterate through tokens representing symbols */
     while (token != NULL)
@@ -637,22 +699,22 @@ void processExternDirective(char *line)
         Symbol *symbol;  /* Pointer to a symbol structure */
         trimLine(token); /* Trim whitespace around the token */
         /* Check if the token is already marked as an entry label */
-        if (isEntryLabel(token))
+        if (isEntryLabel(ctx, token))
         {
             /* Handle the error and exit processing for this line */
-            handleError("Cannot declare entry label as external", lineNum, line);
+            handleError(ctx, "Cannot declare entry label as external", ctx->lineNum, line);
             return; /* Exit the function early */
         }
-        symbol = lookupSymbol(token); /* Check if the symbol is already in the table */
+        symbol = lookupSymbol(ctx, token); /* Check if the symbol is already in the table */
         if (symbol)
         {
-            updateSymbolType(token, external); /* Update the symbol type to external */
+            updateSymbolType(ctx, token, external); /* Update the symbol type to external */
         }
         else
         {
-            addSymbol(token, external, 0);
+            addSymbol(ctx, token, external, 0);
         }
-        token = strtok(NULL, ","); /* Continue to the next token */
+        token = strTokR(NULL, ",", &savePtr); /* Continue to the next token */
     }
 }
 
@@ -661,544 +723,421 @@ void processExternDirective(char *line)
  * It also ensures that duplicate entry declarations are handled appropriately by checking
  * against the existing list of entry labels.
  *
+ * @param ctx The assembler context.
  * @param line A character pointer to the entry directive line to be processed.
  */
-void processEntryDirective(char *line)
+void processEntryDirective(AssemblerContext *ctx, char *line)
 {
     char buffer[MAX_LINE_LENGTH]; /* Buffer to store the line */
-    char *token;
+    char *token, *savePtr;
     strcpy(buffer, line); /* Copy the line to the buffer */
     trimLine(buffer);     /* Trim whitespace around the line */
-    token = strtok(buffer + 7, ", \t");
+    token = strTokR(skipDirectiveName(buffer, 7), ", \t", &savePtr);
 
     /* Begin tokenizing after the directive keyword */
     if (token == NULL) /* Check if the token is missing */
     {
-        handleError("Missing symbol in .entry directive", lineNum, line);
+        handleError(ctx, "Missing symbol in .entry directive", ctx->lineNum, line);
     }
 
     /* Iterate through tokens representing symbols */
     while (token != NULL)
     {
         trimLine(token); /* Trim whitespace around the token */
-        if (!isEntryLabel(token))
+        if (!isEntryLabel(ctx, token))
         {
-            addEntryLabel(token); /* Add the symbol as an entry label */
+            addEntryLabel(ctx, token); /* Add the symbol as an entry label */
         }
         else
         {
-            handleError("Entry label already declared", lineNum, line);
+            handleError(ctx, "Entry label already declared", ctx->lineNum, line);
         }
-        token = strtok(NULL, ","); /* Continue to the next token */
+        token = strTokR(NULL, ",", &savePtr); /* Continue to the next token */
     }
 }
 
-/* ############################### end LINE_DIRECTIVE code ############################### */
-
-/* ############################### start LINE_INSTRUCTION code ############################### */
-
 /**
- * Checks if the first word of the line is a valid assembly instruction.
- * Issues a notice if an instruction matches case-insensitively but not case-sensitively.
+ * Queues the names of an entry directive line, so the second pass can mark them as entries
+ * without reading the source again. Names are separated by commas or whitespace.
  *
- * @param line A string containing the assembly line to check.
- * @return Returns 1 if a valid instruction is found, otherwise returns 0.
+ * @param ctx The assembler context.
+ * @param tokens The tokens of the line, starting with the directive.
  */
-int isInstruction(char *line)
+void queueEntries(AssemblerContext *ctx, const LineTokens *tokens)
 {
-    char *instructionName; /* Variable to store the first word of the line */
+    char symbolName[MAX_LINE_LENGTH]; /* Name of the current entry symbol */
     int i;
 
-    instructionName = getFirstWord(line); /* Retrieve the first word from the line */
-
-    /* Loop through the command table to check for a match */
-    for (i = 0; i < CMD_NUM; i++)
+    for (i = 1; i < tokens->count; i++)
     {
-        if (strCaseCmp(instructionName, commandTable[i].cmdName) == 0) /* Case-insensitive comparison */
+        if (tokens->tokens[i].kind != TOKEN_COMMA)
         {
-            if (strcmp(instructionName, commandTable[i].cmdName) != 0) /* Case-sensitive comparison */
-            {
-                handleError("Instruction case mismatch\n", lineNum, line); /* Handle case mismatch */
-                return 0;                                                  /* Return 0 if case mismatch is found */
-            }
-            return 1; /* Return 1 if a match is found indicating an instruction */
+            queueEntry(ctx, copyToken(&tokens->tokens[i], symbolName), ctx->lineNum);
         }
     }
-    return 0; /* Return 0 if no match is found */
 }
 
+/* ############################### end LINE_DIRECTIVE code ############################### */
+
+/* ############################### start LINE_INSTRUCTION code ############################### */
+
 /**
  * Processes a line that contains an assembly instruction.
  * This function parses the instruction, allocates memory for its components, and stores them appropriately.
  *
+ * @param ctx The assembler context.
  * @param line A character pointer to the instruction line to be processed.
+ * @param tokens The tokens of the line.
+ * @param first Index of the mnemonic token.
  */
-void processInstruction(char *line)
+void processInstruction(AssemblerContext *ctx, char *line, const LineTokens *tokens, int first)
 {
-    Instruction instruction;                /* Struct to store parsed instruction details */
-    Word *firstWord = malloc(sizeof(Word)); /* Allocate memory for the first word of the instruction */
-    if (!firstWord)
-    {
-        handleError("Memory allocation failed", lineNum, line); /* Handle memory allocation failure */
-        return;
-    }
-    L = 0; /* Initialize the line count for this instruction */
+    Instruction instruction; /* Struct to store parsed instruction details */
+    InstructionShape shape;  /* Layout of the instruction, from the shape table */
+    ctx->L = 0;              /* Initialize the line count for this instruction */
 
     memset(&instruction, 0, sizeof(instruction)); /* Zero out the instruction struct */
 
-    if ((parseInstruction(line, &instruction)) != NULL) /* Parse the instruction from the line */
+    if ((parseInstruction(ctx, line, tokens, first, &instruction)) != NULL) /* Parse the instruction from the line */
     {
-
-        setupFirstInstructionWord(firstWord, &instruction); /* Setup the first word based on the parsed instruction */
-
-        memoryLines[IC].word = malloc(sizeof(Word)); /* Allocate memory for storing the instruction in memory lines */
-        if (!memoryLines[IC].word)
+        if (!hasRoomForWord(ctx, line))
         {
-            handleError("Memory allocation failed", lineNum, line); /* Handle memory allocation failure */
             return;
         }
-        else
-        {
-            memoryLines[IC].word = firstWord;              /* Assign the first word to the current instruction counter in memory lines */
-            memoryLines[IC].type = INSTRUCTION_ADDRESSING; /* Set the memory line type to instruction addressing */
-            memoryLines[IC].value = firstWord->value;      /* Set the value of the memory line to the first word's value */
-        }
 
-        memory[IC] = firstWord->bits.opcode; /* Store the opcode in the main memory at the current instruction counter */
+        shape = setupFirstInstructionWord(ctx, &ctx->image[ctx->IC], &instruction); /* Write the first word straight into the image */
+        ctx->wordTypes[ctx->IC] = INSTRUCTION_ADDRESSING;
 
-        IC++; /* Increment the instruction counter */
+        ctx->IC++; /* Increment the instruction counter */
+        ctx->instructionLines++;
 
-        L = 1;                                     /* Set line count for the instruction */
-        L += decodeOperands(instruction.operands); /* Decode and add operand sizes to L */
+        ctx->L = shape.length;                     /* Set line count for the instruction */
+        decodeOperands(ctx, &instruction, shape); /* Encode the words following the first one */
     }
     else
     {
-        if (lineErrorFlag == 0)
+        if (ctx->lineErrorFlag == 0)
         {
-            handleError("Invalid instruction", lineNum, line); /* Handle invalid instruction format */
+            handleError(ctx, "Invalid instruction", ctx->lineNum, line); /* Handle invalid instruction format */
         }
     }
 }
 
-/**
- * Validates whether a line from the assembly source code represents a syntactically correct instruction.
- * This function extracts the instruction name and its operands from the line and checks if the instruction name exists in the command table.
- *
- * @param line A character pointer to the line to be checked.
- * @return An integer 1 if the instruction is valid, otherwise 0.
- */
-int isValidInstruction(char *line)
-{
-    char *instructionName = (char *)malloc(MAX_LINE_LENGTH * sizeof(char)); /* Allocate memory for instruction name */
-    char *operands = (char *)malloc(MAX_LINE_LENGTH * sizeof(char));        /* Allocate memory for storing operands */
-    int i;
-
-    /* Parse the line to extract the instruction name and its operands */
-    sscanf(line, "%s %[^\n]", instructionName, operands);
-
-    /* Loop through the command table to check if the instruction name is valid */
-    for (i = 0; i < CMD_NUM; i++)
-    {
-        if (strcmp(instructionName, commandTable[i].cmdName) == 0)
-        {
-            free(instructionName); /* Free allocated memory for instruction name */
-            free(operands);        /* Free allocated memory for operands */
-            return 1;              /* Return 1 if a valid instruction name is found */
-        }
-    }
-    free(instructionName); /* Free allocated memory if no valid instruction is found */
-    free(operands);        /* Free allocated memory if no valid instruction is found */
-    return 0;              /* Return 0 if no valid instruction name is found */
-}
-
 /**
  * Initializes the first word of an instruction based on its opcode and addressing modes.
- * This function sets up the opcode, ARE (Absolute, Relocatable, External), and addressing modes for source and destination operands.
+ * The legality of the modes and the length of the instruction are looked up in the command and shape
+ * tables, indexed by the opcode and the modes of the source and destination operands.
  *
- * @param firstWord Pointer to the Word struct representing the first word of the instruction.
+ * @param ctx The assembler context.
+ * @param firstWord The word of the image receiving the first word of the instruction.
  * @param instruction Pointer to the Instruction struct containing the instruction information.
+ * @return The shape of the instruction; its length is 0 if the addressing modes are invalid.
  */
-void setupFirstInstructionWord(Word *firstWord, Instruction *instruction)
+InstructionShape setupFirstInstructionWord(AssemblerContext *ctx, Word *firstWord, const Instruction *instruction)
 {
-    int srcAddressing = 0;                        /* Variable to store the source addressing method */
-    int destAddressing = 0;                       /* Variable to store the destination addressing method */
-    memset(firstWord, 0, sizeof(Word));           /* Initialize the firstWord struct to zero */
-    firstWord->bits.opcode = instruction->opcode; /* Set the opcode in the first word */
-    firstWord->bits.ARE = 0;                      /* Set the ARE bits to 0 (Absolute by default) */
-
-    /* Check if the instruction has operands and determine the addressing method for destination */
-    if (instruction->operands[0] && commandTable[instruction->opcode].numOfOps >= 1)
+    int numOfOps = commandTable[instruction->opcode].numOfOps;
+    Addressing srcMode = numOfOps == 2 ? instruction->modes[0] : NO_OPERAND;           /* The source is the first of two operands */
+    Addressing destMode = numOfOps >= 1 ? instruction->modes[numOfOps - 1] : NO_OPERAND; /* The destination is the last operand */
+    InstructionShape shape;
+    StringView both;               /* Both operands as written, from the first to the end of the second */
+    char operand[MAX_LINE_LENGTH]; /* The operand, for the error message */
+
+    if (srcMode == INVALID || destMode == INVALID)
     {
-        destAddressing = getAddressingMethod(instruction->operands[0]);
+        /* The operand was already reported; only the opcode is encoded */
+        shape = encodeFirstWord(firstWord, instruction->opcode, NO_OPERAND, NO_OPERAND);
+        shape.length = 0;
+        return shape;
     }
-
-    /* Set the addressing modes based on the number of operands the command expects */
-    switch (commandTable[instruction->opcode].numOfOps)
+    shape = encodeFirstWord(firstWord, instruction->opcode, srcMode, destMode);
+    if (shape.length == 0)
     {
-    case 0:
-        firstWord->bits.srcOp = 0; /* No source operand */
-        firstWord->bits.desOp = 0; /* No destination operand */
-        break;
-    case 1:
-        if (isValidAddressingMode(destAddressing, commandTable[instruction->opcode].destLegalAddrs))
+        if (numOfOps == 1)
         {
-            firstWord->bits.desOp = destAddressing; /* Set destination operand addressing mode */
+            handleError(ctx, "Invalid addressing mode for destination", ctx->lineNum, copyView(instruction->operands[0], operand)); /* Handle invalid destination addressing mode */
         }
         else
         {
-            handleError("Invalid addressing mode for destination", lineNum, instruction->operands[0]); /* Handle invalid destination addressing mode */
-        }
-        firstWord->bits.srcOp = 0; /* No source operand */
-        break;
-    case 2:
-        srcAddressing = getAddressingMethod(instruction->operands[0]);  /* Determine source addressing method */
-        destAddressing = getAddressingMethod(instruction->operands[1]); /* Determine destination addressing method */
-        if (isValidAddressingMode(srcAddressing, commandTable[instruction->opcode].srcLegalAddrs) &&
-            isValidAddressingMode(destAddressing, commandTable[instruction->opcode].destLegalAddrs))
-        {
-            firstWord->bits.srcOp = srcAddressing;  /* Set source operand addressing mode */
-            firstWord->bits.desOp = destAddressing; /* Set destination operand addressing mode */
-        }
-        else
-        {
-            handleError("Invalid addressing modes for operands", lineNum, "line"); /* Handle invalid operand addressing modes */
-        }
-        break;
-    }
-}
-
-/**
- * Determines if a given addressing mode is valid based on an array of allowed modes.
- * This function checks if the specified mode is among the allowed addressing modes.
- *
- * @param mode The addressing mode to validate.
- * @param allowedModes An array of integers representing the allowed addressing modes.
- * @return An integer 1 if the addressing mode is valid, otherwise 0.
- */
-int isValidAddressingMode(int mode, int allowedModes[])
-{
-    int i;
-    /* Loop through the array of allowed addressing modes */
-    for (i = 0; i < 4; i++)
-    {
-        if (mode == allowedModes[i])
-        {
-            return 1; /* Return 1 if the mode matches an allowed mode */
+            both.start = instruction->operands[0].start;
+            both.length = (size_t)(instruction->operands[1].start + instruction->operands[1].length - both.start);
+            handleError(ctx, "Invalid addressing modes for operands", ctx->lineNum, copyView(both, operand)); /* Handle invalid operand addressing modes */
         }
     }
-    return 0; /* Return 0 if no match is found, indicating the mode is not valid */
+    return shape;
 }
 
 /**
  * Parses an instruction line into its component parts and populates an Instruction struct with the parsed data.
- * The function extracts the instruction name, opcode, and operands from the line and verifies the instruction's validity.
+ * The opcode comes from the mnemonic token, and each operand is a view of the tokens between two commas,
+ * so nothing is allocated.
  *
- * @param line The instruction line to parse.
+ * @param ctx The assembler context.
+ * @param line The instruction line, for error messages.
+ * @param tokens The tokens of the line.
+ * @param first Index of the mnemonic token.
  * @param instruction Pointer to the Instruction struct to store the parsed information.
  * @return Pointer to the Instruction struct if parsing is successful, otherwise NULL.
  */
-Instruction *parseInstruction(char *line, Instruction *instruction)
+Instruction *parseInstruction(AssemblerContext *ctx, char *line, const LineTokens *tokens, int first, Instruction *instruction)
 {
-    char *buffer = strdup(line); /* Duplicate the line for manipulation */
-    if (!buffer)
-    {
-        return NULL; /* Return NULL if memory allocation fails */
-    }
-    if (isValidInstruction(buffer))
+    const Token *token = &tokens->tokens[first + 1];  /* Current operand token */
+    const Token *end = &tokens->tokens[tokens->count]; /* Past the last token of the line */
+    const Token *operandStart;                         /* First token of the current operand */
+    int expectedOperands;
+    int operandCount = 0; /* Counter for operands */
+    int hasComma = 0;     /* Nonzero if the operands contain a comma */
+
+    instruction->opcode = tokens->tokens[first].value;                  /* Set the opcode found by the lexer */
+    instruction->name = commandTable[instruction->opcode].cmdName;  /* Store the instruction name */
+    expectedOperands = commandTable[instruction->opcode].numOfOps; /* Get the number of expected operands */
+
+    if (token < end)
     {
-
-        int expectedOperands;
-        int operandCount = 0;
-        char *operands;
-        int len;
-        char *token = strtok(buffer, " \t"); /* Tokenize the line to extract the instruction name */
-                                             /* Counter for operands */
-        if (!token)
+        /* Check for leading, trailing commas or double commas */
+        if (token->kind == TOKEN_COMMA || end[-1].kind == TOKEN_COMMA)
         {
-            free(buffer);
-            return NULL; /* Return NULL if the first token (instruction name) is missing */
-        }
-
-        instruction->name = strdup(token); /* Store the instruction name */
-        if (!instruction->name)
-        {
-            free(buffer);
-            return NULL; /* Return NULL if memory allocation fails for the instruction name */
+            handleError(ctx, "Improper use of commas in operands", ctx->lineNum, line);
+            return NULL;
         }
-
-        instruction->opcode = getOpcode(token); /* Set the opcode based on the instruction name */
-
-        expectedOperands = commandTable[instruction->opcode].numOfOps; /* Get the number of expected operands */
-        operands = strtok(NULL, "");
-
-        if (operands)
+        for (operandStart = token; operandStart < end; operandStart++)
         {
-
-            trimLine(operands); /* Trim whitespace around the operands */
-            len = strlen(operands);
-            /* Check for leading, trailing commas or double commas */
-            if (*operands == ',' || operands[len - 1] == ',' || strstr(operands, ",,") != NULL)
-            {
-                handleError("Improper use of commas in operands", lineNum, line);
-                free(buffer);
-                return NULL;
-            }
-            /* Extra check for missing comma if exactly two operands are expected */
-            if (expectedOperands == 2 && (strchr(operands, ',') == NULL))
-            {
-                handleError("Missing comma between operands", lineNum, line);
-                free(buffer);
-                return NULL;
-            }
-
-            token = strtok(operands, ","); /* Tokenize the operands */
-            while (token)
+            if (operandStart->kind == TOKEN_COMMA)
             {
-                trimLine(token); /* Trim whitespace around the token */
-                if (*token == '\0')
+                if (operandStart[1].kind == TOKEN_COMMA && operandStart[1].start == operandStart->start + 1)
                 {
-                    handleError("Invalid operand", lineNum, line);
+                    handleError(ctx, "Improper use of commas in operands", ctx->lineNum, line);
                     return NULL;
                 }
-
-                instruction->operands[operandCount] = strdup(token); /* Store the operand */
-
-                if (!instruction->operands[operandCount])
-                {
-                    handleError("Memory allocation failed", lineNum, line);
-                    return NULL; /* Return NULL if memory allocation fails for an operand */
-                }
-                operandCount++;
-
-                token = strtok(NULL, ","); /* Continue to the next operand */
+                hasComma = 1;
             }
         }
-        if (operandCount != expectedOperands)
+        /* Extra check for missing comma if exactly two operands are expected */
+        if (expectedOperands == 2 && !hasComma)
+        {
+            handleError(ctx, "Missing comma between operands", ctx->lineNum, line);
+            return NULL;
+        }
+    }
+
+    /* Each operand is the run of tokens up to the next comma */
+    while (token < end)
+    {
+        operandStart = token;
+        while (token < end && token->kind != TOKEN_COMMA)
+        {
+            token++;
+        }
+        if (token == operandStart)
         {
-            handleError("Invalid number of operands", lineNum, line);
+            handleError(ctx, "Invalid operand", ctx->lineNum, line);
             return NULL;
         }
+        if (operandCount == MAX_OPERANDS)
+        {
+            operandCount++; /* Too many operands, reported below */
+            break;
+        }
+
+        instruction->operands[operandCount].start = operandStart->start; /* Store the operand */
+        instruction->operands[operandCount].length = tokenSpan(operandStart, token - 1);
+        operandCount++;
 
-        free(buffer);
-        return instruction; /* Return the filled instruction struct */
+        if (token < end)
+        {
+            token++; /* Skip the comma */
+        }
     }
-    else
+    if (operandCount != expectedOperands)
+    {
+        handleError(ctx, "Invalid number of operands", ctx->lineNum, line);
+        return NULL;
+    }
+    /* Each operand is classified once, for both the first word and the operand words */
+    for (operandCount = 0; operandCount < expectedOperands; operandCount++)
     {
-        handleError("Invalid instruction format", lineNum, line);
-        return NULL; /* Return NULL if the instruction is not valid */
+        instruction->modes[operandCount] = getAddressingMethod(ctx, instruction->operands[operandCount]);
     }
+    return instruction; /* Return the filled instruction struct */
 }
 
 /**
  * Decodes the operands of an instruction line based on their addressing modes.
  * It handles different addressing modes such as immediate, direct, index, and register, and updates the instruction counter.
  *
- * @param operands The array of operand strings to decode.
- * @return The number of memory lines used by the decoded operands.
+ * @param ctx The assembler context.
+ * @param instruction The parsed instruction, with the addressing mode of each operand.
+ * @param shape The shape of the instruction, telling whether two registers share a word.
  */
-int decodeOperands(char *operands[])
+void decodeOperands(AssemblerContext *ctx, const Instruction *instruction, InstructionShape shape)
 {
-    Word word;                      /* Temporary storage for operand values */
+    const StringView *operands = instruction->operands;
+    Symbol *symbol;                 /* The symbol an operand names */
     int value;                      /* Numeric value of an operand */
-    int totalMemoryLines = 0;       /* Counter for memory lines consumed */
-    int isSrcReg = 0;               /* Flag to handle source register in dual operand instructions */
     int i;                          /* Loop counter */
+    char text[MAX_LINE_LENGTH];     /* The current operand, null-terminated */
     char *symbolName, *start, *end; /* Pointers for handling indexed addressing */
     char index[256];                /* Buffer for index in indexed addressing */
-    char *copy;                     /* Copy of operand for manipulation */
-    Addressing addrMethod;          /* Addressing method of current operand */
+    char copy[MAX_LINE_LENGTH];     /* Copy of operand for manipulation */
+    char *savePtr;                  /* Position of the tokenizer in the copy */
 
     for (i = 0; i < MAX_OPERANDS; i++)
     {
-        if (operands[i] == NULL)
+        if (operands[i].start == NULL)
         {
-            continue; /* Skip processing if the operand is NULL */
+            continue; /* Skip processing if the operand is absent */
         }
-        addrMethod = getAddressingMethod(operands[i]); /* Determine the addressing method */
-        switch (addrMethod)
+        copyView(operands[i], text);
+        switch (instruction->modes[i])
         {
         case IMMEDIATE:
+            if (!hasRoomForWord(ctx, text))
+            {
+                return;
+            }
             /* Immediate value may be a numeric or a symbol value */
-            if (lookupSymbol(operands[i] + 1) != NULL)
+            if ((symbol = lookupOperandSymbol(ctx, text + 1, 1)) != NULL)
             {
-                value = lookupSymbol(operands[i] + 1)->value;
+                value = symbol->value;
             }
             else
             {
-                value = atoi(operands[i] + 1);
+                value = atoi(text + 1);
             }
-            memset(&word, 0, sizeof(word)); /* Clear the word struct */
-
-            setImmediateValue(&word, value, 0); /* Set the immediate value */
-
-            memory[IC] = atoi(operands[i] + 1); /* Store value directly in memory */
-
-            memoryLines[IC].word->value = word.value;
-            memoryLines[IC].type = IMMEDIATE_ADDRESSING;
-            memoryLines[IC].value = value;
-            IC++; /* Increment instruction counter */
-
-            totalMemoryLines += 1; /* Increment total memory lines used */
+            setImmediateValue(&ctx->image[ctx->IC], value, 0); /* Set the immediate value */
+            ctx->wordTypes[ctx->IC] = IMMEDIATE_ADDRESSING;
+            ctx->IC++; /* Increment instruction counter */
             break;
         case DIRECT:
-            memory[IC] = -1; /* Placeholder for future linking */
-            memoryLines[IC].type = DIRECT_ADDRESSING;
-            memoryLines[IC].needEncoding = 1;
-            memoryLines[IC].symbol = strdup(operands[i]);
-            memoryLines[IC].value = -1;
-            recordExternalSymbolUsage(operands[i], IC);
-            IC++; /* Increment instruction counter */
-
-            totalMemoryLines += 1; /* Increment total memory lines used */
+            if (!hasRoomForWord(ctx, text))
+            {
+                return;
+            }
+            ctx->wordTypes[ctx->IC] = DIRECT_ADDRESSING;
+            addFixup(ctx, ctx->IC, text); /* Patched once the symbol is resolved */
+            ctx->IC++; /* Increment instruction counter */
             break;
         case INDEX:
+            if (!hasRoomForWord(ctx, text))
+            {
+                return;
+            }
             /* Handle indexed addressing */
-            copy = strdup(operands[i]);
-            symbolName = strtok(copy, "[");
-            start = strchr(operands[i], '[');
-            end = strchr(operands[i], ']');
+            strcpy(copy, text);
+            symbolName = strTokR(copy, "[", &savePtr);
+            start = strchr(text, '[');
+            end = strchr(text, ']');
 
-            if (lookupSymbol(symbolName) == NULL)
+            if (lookupOperandSymbol(ctx, symbolName, 0) == NULL)
             {
-                memory[IC] = -1; /* Placeholder for future linking */
-                memoryLines[IC].type = INDEX_ADDRESSING;
-                memoryLines[IC].needEncoding = 1;
-                memoryLines[IC].symbol = strdup(symbolName);
-                memoryLines[IC].value = -1;
-                IC++; /* Increment instruction counter */
+                ctx->wordTypes[ctx->IC] = INDEX_ADDRESSING;
+                addFixup(ctx, ctx->IC, symbolName); /* Patched once the symbol is resolved */
+                ctx->IC++; /* Increment instruction counter */
             }
             else
             {
-                memory[IC] = lookupSymbol(symbolName)->value;
-                memoryLines[IC].type = INDEX_ADDRESSING_VALUE;
-                memoryLines[IC].value = lookupSymbol(symbolName)->value;
-                IC++; /* Increment instruction counter */
+                /* Only symbols defined after their use are resolved; this word is left empty */
+                ctx->image[ctx->IC] = 0;
+                ctx->wordTypes[ctx->IC] = INDEX_ADDRESSING_VALUE;
+                ctx->IC++; /* Increment instruction counter */
             }
             /* Handle the numeric index within brackets */
             if (start && end && (end > start))
             {
                 int length = end - start - 1;
-                if (length < 255)
+                if (length < 255 && hasRoomForWord(ctx, text)) /* The index takes a word of its own */
                 {
                     strncpy(index, start + 1, length);
                     index[length] = '\0';
                     if (isNumeric(index))
                     {
                         value = atoi(index);
-                        memset(&word, 0, sizeof(word));
-                        setImmediateValue(&word, value, 0);
-
-                        memory[IC] = value;
-                        memoryLines[IC].word->value = word.value;
-                        memoryLines[IC].type = INDEX_ADDRESSING_VALUE;
-                        memoryLines[IC].value = value;
-                        IC++;
+                        setImmediateValue(&ctx->image[ctx->IC], value, 0);
+                        ctx->wordTypes[ctx->IC] = INDEX_ADDRESSING_VALUE;
+                        ctx->IC++;
                     }
-                    else if (lookupSymbol(index) != NULL)
+                    else if ((symbol = lookupOperandSymbol(ctx, index, 1)) != NULL)
                     {
-                        value = lookupSymbol(index)->value;
-                        memset(&word, 0, sizeof(word));
-                        setImmediateValue(&word, value, 0);
-
-                        memory[IC] = value;
-
-                        memoryLines[IC].word->value = word.value;
-                        memoryLines[IC].type = INDEX_ADDRESSING_VALUE;
-                        memoryLines[IC].value = value;
-                        IC++;
+                        value = symbol->value;
+                        setImmediateValue(&ctx->image[ctx->IC], value, 0);
+                        ctx->wordTypes[ctx->IC] = INDEX_ADDRESSING_VALUE;
+                        ctx->IC++;
                     }
                     else
                     {
-                        handleError("Invalid index value", lineNum, index);
+                        handleError(ctx, "Invalid index value", ctx->lineNum, index);
                     }
                 }
             }
-
-            totalMemoryLines += 2;
-            free(copy);
             break;
         case REGISTER:
-            memset(&word, 0, sizeof(word));
-            value = atoi(operands[i] + 1);
-            memoryLines[IC].word = malloc(sizeof(Word));
-
-            if (memoryLines[IC].word)
+            if (!(i > 0 && shape.registerPair) && !hasRoomForWord(ctx, text))
             {
-                if (isSrcReg == 0 && i == 0)
-                {
-                    setRegisterValue(memoryLines[IC].word, value, 0, 1, 0);
-                    isSrcReg = 1;
-                }
-                else if (isSrcReg == 1 && i == 1)
-                {
-                    setRegisterValue(memoryLines[IC - 1].word, atoi(operands[i - 1] + 1), value, 1, 1);
-                }
-                else
-                {
-
-                    setRegisterValue(memoryLines[IC].word, 0, value, 0, 1);
-                }
-
-                memoryLines[IC].type = REGISTER_ADDRESSING;
-                memoryLines[IC].value = memoryLines[IC].word->value;
-
-                if (isSrcReg == 1 && i == 1)
-                {
-                    ;
-                }
-                else
-                {
-                    IC++;
-                    totalMemoryLines += 1;
-                }
+                return;
+            }
+            value = atoi(text + 1);
+            if (i == 0)
+            {
+                setRegisterValue(&ctx->image[ctx->IC], value, 0, 1, 0);
+            }
+            else if (shape.registerPair)
+            {
+                /* Both operands are registers: they share the word of the source register */
+                setRegisterValue(&ctx->image[ctx->IC - 1], atoi(operands[i - 1].start + 1), value, 1, 1);
+                break;
             }
             else
             {
-                handleError("Memory allocation failed", lineNum, operands[i]);
+                setRegisterValue(&ctx->image[ctx->IC], 0, value, 0, 1);
             }
 
+            ctx->wordTypes[ctx->IC] = REGISTER_ADDRESSING;
+            ctx->IC++;
             break;
+        case NO_OPERAND:
         case INVALID:
             break;
         }
     }
-    return totalMemoryLines;
 }
 
 /**
  * Determines the addressing method used by an operand in assembly language instruction.
  * This function identifies whether the operand uses immediate, index, register, or direct addressing.
  *
- * @param operand The operand string to analyze.
+ * @param ctx The assembler context.
+ * @param operand The view of the operand to analyze.
  * @return The addressing method as an enumeration value of type Addressing.
  */
-Addressing getAddressingMethod(char *operand)
+Addressing getAddressingMethod(AssemblerContext *ctx, StringView operand)
 {
+    const char *text = operand.start;
+    char copy[MAX_LINE_LENGTH]; /* The operand, for error messages */
+
     /* Check for immediate addressing mode signified by a '#' */
-    if (operand[0] == '#')
+    if (text[0] == '#')
     {
-        if (isspace((unsigned char)operand[1]) || operand[1] == '\0')
+        if (operand.length == 1 || isspace((unsigned char)text[1]))
         {
-            handleError("Invalid immediate value", lineNum, operand);
+            handleError(ctx, "Invalid immediate value", ctx->lineNum, copyView(operand, copy));
             return INVALID;
         }
         return IMMEDIATE; /* Return immediate addressing type */
     }
     /* Check for index addressing mode signified by presence of '[' and ']' */
-    if (strchr(operand, '[') && strchr(operand, ']'))
+    if (memchr(text, '[', operand.length) && memchr(text, ']', operand.length))
     {
         return INDEX; /* Return index addressing type */
     }
     /* Check for register addressing mode signified by 'r' followed by a digit */
-    if (operand[0] == 'r')
+    if (text[0] == 'r')
     {
-        if (operand[1] >= '0' && operand[1] <= '7' && (operand[2] == '\0' || isspace((unsigned char)operand[2]) || operand[2] == ','))
+        if (operand.length >= 2 && text[1] >= '0' && text[1] <= '7' && (operand.length == 2 || isspace((unsigned char)text[2])))
         {
             return REGISTER; /* Return register addressing type */
         }
         else
         {
-            handleError("Invalid register value", lineNum, operand);
+            handleError(ctx, "Invalid register value", ctx->lineNum, copyView(operand, copy));
             return INVALID;
         }
     }
@@ -0,0 +1,662 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "include.h"
+#include "file_status.h"
+#include "utils.h"
+
+/* An .include directive, found on a line of a file */
+typedef struct IncludeDirective
+{
+    size_t start;                  /* Offset of the line of the directive in the text */
+    size_t end;                    /* Offset just past the line */
+    int line;                      /* Number of the line in its file */
+    int confined;                  /* Nonzero if the name is relative and has no '..' component */
+    char target[MAX_INCLUDE_PATH]; /* The file to include; empty if the directive is malformed */
+} IncludeDirective;
+
+/* A file read for an .include directive, shared by the sources that include it */
+typedef struct IncludedFile
+{
+    char path[MAX_INCLUDE_PATH];  /* The path the file was read from */
+    unsigned long hash;           /* Hash of the path */
+    int references;               /* Held by the cache while the file is its latest version, and by each expansion using it */
+    FileStatus status;            /* The file on disk when it was read */
+    int readable;                 /* Nonzero if the file could be read */
+    TextBuffer text;              /* The text of the file, without its comments */
+    IncludeDirective *directives; /* The directives of the text, in order */
+    int directiveCount;           /* Number of directives */
+} IncludedFile;
+
+/* The files read by the process, indexed by path with open addressing. A file that changed on disk
+ * takes the slot of the version read before it, so the cache holds one entry per path. */
+typedef struct IncludeCache
+{
+    IncludedFile **slots;   /* The files, or NULL for an empty slot */
+    unsigned long slotMask; /* Number of slots minus one; the number of slots is a power of two */
+    unsigned long count;    /* Number of files */
+} IncludeCache;
+
+/* A file already included by the source being expanded */
+typedef struct IncludedName
+{
+    FileStatus status;         /* The file on disk, which identifies it whatever path named it */
+    IncludedFile *file;        /* The file, released once the source is expanded; NULL for the source itself */
+    struct IncludedName *next; /* The file included before it */
+} IncludedName;
+
+/* The expansion of the directives of one source */
+typedef struct IncludeState
+{
+    AssemblerContext *ctx;  /* The context receiving the line map and the error messages */
+    TextBuffer *out;        /* The expanded source */
+    int lines;              /* Number of lines written to out */
+    int directives;         /* Number of directives met */
+    int confined;           /* Nonzero if every directive must name a confined path */
+    IncludedName *included; /* The files included so far */
+} IncludeState;
+
+static IncludeCache includeCache = {NULL, 0, 0}; /* Every file read by the process, in its latest version */
+static pthread_mutex_t includeLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Checks whether a text may hold an .include directive.
+ *
+ * @param text The text.
+ * @param length The number of characters in the text.
+ * @return Nonzero if the text mentions the directive anywhere.
+ */
+int mentionsInclude(const char *text, size_t length)
+{
+    const char *p, *end;
+
+    if (length < INCLUDE_DIRECTIVE_LENGTH)
+    {
+        return 0;
+    }
+    end = text + length - INCLUDE_DIRECTIVE_LENGTH + 1; /* Past the last place the directive can start */
+    for (p = text; (p = memchr(p, '.', (size_t)(end - p))) != NULL; p++)
+    {
+        if (memcmp(p, INCLUDE_DIRECTIVE, INCLUDE_DIRECTIVE_LENGTH) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks that a path stays inside the directory it is relative to.
+ *
+ * @param path The path. It does not need to be null-terminated.
+ * @param length The number of characters in the path.
+ * @return 1 if the path is not empty, does not start with '/' and has no '..' component, 0 otherwise.
+ */
+int isConfinedPath(const char *path, size_t length)
+{
+    size_t start = 0, end;
+
+    if (length == 0 || path[0] == '/')
+    {
+        return 0;
+    }
+    while (start <= length)
+    {
+        end = start;
+        while (end < length && path[end] != '/')
+        {
+            end++;
+        }
+        if (end - start == 2 && path[start] == '.' && path[start + 1] == '.')
+        {
+            return 0;
+        }
+        start = end + 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads a line as an .include directive.
+ *
+ * @param line The line.
+ * @param length The number of characters in the line, its newline included.
+ * @param fileName The file holding the line, or NULL for a source without a name.
+ * @param target Buffer of MAX_INCLUDE_PATH characters receiving the path of the file to include,
+ *               or an empty string if the directive is malformed or the path too long.
+ * @param confined Receives whether the name in the directive is a confined path, as isConfinedPath checks.
+ * @return 1 if the line is an .include directive, 0 otherwise.
+ */
+static int parseDirective(const char *line, size_t length, const char *fileName, char target[], int *confined)
+{
+    const char *slash;
+    size_t i = 0, nameStart, nameEnd, directoryLength = 0;
+
+    while (i < length && (line[i] == ' ' || line[i] == '\t'))
+    {
+        i++;
+    }
+    if (length - i < INCLUDE_DIRECTIVE_LENGTH || memcmp(line + i, INCLUDE_DIRECTIVE, INCLUDE_DIRECTIVE_LENGTH) != 0)
+    {
+        return 0;
+    }
+    i += INCLUDE_DIRECTIVE_LENGTH;
+    if (i < length && !isspace((unsigned char)line[i]) && line[i] != '"')
+    {
+        return 0; /* A longer word, which the first pass reports */
+    }
+
+    target[0] = '\0';
+    while (i < length && (line[i] == ' ' || line[i] == '\t'))
+    {
+        i++;
+    }
+    if (i == length || line[i] != '"')
+    {
+        return 1;
+    }
+    nameStart = ++i;
+    while (i < length && line[i] != '"' && line[i] != '\n')
+    {
+        i++;
+    }
+    if (i == length || line[i] != '"' || i == nameStart)
+    {
+        return 1;
+    }
+    nameEnd = i++;
+    while (i < length && isspace((unsigned char)line[i]))
+    {
+        i++;
+    }
+    if (i < length)
+    {
+        return 1; /* Something follows the name */
+    }
+    *confined = isConfinedPath(line + nameStart, nameEnd - nameStart);
+
+    /* A relative name is relative to the directory of the file holding the directive */
+    if (line[nameStart] != '/' && fileName != NULL && (slash = strrchr(fileName, '/')) != NULL)
+    {
+        directoryLength = (size_t)(slash - fileName) + 1;
+    }
+    if (directoryLength + (nameEnd - nameStart) < MAX_INCLUDE_PATH)
+    {
+        memcpy(target, fileName, directoryLength);
+        memcpy(target + directoryLength, line + nameStart, nameEnd - nameStart);
+        target[directoryLength + (nameEnd - nameStart)] = '\0';
+    }
+    return 1;
+}
+
+/**
+ * @brief Finds the .include directives of a text.
+ *
+ * @param text The comment-stripped text.
+ * @param length The number of characters in the text.
+ * @param fileName The file holding the text, or NULL for a source without a name.
+ * @param directives Receives the directives, allocated with malloc, or NULL if there are none.
+ * @param count Receives the number of directives.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int scanIncludes(const char *text, size_t length, const char *fileName, IncludeDirective **directives, int *count)
+{
+    char target[MAX_INCLUDE_PATH];
+    IncludeDirective *grown;
+    const char *newline;
+    size_t start = 0, end;
+    int line = 1, capacity = 0, confined = 0;
+
+    *directives = NULL;
+    *count = 0;
+    while (start < length)
+    {
+        newline = memchr(text + start, '\n', length - start);
+        end = newline != NULL ? (size_t)(newline - text) + 1 : length;
+        if (parseDirective(text + start, end - start, fileName, target, &confined))
+        {
+            if (*count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 4;
+                if ((grown = realloc(*directives, sizeof(IncludeDirective) * capacity)) == NULL)
+                {
+                    free(*directives);
+                    *directives = NULL;
+                    *count = 0;
+                    return 0;
+                }
+                *directives = grown;
+            }
+            (*directives)[*count].start = start;
+            (*directives)[*count].end = end;
+            (*directives)[*count].line = line;
+            (*directives)[*count].confined = confined;
+            strcpy((*directives)[*count].target, target);
+            (*count)++;
+        }
+        start = end;
+        line++;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads and comment-strips a file, and finds its directives.
+ *
+ * @param file The file, with its path set. It is left unreadable if it cannot be read.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int readIncludedFile(IncludedFile *file)
+{
+    TextBuffer raw;
+    FILE *fp;
+    int ok = 1;
+
+    if ((fp = fopen(file->path, "r")) == NULL)
+    {
+        return 1;
+    }
+    initTextBuffer(&raw);
+    if (appendFile(&raw, fp))
+    {
+        stripComments(raw.data != NULL ? raw.data : "", raw.length, 0, &file->text);
+        ok = scanIncludes(file->text.data, file->text.length, file->path, &file->directives, &file->directiveCount);
+        file->readable = ok;
+    }
+    freeTextBuffer(&raw);
+    fclose(fp);
+    return ok;
+}
+
+/**
+ * @brief Releases the text of an included file and the file itself.
+ *
+ * @param file The file.
+ */
+static void freeIncludedFile(IncludedFile *file)
+{
+    freeTextBuffer(&file->text);
+    free(file->directives);
+    free(file);
+}
+
+/**
+ * @brief Drops a reference to an included file, releasing it with the last one.
+ *
+ * @param file The file.
+ */
+static void releaseIncludedFile(IncludedFile *file)
+{
+    int unused;
+
+    pthread_mutex_lock(&includeLock);
+    unused = --file->references == 0;
+    pthread_mutex_unlock(&includeLock);
+    if (unused)
+    {
+        freeIncludedFile(file);
+    }
+}
+
+/**
+ * @brief Finds the slot of a path in the cache. The lock must be held and the slots allocated.
+ *
+ * @param path The path.
+ * @param hash The hash of the path.
+ * @return The slot holding the file read from the path, or the empty slot where it would be inserted.
+ */
+static unsigned long findCacheSlot(const char *path, unsigned long hash)
+{
+    unsigned long slot;
+    const IncludedFile *file;
+
+    for (slot = hash & includeCache.slotMask; (file = includeCache.slots[slot]) != NULL;
+         slot = (slot + 1) & includeCache.slotMask)
+    {
+        if (file->hash == hash && strcmp(file->path, path) == 0)
+        {
+            break;
+        }
+    }
+    return slot;
+}
+
+/**
+ * @brief Makes room in the cache for one more path, doubling its slots when it would be more than
+ * half full. The lock must be held.
+ *
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int reserveCacheSlot(void)
+{
+    unsigned long slotCount = includeCache.slots != NULL ? includeCache.slotMask + 1 : 0;
+    unsigned long i, slot;
+    IncludedFile **slots;
+
+    if ((includeCache.count + 1) * 2 <= slotCount)
+    {
+        return 1;
+    }
+    slotCount = slotCount ? slotCount * 2 : INITIAL_TABLE_SLOTS;
+    if ((slots = calloc(slotCount, sizeof(IncludedFile *))) == NULL)
+    {
+        return 0;
+    }
+    for (i = 0; includeCache.slots != NULL && i <= includeCache.slotMask; i++)
+    {
+        if (includeCache.slots[i] != NULL)
+        {
+            for (slot = includeCache.slots[i]->hash & (slotCount - 1); slots[slot] != NULL; slot = (slot + 1) & (slotCount - 1))
+            {
+            }
+            slots[slot] = includeCache.slots[i];
+        }
+    }
+    free(includeCache.slots);
+    includeCache.slots = slots;
+    includeCache.slotMask = slotCount - 1;
+    return 1;
+}
+
+/**
+ * @brief Finds a file in the files read by the process, reading it if it is new or changed on disk.
+ *
+ * The file is read without holding the lock, so sources waiting for other files are not held up by
+ * the disk. A file changed on disk replaces the version read before it in the cache; sources still
+ * expanding the old version keep it until they release it. Two sources wanting a new file at once
+ * may both read it, and the version read first is kept.
+ *
+ * @param path The path of the file.
+ * @return The file, to release with releaseIncludedFile, or NULL if memory allocation failed.
+ */
+static IncludedFile *loadIncludedFile(const char *path)
+{
+    FileStatus status;
+    IncludedFile *file, *stale = NULL;
+    unsigned long hash = hashSymbolName(path), slot;
+
+    readFileStatus(path, &status);
+    pthread_mutex_lock(&includeLock);
+    if (includeCache.slots != NULL && (file = includeCache.slots[findCacheSlot(path, hash)]) != NULL &&
+        isSameVersion(&file->status, &status))
+    {
+        file->references++;
+        pthread_mutex_unlock(&includeLock);
+        return file;
+    }
+    pthread_mutex_unlock(&includeLock);
+
+    if ((file = calloc(1, sizeof(IncludedFile))) == NULL)
+    {
+        return NULL;
+    }
+    strcpy(file->path, path);
+    file->hash = hash;
+    file->status = status;
+    initTextBuffer(&file->text);
+    if (!readIncludedFile(file))
+    {
+        freeIncludedFile(file);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&includeLock);
+    if (!reserveCacheSlot())
+    {
+        file->references = 1; /* Not cached: the caller is the only user */
+        pthread_mutex_unlock(&includeLock);
+        return file;
+    }
+    slot = findCacheSlot(path, hash);
+    if (includeCache.slots[slot] != NULL && isSameVersion(&includeCache.slots[slot]->status, &status))
+    {
+        stale = file; /* Read by another source in the meantime */
+        file = includeCache.slots[slot];
+        file->references++;
+    }
+    else
+    {
+        if (includeCache.slots[slot] == NULL)
+        {
+            includeCache.count++;
+        }
+        else if (--includeCache.slots[slot]->references == 0)
+        {
+            stale = includeCache.slots[slot];
+        }
+        file->references = 2; /* The cache and the caller */
+        includeCache.slots[slot] = file;
+    }
+    pthread_mutex_unlock(&includeLock);
+    if (stale != NULL)
+    {
+        freeIncludedFile(stale);
+    }
+    return file;
+}
+
+/**
+ * @brief Counts the lines ended in a text.
+ *
+ * @param text The text.
+ * @param length The number of characters in the text.
+ * @return The number of newlines in the text.
+ */
+static int countLines(const char *text, size_t length)
+{
+    const char *p, *end = text + length;
+    int lines = 0;
+
+    for (p = text; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++)
+    {
+        lines++;
+    }
+    return lines;
+}
+
+static void expandText(IncludeState *state, const char *fileName, const char *text, size_t length,
+                       const IncludeDirective *directives, int count);
+
+/**
+ * @brief Replaces a directive by the file it names, unless the source included it already.
+ *
+ * @param state The expansion.
+ * @param fileName The file holding the directive, or NULL for the source itself.
+ * @param text The text holding the directive.
+ * @param directive The directive.
+ */
+static void includeFile(IncludeState *state, const char *fileName, const char *text, const IncludeDirective *directive)
+{
+    AssemblerContext *ctx = state->ctx;
+    char line[MAX_LINE_LENGTH];
+    IncludedFile *file = NULL;
+    const IncludedName *name;
+    IncludedName *included;
+    const char *error = NULL, *path;
+    size_t length;
+
+    state->directives++;
+    if (directive->target[0] == '\0')
+    {
+        error = "Invalid .include directive";
+    }
+    else if (state->confined && !directive->confined)
+    {
+        error = "Included file must be relative and without '..'";
+    }
+    else
+    {
+        if ((file = loadIncludedFile(directive->target)) == NULL)
+        {
+            reportMessage(ctx, "Memory allocation error\n");
+            ctx->errorFlag = 1;
+            return;
+        }
+        if (!file->readable)
+        {
+            error = "Couldn't open included file";
+        }
+        for (name = state->included; error == NULL && name != NULL; name = name->next)
+        {
+            if (isSameFile(&name->status, &file->status))
+            {
+                releaseIncludedFile(file);
+                return; /* Included once already, maybe through another path */
+            }
+        }
+    }
+    if (error != NULL)
+    {
+        if (file != NULL)
+        {
+            releaseIncludedFile(file);
+        }
+        length = directive->end - directive->start < MAX_LINE_LENGTH ? directive->end - directive->start : MAX_LINE_LENGTH - 1;
+        memcpy(line, text + directive->start, length);
+        line[length] = '\0';
+        trimLine(line);
+        ctx->lineErrorFlag = 0;
+        handleFileError(ctx, error, fileName, directive->line, line);
+        return;
+    }
+
+    /* The line map outlives the file, which a later version may replace, so it gets a copy of the path */
+    if ((included = (IncludedName *)arenaAlloc(&ctx->arena, sizeof(IncludedName))) == NULL ||
+        (path = arenaCopy(&ctx->arena, file->path, strlen(file->path))) == NULL)
+    {
+        releaseIncludedFile(file);
+        reportMessage(ctx, "Memory allocation error\n");
+        ctx->errorFlag = 1;
+        return;
+    }
+    included->status = file->status;
+    included->file = file;
+    included->next = state->included;
+    state->included = included;
+    expandText(state, path, file->text.data, file->text.length, file->directives, file->directiveCount);
+    if (state->out->length > 0 && state->out->data[state->out->length - 1] != '\n')
+    {
+        appendText(state->out, "\n", 1); /* The line after the directive starts a line of its own */
+        state->lines++;
+    }
+}
+
+/**
+ * @brief Copies a text to the expanded source, replacing its directives by the files they name.
+ *
+ * @param state The expansion.
+ * @param fileName The file holding the text, or NULL for the source itself.
+ * @param text The text.
+ * @param length The number of characters in the text.
+ * @param directives The directives of the text, in order.
+ * @param count The number of directives.
+ */
+static void expandText(IncludeState *state, const char *fileName, const char *text, size_t length,
+                       const IncludeDirective *directives, int count)
+{
+    size_t position = 0, end;
+    int line = 1, i;
+
+    for (i = 0; i <= count; i++)
+    {
+        end = i < count ? directives[i].start : length;
+        if (end > position)
+        {
+            addLineSpan(state->ctx, &state->ctx->includeMap, state->lines + 1, fileName, line, 1);
+            appendText(state->out, text + position, end - position);
+            state->lines += countLines(text + position, end - position);
+        }
+        if (i < count)
+        {
+            includeFile(state, fileName, text, &directives[i]);
+            position = directives[i].end;
+            line = directives[i].line + 1;
+        }
+    }
+}
+
+/**
+ * @brief Replaces the .include directives of a comment-stripped source by the files they name.
+ *
+ * @param ctx The assembler context receiving the map and the error messages.
+ * @param source The comment-stripped source.
+ * @param fileName The name of the source, which relative names are resolved against, or NULL for the working directory.
+ * @param confined Nonzero to reject the directives whose name is not a confined path.
+ * @param out The buffer the source with its files included is appended to.
+ * @return The number of directives found in the source and the files it included.
+ */
+int expandIncludes(AssemblerContext *ctx, const TextBuffer *source, const char *fileName, int confined, TextBuffer *out)
+{
+    IncludeDirective *directives;
+    IncludeState state;
+    IncludedName *name;
+    FileStatus status;
+    int count;
+
+    if (!scanIncludes(source->data, source->length, fileName, &directives, &count))
+    {
+        reportMessage(ctx, "Memory allocation error\n");
+        ctx->errorFlag = 1;
+        return 0;
+    }
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    state.ctx = ctx;
+    state.out = out;
+    state.lines = 0;
+    state.directives = 0;
+    state.confined = confined;
+    state.included = NULL;
+    if (fileName != NULL)
+    {
+        readFileStatus(fileName, &status);
+    }
+    if (fileName != NULL && status.exists &&
+        (state.included = (IncludedName *)arenaAlloc(&ctx->arena, sizeof(IncludedName))) != NULL)
+    {
+        state.included->status = status; /* A source including itself includes nothing */
+        state.included->file = NULL;
+        state.included->next = NULL;
+    }
+    expandText(&state, NULL, source->data, source->length, directives, count);
+    free(directives);
+    for (name = state.included; name != NULL; name = name->next)
+    {
+        if (name->file != NULL)
+        {
+            releaseIncludedFile(name->file);
+        }
+    }
+    ctx->lineMap = &ctx->includeMap;
+    return state.directives;
+}
+
+/**
+ * @brief Releases every included file kept by the process.
+ */
+void clearIncludeCache(void)
+{
+    unsigned long i;
+
+    pthread_mutex_lock(&includeLock);
+    for (i = 0; includeCache.slots != NULL && i <= includeCache.slotMask; i++)
+    {
+        if (includeCache.slots[i] != NULL && --includeCache.slots[i]->references == 0)
+        {
+            freeIncludedFile(includeCache.slots[i]);
+        }
+    }
+    free(includeCache.slots);
+    includeCache.slots = NULL;
+    includeCache.slotMask = 0;
+    includeCache.count = 0;
+    pthread_mutex_unlock(&includeLock);
+}
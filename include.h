@@ -0,0 +1,67 @@
+#ifndef INCLUDE_H
+#define INCLUDE_H
+
+#include <stddef.h>
+
+#include "data.h"
+#include "text_buffer.h"
+
+#define INCLUDE_DIRECTIVE ".include"
+#define INCLUDE_DIRECTIVE_LENGTH 8
+#define MAX_INCLUDE_PATH 256 /* Longest path of an included file, null terminator included */
+
+/*
+ * An '.include "file"' line is replaced by the comment-stripped text of the file, before macro
+ * expansion. A file is included once per source: later directives naming it again, through any path,
+ * are dropped. The name is relative to the directory of the file holding the directive.
+ *
+ * Each included file is read, comment-stripped and scanned for directives of its own once per
+ * process, then shared by every source that includes it, on any thread. A file whose inode, size or
+ * modification time changed since it was read is read again, and replaces the old version once the
+ * sources using that one are done with it.
+ */
+
+/**
+ * @brief Checks that a path stays inside the directory it is relative to.
+ *
+ * Symbolic links are not followed: the check is on the characters of the path only.
+ *
+ * @param path The path. It does not need to be null-terminated.
+ * @param length The number of characters in the path.
+ * @return 1 if the path is not empty, does not start with '/' and has no '..' component, 0 otherwise.
+ */
+int isConfinedPath(const char *path, size_t length);
+
+/**
+ * @brief Checks whether a text may hold an .include directive.
+ *
+ * @param text The text.
+ * @param length The number of characters in the text.
+ * @return Nonzero if the text mentions the directive anywhere.
+ */
+int mentionsInclude(const char *text, size_t length);
+
+/**
+ * @brief Replaces the .include directives of a comment-stripped source by the files they name.
+ *
+ * The lines of the output are mapped back to their files in the include map of the context, which
+ * becomes the map of the line numbers reported, unless there was no directive.
+ *
+ * @param ctx The assembler context receiving the map and the error messages.
+ * @param source The comment-stripped source.
+ * @param fileName The name of the source, which relative names are resolved against, or NULL for the working directory.
+ * @param confined Nonzero to report the directives, in the source and in the files it includes, whose name
+ *                 is not a confined path, instead of including the files they name.
+ * @param out The buffer the source with its files included is appended to.
+ * @return The number of directives found in the source and the files it included.
+ */
+int expandIncludes(AssemblerContext *ctx, const TextBuffer *source, const char *fileName, int confined, TextBuffer *out);
+
+/**
+ * @brief Releases every included file kept by the process.
+ *
+ * No source may be assembling at the time.
+ */
+void clearIncludeCache(void);
+
+#endif /* INCLUDE_H */
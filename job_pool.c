@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "job_pool.h"
+
+/* State shared by the workers of one runJobs call */
+typedef struct JobPool
+{
+    char *jobs;           /* The array of jobs */
+    size_t jobSize;       /* The size of one job in bytes */
+    int jobCount;         /* The number of jobs in the array */
+    int nextJob;          /* Index of the next job to hand out */
+    JobFunction function; /* The function to run on each job */
+    pthread_mutex_t lock; /* Protects nextJob */
+} JobPool;
+
+/**
+ * @brief Takes jobs from the pool and runs them until none are left.
+ *
+ * @param arg The JobPool to work on.
+ * @return Always NULL.
+ */
+static void *workerMain(void *arg)
+{
+    JobPool *pool = (JobPool *)arg;
+    int job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        job = pool->nextJob < pool->jobCount ? pool->nextJob++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (job < 0)
+        {
+            return NULL;
+        }
+        pool->function(pool->jobs + (size_t)job * pool->jobSize);
+    }
+}
+
+/**
+ * @brief Runs a function on every job of an array, on a pool of worker threads.
+ *
+ * @param jobs The array of jobs.
+ * @param jobSize The size of one job in bytes.
+ * @param jobCount The number of jobs in the array.
+ * @param workerCount The number of workers to use, including the calling thread.
+ * @param function The function to run on each job.
+ */
+void runJobs(void *jobs, size_t jobSize, int jobCount, int workerCount, JobFunction function)
+{
+    JobPool pool;
+    pthread_t threads[MAX_WORKERS];
+    int started = 0, i;
+
+    pool.jobs = (char *)jobs;
+    pool.jobSize = jobSize;
+    pool.jobCount = jobCount;
+    pool.nextJob = 0;
+    pool.function = function;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    if (workerCount > MAX_WORKERS)
+    {
+        workerCount = MAX_WORKERS;
+    }
+    if (workerCount > jobCount)
+    {
+        workerCount = jobCount;
+    }
+
+    /* The calling thread is a worker too, so start one thread less */
+    for (i = 0; i < workerCount - 1; i++)
+    {
+        if (pthread_create(&threads[started], NULL, workerMain, &pool) != 0)
+        {
+            fprintf(stderr, "Failed to start a worker thread, continuing with %d\n", started + 1);
+            break;
+        }
+        started++;
+    }
+
+    workerMain(&pool);
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+}
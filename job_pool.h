@@ -0,0 +1,26 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <stddef.h>
+
+#define MAX_WORKERS 256
+
+/* Function run by a worker on one job of the pool */
+typedef void (*JobFunction)(void *job);
+
+/**
+ * @brief Runs a function on every job of an array, on a pool of worker threads.
+ *
+ * Jobs are handed out in array order to whichever worker is free. The calling thread works as one
+ * of the workers, so a worker count of 1 (or a failure to start threads) runs all jobs in the
+ * calling thread. The function returns after every job has finished.
+ *
+ * @param jobs The array of jobs.
+ * @param jobSize The size of one job in bytes.
+ * @param jobCount The number of jobs in the array.
+ * @param workerCount The number of workers to use, including the calling thread.
+ * @param function The function to run on each job.
+ */
+void runJobs(void *jobs, size_t jobSize, int jobCount, int workerCount, JobFunction function);
+
+#endif /* JOB_POOL_H */
@@ -0,0 +1,207 @@
+/*
+ * Checks and regenerates the perfect hash of the keyword table.
+ *
+ * Run without arguments, it checks that every keyword of keywordTable sits in the slot keywordHash gives
+ * it, so no two keywords share a slot, and exits with a failure status otherwise. The makefile runs this
+ * check before compiling keywords.c.
+ *
+ * Run with --search, it looks for new multipliers of the hash, for the keywords currently in the table,
+ * and prints the hash and the table to paste into keywords.c. To add a keyword, put its entry in any
+ * empty slot of keywordTable, run "make keyword_hash && ./keyword_hash --search" and copy the output
+ * over keywordHash, KEYWORD_SLOTS and keywordTable.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "keywords.c"
+
+#define MAX_MULTIPLIER 32  /* Multipliers are searched from 0 to MAX_MULTIPLIER - 1 */
+#define MAX_SEARCH_SLOTS 256 /* Largest table the search tries, doubling from KEYWORD_SLOTS */
+
+/* The multipliers of a hash: slot = (length * a + first * b + second * c + last * d) & (slots - 1) */
+typedef struct HashParameters
+{
+    unsigned int a, b, c, d;
+    unsigned int slots;
+} HashParameters;
+
+/* Names of the values of KeywordKind and DirectiveType, as written in keywordTable */
+static const char *const kindNames[] = {"KEYWORD_OPCODE", "KEYWORD_DIRECTIVE", "KEYWORD_REGISTER", "KEYWORD_WORD"};
+static const char *const directiveNames[] = {"DATA_DIRECTIVE", "STRING_DIRECTIVE", "ENTRY_DIRECTIVE", "EXTERN_DIRECTIVE",
+                                             "DEFINE_DIRECTIVE", "IF_DIRECTIVE", "IFDEF_DIRECTIVE", "ELSE_DIRECTIVE",
+                                             "ENDIF_DIRECTIVE"};
+
+/**
+ * @brief Computes the slot of a keyword with candidate multipliers, as keywordHash does with its own.
+ *
+ * @param parameters The multipliers and the number of slots.
+ * @param name The keyword.
+ * @return The slot of the keyword.
+ */
+static unsigned int candidateHash(const HashParameters *parameters, const char *name)
+{
+    size_t length = strlen(name);
+
+    return (parameters->a * (unsigned int)length + parameters->b * (unsigned char)name[0] +
+            parameters->c * (unsigned char)name[1] + parameters->d * (unsigned char)name[length - 1]) &
+           (parameters->slots - 1);
+}
+
+/**
+ * @brief Checks that every keyword of the table is found in its own slot.
+ *
+ * @return The number of keywords that are not, 0 if the hash is perfect.
+ */
+static int checkTable(void)
+{
+    int slot, misplaced = 0;
+    const char *name;
+
+    for (slot = 0; slot < KEYWORD_SLOTS; slot++)
+    {
+        name = keywordTable[slot].name;
+        if (name == NULL)
+        {
+            continue;
+        }
+        if (strlen(name) < 2 || strlen(name) > MAX_KEYWORD_LENGTH)
+        {
+            fprintf(stderr, "keyword_hash: \"%s\" must have from 2 to %d characters\n", name, MAX_KEYWORD_LENGTH);
+            misplaced++;
+        }
+        else if (keywordHash(name, strlen(name)) != (unsigned int)slot)
+        {
+            fprintf(stderr, "keyword_hash: \"%s\" is in slot %d but hashes to slot %u\n", name, slot,
+                    keywordHash(name, strlen(name)));
+            misplaced++;
+        }
+    }
+    return misplaced;
+}
+
+/**
+ * @brief Checks whether candidate multipliers give every keyword of the table a slot of its own.
+ *
+ * @param parameters The multipliers and the number of slots.
+ * @return 1 if no two keywords share a slot, 0 otherwise.
+ */
+static int isPerfect(const HashParameters *parameters)
+{
+    unsigned char used[MAX_SEARCH_SLOTS];
+    unsigned int hash;
+    int slot;
+
+    memset(used, 0, sizeof(used));
+    for (slot = 0; slot < KEYWORD_SLOTS; slot++)
+    {
+        if (keywordTable[slot].name != NULL)
+        {
+            hash = candidateHash(parameters, keywordTable[slot].name);
+            if (used[hash])
+            {
+                return 0;
+            }
+            used[hash] = 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Finds the multipliers of a perfect hash over the smallest table that has one.
+ *
+ * @param parameters Receives the multipliers and the number of slots.
+ * @return 1 if a perfect hash was found, 0 otherwise.
+ */
+static int searchParameters(HashParameters *parameters)
+{
+    for (parameters->slots = KEYWORD_SLOTS; parameters->slots <= MAX_SEARCH_SLOTS; parameters->slots *= 2)
+    {
+        for (parameters->a = 0; parameters->a < MAX_MULTIPLIER; parameters->a++)
+        {
+            for (parameters->b = 0; parameters->b < MAX_MULTIPLIER; parameters->b++)
+            {
+                for (parameters->c = 0; parameters->c < MAX_MULTIPLIER; parameters->c++)
+                {
+                    for (parameters->d = 0; parameters->d < MAX_MULTIPLIER; parameters->d++)
+                    {
+                        if (isPerfect(parameters))
+                        {
+                            return 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Prints the hash function and the keyword table for the multipliers found.
+ *
+ * @param parameters The multipliers and the number of slots.
+ */
+static void printTable(const HashParameters *parameters)
+{
+    const Keyword *bySlot[MAX_SEARCH_SLOTS];
+    const Keyword *keyword;
+    unsigned int slot;
+
+    memset(bySlot, 0, sizeof(bySlot));
+    for (slot = 0; slot < KEYWORD_SLOTS; slot++)
+    {
+        if (keywordTable[slot].name != NULL)
+        {
+            bySlot[candidateHash(parameters, keywordTable[slot].name)] = &keywordTable[slot];
+        }
+    }
+
+    printf("#define KEYWORD_SLOTS %u\n\n", parameters->slots);
+    printf("    return (%u * (unsigned int)length + %u * (unsigned char)word[0] + %u * (unsigned char)word[1] +\n"
+           "            %u * (unsigned char)word[length - 1]) &\n"
+           "           (KEYWORD_SLOTS - 1);\n\n",
+           parameters->a, parameters->b, parameters->c, parameters->d);
+    printf("static const Keyword keywordTable[KEYWORD_SLOTS] = {\n");
+    for (slot = 0; slot < parameters->slots; slot++)
+    {
+        keyword = bySlot[slot];
+        if (keyword == NULL)
+        {
+            printf("    {NULL, KEYWORD_WORD, 0, 0}");
+        }
+        else if (keyword->kind == KEYWORD_DIRECTIVE)
+        {
+            printf("    {\"%s\", %s, %s, %d}", keyword->name, kindNames[keyword->kind], directiveNames[keyword->value],
+                   keyword->reserved);
+        }
+        else
+        {
+            printf("    {\"%s\", %s, %d, %d}", keyword->name, kindNames[keyword->kind], keyword->value, keyword->reserved);
+        }
+        printf(slot + 1 < parameters->slots ? ",\n" : "};\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    HashParameters parameters;
+
+    if (argc > 1 && strcmp(argv[1], "--search") == 0)
+    {
+        if (!searchParameters(&parameters))
+        {
+            fprintf(stderr, "keyword_hash: no perfect hash with multipliers below %d and at most %d slots\n",
+                    MAX_MULTIPLIER, MAX_SEARCH_SLOTS);
+            return 1;
+        }
+        printTable(&parameters);
+        return 0;
+    }
+    if (checkTable() > 0)
+    {
+        fprintf(stderr, "keyword_hash: the keyword table does not match keywordHash; run keyword_hash --search\n");
+        return 1;
+    }
+    return 0;
+}
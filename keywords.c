@@ -0,0 +1,166 @@
+#include <ctype.h>
+#include <string.h>
+
+#include "keywords.h"
+#include "data.h"
+
+#define KEYWORD_SLOTS 64
+
+/**
+ * Keyword table indexed by keywordHash. The hash multipliers were found by a search over small
+ * multipliers so that every keyword gets a slot of its own. The build checks that they still do with
+ * keyword_hash; when adding a keyword, put it in an empty slot and run "./keyword_hash --search" to
+ * regenerate the hash and the table.
+ * The reserved words are the registers r1-r7, the instruction names and data, string, entry and extern.
+ */
+static const Keyword keywordTable[KEYWORD_SLOTS] = {
+    {"r2", KEYWORD_REGISTER, 2, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {".data", KEYWORD_DIRECTIVE, DATA_DIRECTIVE, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {".ifdef", KEYWORD_DIRECTIVE, IFDEF_DIRECTIVE, 0},
+    {".else", KEYWORD_DIRECTIVE, ELSE_DIRECTIVE, 0},
+    {".define", KEYWORD_DIRECTIVE, DEFINE_DIRECTIVE, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"r4", KEYWORD_REGISTER, 4, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"data", KEYWORD_WORD, 0, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"clr", KEYWORD_OPCODE, 5, 1},
+    {"inc", KEYWORD_OPCODE, 7, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"not", KEYWORD_OPCODE, 4, 1},
+    {"lea", KEYWORD_OPCODE, 6, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"r6", KEYWORD_REGISTER, 6, 1},
+    {"cmp", KEYWORD_OPCODE, 1, 1},
+    {"r1", KEYWORD_REGISTER, 1, 1},
+    {"jsr", KEYWORD_OPCODE, 13, 1},
+    {"prn", KEYWORD_OPCODE, 12, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"string", KEYWORD_WORD, 0, 1},
+    {"extern", KEYWORD_WORD, 0, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"dec", KEYWORD_OPCODE, 8, 1},
+    {".extern", KEYWORD_DIRECTIVE, EXTERN_DIRECTIVE, 0},
+    {"r3", KEYWORD_REGISTER, 3, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {".endif", KEYWORD_DIRECTIVE, ENDIF_DIRECTIVE, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"entry", KEYWORD_WORD, 0, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {".string", KEYWORD_DIRECTIVE, STRING_DIRECTIVE, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"rts", KEYWORD_OPCODE, 14, 1},
+    {"r5", KEYWORD_REGISTER, 5, 1},
+    {"jmp", KEYWORD_OPCODE, 9, 1},
+    {"r0", KEYWORD_REGISTER, 0, 0},
+    {"bne", KEYWORD_OPCODE, 10, 1},
+    {".entry", KEYWORD_DIRECTIVE, ENTRY_DIRECTIVE, 0},
+    {"red", KEYWORD_OPCODE, 11, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {".if", KEYWORD_DIRECTIVE, IF_DIRECTIVE, 0},
+    {"add", KEYWORD_OPCODE, 2, 1},
+    {NULL, KEYWORD_WORD, 0, 0},
+    {"hlt", KEYWORD_OPCODE, 15, 1},
+    {"mov", KEYWORD_OPCODE, 0, 1},
+    {"r7", KEYWORD_REGISTER, 7, 1},
+    {"sub", KEYWORD_OPCODE, 3, 1}};
+
+/**
+ * @brief Computes the slot of a word in the keyword table, from its length, its first two characters and its last one.
+ *
+ * @param word The word, at least two characters long.
+ * @param length The number of characters in the word.
+ * @return The slot of the word.
+ */
+static unsigned int keywordHash(const char *word, size_t length)
+{
+    return (4 * (unsigned int)length + 22 * (unsigned char)word[0] + 7 * (unsigned char)word[1] +
+            31 * (unsigned char)word[length - 1]) &
+           (KEYWORD_SLOTS - 1);
+}
+
+/**
+ * @brief Looks up a keyword with a perfect hash, in constant time and without allocating.
+ *
+ * @param word The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The keyword, or NULL if the word is not a keyword.
+ */
+const Keyword *findKeyword(const char *word, size_t length)
+{
+    const Keyword *keyword;
+
+    if (length < 2 || length > MAX_KEYWORD_LENGTH)
+    {
+        return NULL;
+    }
+    keyword = &keywordTable[keywordHash(word, length)];
+    if (keyword->name == NULL || strncmp(keyword->name, word, length) != 0 || keyword->name[length] != '\0')
+    {
+        return NULL;
+    }
+    return keyword;
+}
+
+/**
+ * @brief Looks up an instruction name ignoring case.
+ *
+ * @param word The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The opcode keyword whose name matches the word ignoring case, or NULL if there is none.
+ */
+const Keyword *findOpcodeIgnoringCase(const char *word, size_t length)
+{
+    char folded[MAX_KEYWORD_LENGTH];
+    const Keyword *keyword;
+    size_t i;
+
+    if (length > MAX_KEYWORD_LENGTH)
+    {
+        return NULL;
+    }
+    for (i = 0; i < length; i++)
+    {
+        folded[i] = (char)tolower((unsigned char)word[i]);
+    }
+    keyword = findKeyword(folded, length);
+    return keyword != NULL && keyword->kind == KEYWORD_OPCODE ? keyword : NULL;
+}
+
+/**
+ * @brief Finds the first whitespace-delimited word of a line.
+ *
+ * @param line The line.
+ * @param length Receives the number of characters in the word; 0 if the line is blank.
+ * @return The start of the word.
+ */
+const char *firstWordSpan(const char *line, size_t *length)
+{
+    const char *end;
+
+    while (isspace((unsigned char)*line))
+    {
+        line++;
+    }
+    end = line;
+    while (*end != '\0' && !isspace((unsigned char)*end))
+    {
+        end++;
+    }
+    *length = (size_t)(end - line);
+    return line;
+}
@@ -0,0 +1,53 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stddef.h>
+
+#define MAX_KEYWORD_LENGTH 7 /* Length of the longest keyword, ".string" and ".extern" */
+
+/* What a keyword names */
+typedef enum KeywordKind
+{
+    KEYWORD_OPCODE,    /* An instruction; the value is its opcode */
+    KEYWORD_DIRECTIVE, /* A directive such as ".data"; the value is its DirectiveType */
+    KEYWORD_REGISTER,  /* A register; the value is its number */
+    KEYWORD_WORD       /* A directive name without its dot, such as "data" */
+} KeywordKind;
+
+/* An entry of the keyword table */
+typedef struct Keyword
+{
+    const char *name;  /* The keyword, as it appears in the source */
+    KeywordKind kind;  /* What the keyword names */
+    int value;         /* Opcode, DirectiveType or register number, depending on the kind */
+    int reserved;      /* Nonzero if the keyword cannot be used as a label or macro name */
+} Keyword;
+
+/**
+ * @brief Looks up a keyword with a perfect hash, in constant time and without allocating.
+ *
+ * @param word The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The keyword, or NULL if the word is not a keyword.
+ */
+const Keyword *findKeyword(const char *word, size_t length);
+
+/**
+ * @brief Looks up an instruction name ignoring case.
+ *
+ * @param word The word to look up. It does not need to be null-terminated.
+ * @param length The number of characters in the word.
+ * @return The opcode keyword whose name matches the word ignoring case, or NULL if there is none.
+ */
+const Keyword *findOpcodeIgnoringCase(const char *word, size_t length);
+
+/**
+ * @brief Finds the first whitespace-delimited word of a line.
+ *
+ * @param line The line.
+ * @param length Receives the number of characters in the word; 0 if the line is blank.
+ * @return The start of the word.
+ */
+const char *firstWordSpan(const char *line, size_t *length);
+
+#endif /* KEYWORDS_H */
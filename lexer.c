@@ -0,0 +1,200 @@
+#include <ctype.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "keywords.h"
+#include "scanner.h"
+
+/**
+ * @brief Appends a token to the tokens of a line.
+ *
+ * @param tokens The tokens of the line.
+ * @param kind The kind of the token.
+ * @param start The first character of the token.
+ * @param end The character after the token.
+ * @param value The value of the token.
+ */
+static void addToken(LineTokens *tokens, TokenKind kind, const char *start, const char *end, int value)
+{
+    Token *token;
+
+    if (tokens->count < MAX_LINE_TOKENS)
+    {
+        token = &tokens->tokens[tokens->count++];
+        token->kind = kind;
+        token->start = start;
+        token->length = (size_t)(end - start);
+        token->value = value;
+    }
+}
+
+/**
+ * @brief Skips whitespace.
+ *
+ * @param p The current position.
+ * @param limit The end of the line.
+ * @return The first non-whitespace character at or after p, or limit.
+ */
+static const char *skipSpace(const char *p, const char *limit)
+{
+    while (p < limit && isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @brief Finds the next delimiter of the given kinds in the index of a line.
+ *
+ * @param index The delimiters of the line.
+ * @param cursor The first delimiter not yet passed; moved forward to from.
+ * @param line The line.
+ * @param from The position to search from.
+ * @param kinds The DELIMITER_ kinds to stop at.
+ * @return The first such delimiter at or after from, or the end of the line.
+ */
+static const char *nextDelimiter(const LineIndex *index, int *cursor, const char *line, const char *from, int kinds)
+{
+    size_t offset = (size_t)(from - line);
+    int i;
+
+    while (*cursor < index->count && index->positions[*cursor] < offset)
+    {
+        (*cursor)++;
+    }
+    for (i = *cursor; i < index->count; i++)
+    {
+        if (index->kinds[i] & kinds)
+        {
+            return line + index->positions[i];
+        }
+    }
+    return line + index->length;
+}
+
+/**
+ * @brief Splits a line into tokens in a single scan.
+ *
+ * Labels are recognized at the start of the line and after another label. The next word, up to
+ * whitespace, is the mnemonic or directive. The rest of the line is split into operands and punctuation.
+ * The delimiters of the line are found first, a block of characters at a time, and each token is cut
+ * at the next delimiter that ends it. Only the first MAX_LINE_LENGTH - 1 characters are tokenized.
+ *
+ * @param line The line. The tokens point into it, so it must outlive them.
+ * @param tokens Receives the tokens.
+ */
+void tokenizeLine(const char *line, LineTokens *tokens)
+{
+    const Keyword *keyword;
+    const char *p, *end, *limit;
+    LineIndex index; /* The delimiters of the line */
+    int cursor = 0;  /* The first delimiter of the index the scan has not passed */
+    int inString = 0; /* Nonzero if quotes start string literals, as in a .string directive */
+
+    /* Every token ends at a delimiter, so the tokens are cut at the positions of the index */
+    indexLine(line, strlen(line), &index);
+    limit = line + index.length;
+    tokens->count = 0;
+    tokens->colonCount = index.colonCount;
+
+    /* Labels: a letter, then letters and digits, then ':' */
+    p = skipSpace(line, limit);
+    while (p < limit && isalpha((unsigned char)*p))
+    {
+        end = p;
+        while (end < limit && isalnum((unsigned char)*end))
+        {
+            end++;
+        }
+        if (end == limit || *end != ':')
+        {
+            break;
+        }
+        addToken(tokens, TOKEN_LABEL, p, end, 0);
+        p = skipSpace(end + 1, limit);
+    }
+
+    /* The mnemonic or directive: everything up to the next whitespace */
+    if (p < limit)
+    {
+        end = nextDelimiter(&index, &cursor, line, p, DELIMITER_SPACE);
+        if (*p == '.')
+        {
+            keyword = findKeyword(p, (size_t)(end - p));
+            addToken(tokens, TOKEN_DIRECTIVE, p, end,
+                     keyword != NULL && keyword->kind == KEYWORD_DIRECTIVE ? keyword->value : INVALID_DIRECTIVE);
+            inString = keyword != NULL && keyword->kind == KEYWORD_DIRECTIVE && keyword->value == STRING_DIRECTIVE;
+        }
+        else if ((keyword = findOpcodeIgnoringCase(p, (size_t)(end - p))) != NULL)
+        {
+            addToken(tokens, TOKEN_MNEMONIC, p, end, keyword->value);
+        }
+        else
+        {
+            addToken(tokens, TOKEN_OPERAND, p, end, 0);
+        }
+        p = end;
+    }
+
+    /* Operands and punctuation */
+    while ((p = skipSpace(p, limit)) < limit)
+    {
+        end = p + 1;
+        switch (*p)
+        {
+        case ',':
+            addToken(tokens, TOKEN_COMMA, p, end, 0);
+            break;
+        case '[':
+            addToken(tokens, TOKEN_INDEX_OPEN, p, end, 0);
+            break;
+        case ']':
+            addToken(tokens, TOKEN_INDEX_CLOSE, p, end, 0);
+            break;
+        case '=':
+            addToken(tokens, TOKEN_EQUALS, p, end, 0);
+            break;
+        default:
+            if (*p == '"' && inString)
+            {
+                end = nextDelimiter(&index, &cursor, line, p + 1, DELIMITER_QUOTE);
+                end += end < limit; /* The closing quote */
+                addToken(tokens, TOKEN_STRING, p, end, 0);
+                break;
+            }
+            /* Any other run of characters up to whitespace or punctuation; '#' starts an immediate */
+            end = nextDelimiter(&index, &cursor, line, p, DELIMITER_SPACE | DELIMITER_PUNCTUATION | (inString ? DELIMITER_QUOTE : 0));
+            addToken(tokens, *p == '#' ? TOKEN_IMMEDIATE : TOKEN_OPERAND, p, end, 0);
+            break;
+        }
+        p = end;
+    }
+}
+
+/**
+ * @brief Copies the text of a token into a null-terminated buffer.
+ *
+ * @param token The token.
+ * @param buffer Buffer of at least MAX_LINE_LENGTH characters.
+ * @return The buffer.
+ */
+char *copyToken(const Token *token, char buffer[])
+{
+    size_t length = token->length < MAX_LINE_LENGTH ? token->length : MAX_LINE_LENGTH - 1;
+    memcpy(buffer, token->start, length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+/**
+ * @brief Measures the text covered by a run of tokens.
+ *
+ * @param first The first token of the run.
+ * @param last The last token of the run.
+ * @return The number of characters from the start of first to the end of last.
+ */
+size_t tokenSpan(const Token *first, const Token *last)
+{
+    return (size_t)(last->start + last->length - first->start);
+}
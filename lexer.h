@@ -0,0 +1,73 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+
+#include "data.h"
+
+#define MAX_LINE_TOKENS MAX_LINE_LENGTH /* A token takes at least one character of the line */
+
+/* Kinds of tokens a source line is split into */
+typedef enum TokenKind
+{
+    TOKEN_LABEL,       /* A word followed by ':' at the start of the line; the range excludes the colon */
+    TOKEN_MNEMONIC,    /* An instruction name, in any case; the value is its opcode */
+    TOKEN_DIRECTIVE,   /* A word starting with '.'; the value is its DirectiveType */
+    TOKEN_OPERAND,     /* A symbol, number or any other run of characters */
+    TOKEN_IMMEDIATE,   /* '#' and the characters following it */
+    TOKEN_COMMA,       /* ',' */
+    TOKEN_INDEX_OPEN,  /* '[' */
+    TOKEN_INDEX_CLOSE, /* ']' */
+    TOKEN_EQUALS,      /* '=' */
+    TOKEN_STRING       /* A string literal of a .string directive, including its quotes */
+} TokenKind;
+
+/* A token: its kind and the characters of the line it covers */
+typedef struct Token
+{
+    TokenKind kind;    /* Kind of the token */
+    const char *start; /* First character of the token, inside the line */
+    size_t length;     /* Number of characters in the token */
+    int value;         /* Opcode of a mnemonic or DirectiveType of a directive; 0 otherwise */
+} Token;
+
+/* The tokens of one line, in order. Every non-whitespace character of the line belongs to a token. */
+typedef struct LineTokens
+{
+    Token tokens[MAX_LINE_TOKENS]; /* The tokens */
+    int count;                     /* Number of tokens */
+    int colonCount;                /* Number of ':' characters anywhere in the line */
+} LineTokens;
+
+/**
+ * @brief Splits a line into tokens in a single scan.
+ *
+ * Labels are recognized at the start of the line and after another label. The next word, up to
+ * whitespace, is the mnemonic or directive. The rest of the line is split into operands and punctuation.
+ * The delimiters of the line are found first, a block of characters at a time, and each token is cut
+ * at the next delimiter that ends it. Only the first MAX_LINE_LENGTH - 1 characters are tokenized.
+ *
+ * @param line The line. The tokens point into it, so it must outlive them.
+ * @param tokens Receives the tokens.
+ */
+void tokenizeLine(const char *line, LineTokens *tokens);
+
+/**
+ * @brief Copies the text of a token into a null-terminated buffer.
+ *
+ * @param token The token.
+ * @param buffer Buffer of at least MAX_LINE_LENGTH characters.
+ * @return The buffer.
+ */
+char *copyToken(const Token *token, char buffer[]);
+
+/**
+ * @brief Measures the text covered by a run of tokens.
+ *
+ * @param first The first token of the run.
+ * @param last The last token of the run.
+ * @return The number of characters from the start of first to the end of last.
+ */
+size_t tokenSpan(const Token *first, const Token *last);
+
+#endif /* LEXER_H */
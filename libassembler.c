@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libassembler.h"
+#include "data.h"
+#include "utils.h"
+#include "text_buffer.h"
+#include "macro_parser.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "parallel_pass.h"
+#include "include.h"
+#include "stats.h"
+
+/* An assembler instance: the state of the assembly and the output handed back to the caller */
+struct AsmContext
+{
+    AssemblerContext *assembler; /* State of the assembly */
+    TextBuffer stripped;         /* The source without its comments */
+    TextBuffer included;         /* The source without its comments, with its .include directives expanded */
+    TextBuffer expanded;         /* The source after macro expansion */
+    AsmSymbolAddress *entries;   /* Entry symbols of the last assembly */
+    int entryCapacity;           /* Number of slots allocated for entries */
+    AsmSymbolAddress *externs;   /* Uses of external symbols in the last assembly */
+    int externCapacity;          /* Number of slots allocated for externs */
+    const char **byAddress;      /* For each word of the image, the symbol collected at its address, or NULL */
+    int addressCapacity;         /* Number of slots allocated for byAddress */
+    int passThreads;             /* Number of threads the first pass reads the source on */
+    const AsmPrelude *prelude;   /* Macros and constants defined before each source, or NULL */
+    const char *fileName;        /* Name of the source, which included files are found relative to, or NULL */
+    int confinedIncludes;        /* Nonzero if included files must stay inside the directory of the source */
+};
+
+/**
+ * @brief Adds a symbol and an address to a growable list.
+ *
+ * @param list The list, reallocated when it is full.
+ * @param count The number of items in the list, incremented on success.
+ * @param capacity The number of slots allocated for the list.
+ * @param name The name of the symbol.
+ * @param address The address to record with it.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int addSymbolAddress(AsmSymbolAddress **list, int *count, int *capacity, const char *name, int address)
+{
+    if (*count == *capacity)
+    {
+        int newCapacity = *capacity ? *capacity * 2 : 16;
+        AsmSymbolAddress *newList = realloc(*list, sizeof(AsmSymbolAddress) * newCapacity);
+        if (newList == NULL)
+        {
+            return 0;
+        }
+        *list = newList;
+        *capacity = newCapacity;
+    }
+    (*list)[*count].name = name;
+    (*list)[*count].address = address;
+    (*count)++;
+    return 1;
+}
+
+/**
+ * @brief Orders two symbol addresses by address, then by name.
+ *
+ * @param a The first AsmSymbolAddress.
+ * @param b The second AsmSymbolAddress.
+ * @return A negative number, zero or a positive number as a sorts before, with or after b.
+ */
+static int compareSymbolAddresses(const void *a, const void *b)
+{
+    const AsmSymbolAddress *first = (const AsmSymbolAddress *)a;
+    const AsmSymbolAddress *second = (const AsmSymbolAddress *)b;
+
+    if (first->address != second->address)
+    {
+        return first->address < second->address ? -1 : 1;
+    }
+    return strcmp(first->name, second->name);
+}
+
+/**
+ * @brief Collects the symbols placed in the address slots, in address order, and empties the slots.
+ *
+ * @param ctx The context holding the slots.
+ * @param words The number of slots in use.
+ * @param list The list receiving the symbols.
+ * @param count The number of items in the list, incremented for each symbol.
+ * @param capacity The number of slots allocated for the list.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int collectAddressSlots(AsmContext *ctx, int words, AsmSymbolAddress **list, int *count, int *capacity)
+{
+    int i;
+
+    for (i = 0; i < words; i++)
+    {
+        if (ctx->byAddress[i] != NULL)
+        {
+            if (!addSymbolAddress(list, count, capacity, ctx->byAddress[i], i + ASM_BASE_ADDRESS))
+            {
+                return 0;
+            }
+            ctx->byAddress[i] = NULL;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Fills the entry and extern lists of the result, in address order.
+ *
+ * Each symbol is placed in the slot of its address, and the slots are then read in order, so the lists
+ * take time linear in the size of the image. A word uses at most one external symbol, so the uses never
+ * share a slot. Two entries can only share an address when one of them is a constant; the entries are
+ * then sorted instead.
+ *
+ * @param ctx The context that assembled the source.
+ * @param result The result receiving the lists.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int collectSymbols(AsmContext *ctx, AsmResult *result)
+{
+    AssemblerContext *assembler = ctx->assembler;
+    const Symbol *current;
+    const QueuedEntry *queued;
+    int i, j, address, placed = 1, words = assembler->IC + assembler->DC;
+
+    result->entryCount = 0;
+    result->externCount = 0;
+    if (words > ctx->addressCapacity)
+    {
+        const char **slots = malloc(sizeof(const char *) * words);
+        if (slots == NULL)
+        {
+            return 0;
+        }
+        free(ctx->byAddress);
+        ctx->byAddress = slots;
+        ctx->addressCapacity = words;
+    }
+    memset(ctx->byAddress, 0, sizeof(const char *) * words);
+
+    for (i = 0; i < assembler->symbolTable.count; i++)
+    {
+        current = &assembler->symbolTable.symbols[i];
+        for (j = 0; j < current->useCount; j++)
+        {
+            ctx->byAddress[current->uses[j]] = current->symbolName;
+        }
+    }
+    if (!collectAddressSlots(ctx, words, &ctx->externs, &result->externCount, &ctx->externCapacity))
+    {
+        return 0;
+    }
+
+    for (queued = assembler->entryQueue; queued != NULL; queued = queued->next)
+    {
+        if (queued->symbol < 0)
+        {
+            continue;
+        }
+        current = &assembler->symbolTable.symbols[queued->symbol];
+        address = (int)current->value - ASM_BASE_ADDRESS;
+        if (placed && address >= 0 && address < words && ctx->byAddress[address] == NULL)
+        {
+            ctx->byAddress[address] = current->symbolName;
+        }
+        else
+        {
+            placed = 0;
+        }
+        if (!addSymbolAddress(&ctx->entries, &result->entryCount, &ctx->entryCapacity, current->symbolName, current->value))
+        {
+            return 0;
+        }
+    }
+    if (placed)
+    {
+        result->entryCount = 0;
+        if (!collectAddressSlots(ctx, words, &ctx->entries, &result->entryCount, &ctx->entryCapacity))
+        {
+            return 0;
+        }
+    }
+    else if (result->entryCount > 1)
+    {
+        qsort(ctx->entries, result->entryCount, sizeof(AsmSymbolAddress), compareSymbolAddresses);
+    }
+    result->entries = ctx->entries;
+    result->externs = ctx->externs;
+    return 1;
+}
+
+/**
+ * @brief Fills the result with what the last assembly produced.
+ *
+ * @param ctx The context that assembled the source.
+ * @param result The result to fill.
+ * @return 1 if the source assembled without errors, 0 otherwise.
+ */
+static int finishResult(AsmContext *ctx, AsmResult *result)
+{
+    AssemblerContext *assembler = ctx->assembler;
+
+    if (!assembler->errorFlag && !collectSymbols(ctx, result))
+    {
+        reportMessage(assembler, "Memory allocation failed\n");
+        assembler->errorFlag = 1;
+    }
+    if (assembler->errorFlag)
+    {
+        result->entryCount = 0;
+        result->externCount = 0;
+    }
+    result->success = !assembler->errorFlag;
+    result->instructionCount = assembler->IC;
+    result->dataCount = assembler->DC;
+    result->baseAddress = ASM_BASE_ADDRESS;
+    result->image = assembler->image;
+    result->diagnostics = assembler->diagnostics.data ? assembler->diagnostics.data : "";
+    result->diagnosticsLength = assembler->diagnostics.length;
+    result->expanded = ctx->expanded.data ? ctx->expanded.data : "";
+    result->expandedLength = ctx->expanded.length;
+    result->stats.linesRead = assembler->linesRead;
+    result->stats.instructions = assembler->instructionLines;
+    result->stats.dataWords = (unsigned long)assembler->DC;
+    result->stats.symbolLookups = assembler->symbolLookups;
+    result->stats.macroExpansions = assembler->macroExpansions;
+    result->stats.macroLookups = assembler->macros.lookups;
+    result->stats.macroProbes = assembler->macros.probes;
+    result->stats.longestMacroProbe = assembler->macros.longestProbe;
+    result->stats.memoryWords = result->success ? (unsigned long)(assembler->IC + assembler->DC) : 0;
+    return result->success;
+}
+
+/**
+ * @brief Creates an assembler context.
+ *
+ * @return The new context, or NULL if memory allocation fails.
+ */
+AsmContext *asm_context_create(void)
+{
+    AsmContext *ctx = malloc(sizeof(AsmContext));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    if ((ctx->assembler = createAssemblerContext()) == NULL)
+    {
+        free(ctx);
+        return NULL;
+    }
+    initTextBuffer(&ctx->stripped);
+    initTextBuffer(&ctx->included);
+    initTextBuffer(&ctx->expanded);
+    ctx->entries = NULL;
+    ctx->entryCapacity = 0;
+    ctx->externs = NULL;
+    ctx->byAddress = NULL;
+    ctx->addressCapacity = 0;
+    ctx->externCapacity = 0;
+    ctx->passThreads = 1;
+    ctx->prelude = NULL;
+    ctx->fileName = NULL;
+    ctx->confinedIncludes = 0;
+    return ctx;
+}
+
+/**
+ * @brief Sets the number of threads the first pass of a context reads the source on.
+ *
+ * @param ctx The context.
+ * @param threadCount The number of threads.
+ */
+void asm_context_set_pass_threads(AsmContext *ctx, int threadCount)
+{
+    ctx->passThreads = threadCount;
+}
+
+/**
+ * @brief Sets the prelude whose macros and constants are defined before each source a context assembles.
+ *
+ * @param ctx The context.
+ * @param prelude The prelude, or NULL for none.
+ */
+void asm_context_set_prelude(AsmContext *ctx, const AsmPrelude *prelude)
+{
+    ctx->prelude = prelude;
+}
+
+/**
+ * @brief Sets the name of the source a context assembles next.
+ *
+ * @param ctx The context.
+ * @param fileName The name of the source file, or NULL for a source without one.
+ */
+void asm_context_set_file_name(AsmContext *ctx, const char *fileName)
+{
+    ctx->fileName = fileName;
+}
+
+/**
+ * @brief Restricts the files the .include directives of the sources of a context may name.
+ *
+ * @param ctx The context.
+ * @param confined Nonzero to accept only relative names without a '..' component.
+ */
+void asm_context_set_confined_includes(AsmContext *ctx, int confined)
+{
+    ctx->confinedIncludes = confined;
+}
+
+/**
+ * @brief Releases the included files the process keeps for later sources.
+ */
+void asm_clear_include_cache(void)
+{
+    clearIncludeCache();
+}
+
+/**
+ * @brief Assembles source code held in memory.
+ *
+ * The steps are:
+ * - Comment stripping: Copies the source without its comments, then replaces its .include directives by
+ *   the comment-stripped files they name.
+ * - Macro processing: Expands macros into a second buffer, starting from the macros of the prelude, if any.
+ * - First Pass: Generates a symbol table, calculates memory addresses and encodes the instructions,
+ *   recording the words that refer to symbols and the names of the entry directives.
+ * - Second Pass: Resolves the entries and patches the words that refer to symbols, without reading the source again.
+ *
+ * @param ctx The context to assemble with. Anything left from its previous assembly is released.
+ * @param source The source code, as it would appear in a '.as' file.
+ * @param length The number of characters in the source.
+ * @param result Receives the output of the assembly.
+ * @return 1 if the source assembled without errors, 0 otherwise.
+ */
+int asm_assemble_buffer(AsmContext *ctx, const char *source, size_t length, AsmResult *result)
+{
+    AssemblerContext *assembler = ctx->assembler;
+    TextBuffer *preprocessed = &ctx->stripped;
+    PhaseTimer timer;
+
+    memset(result, 0, sizeof(AsmResult));
+    resetAssemblerContext(assembler);
+    assembler->prelude = ctx->prelude;
+    clearTextBuffer(&ctx->stripped);
+    clearTextBuffer(&ctx->included);
+    clearTextBuffer(&ctx->expanded);
+
+    /* Perform comment stripping, file inclusion and macro processing */
+    startPhase(&timer);
+    stripComments(source, length, 0, &ctx->stripped);
+    if (mentionsInclude(ctx->stripped.data, ctx->stripped.length) &&
+        expandIncludes(assembler, &ctx->stripped, ctx->fileName, ctx->confinedIncludes, &ctx->included) > 0)
+    {
+        preprocessed = &ctx->included;
+    }
+    endPhase(&timer, &result->stats, ASM_PHASE_STRIP);
+    if (assembler->errorFlag)
+    {
+        reportMessage(assembler, "Errors detected in file inclusion. Exiting...\n");
+        return finishResult(ctx, result);
+    }
+    startPhase(&timer);
+    macroParser(assembler, preprocessed, &ctx->expanded);
+    endPhase(&timer, &result->stats, ASM_PHASE_MACRO);
+    if (assembler->errorFlag)
+    {
+        reportMessage(assembler, "Errors detected in macro processing. Exiting...\n");
+        return finishResult(ctx, result);
+    }
+
+    /* Perform the first pass of the assembler */
+    startPhase(&timer);
+    if (ctx->passThreads > 1)
+    {
+        parallelFirstPass(assembler, &ctx->expanded, ctx->passThreads);
+    }
+    else
+    {
+        firstPass(assembler, &ctx->expanded);
+    }
+    endPhase(&timer, &result->stats, ASM_PHASE_FIRST_PASS);
+    if (assembler->errorFlag)
+    {
+        reportMessage(assembler, "Errors detected in the first pass. Exiting...\n");
+        return finishResult(ctx, result);
+    }
+    startPhase(&timer);
+    /* Perform the second pass of the assembler */
+    secondPass(assembler);
+    endPhase(&timer, &result->stats, ASM_PHASE_SECOND_PASS);
+    if (assembler->errorFlag)
+    {
+        reportMessage(assembler, "Errors detected in the second pass. Exiting...\n");
+    }
+    return finishResult(ctx, result);
+}
+
+/**
+ * @brief Releases an assembler context and every result it returned.
+ *
+ * @param ctx The context to destroy. May be NULL.
+ */
+void asm_context_destroy(AsmContext *ctx)
+{
+    if (ctx != NULL)
+    {
+        destroyAssemblerContext(ctx->assembler);
+        freeTextBuffer(&ctx->stripped);
+        freeTextBuffer(&ctx->included);
+        freeTextBuffer(&ctx->expanded);
+        free(ctx->entries);
+        free(ctx->externs);
+        free(ctx->byAddress);
+        free(ctx);
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef LIBASSEMBLER_H
+#define LIBASSEMBLER_H
+
+#include <stddef.h>
+
+/* Version of the assembler. Change it whenever the same source may assemble to different output. */
+#define ASM_VERSION "1.1.0"
+
+/* Address of the first word of the memory image */
+#define ASM_BASE_ADDRESS 100
+
+/* An assembler instance. Contexts are independent of each other, so different threads may each
+ * assemble with a context of their own at the same time. */
+typedef struct AsmContext AsmContext;
+
+/* Macros and constants assembled once and defined before every source, as made by buildPrelude in
+ * prelude.h. A prelude is only read, so contexts may share one. */
+typedef struct AsmPrelude AsmPrelude;
+
+/* A symbol name together with an address */
+typedef struct AsmSymbolAddress
+{
+    const char *name; /* Name of the symbol */
+    int address;      /* Address of the symbol or of the word that uses it */
+} AsmSymbolAddress;
+
+/* Phases of an assembly, as timed in AsmStats */
+typedef enum AsmPhase
+{
+    ASM_PHASE_STRIP,       /* Comment stripping */
+    ASM_PHASE_MACRO,       /* Macro expansion */
+    ASM_PHASE_FIRST_PASS,  /* First pass */
+    ASM_PHASE_SECOND_PASS, /* Second pass */
+    ASM_PHASE_OUTPUT,      /* Writing the output files, timed by the caller */
+    ASM_PHASE_COUNT
+} AsmPhase;
+
+/* Time spent in each phase of an assembly, and counters of the work done */
+typedef struct AsmStats
+{
+    double wallSeconds[ASM_PHASE_COUNT]; /* Elapsed time of each phase */
+    double cpuSeconds[ASM_PHASE_COUNT];  /* CPU time of each phase, in the assembling thread */
+    unsigned long linesRead;             /* Source lines read */
+    unsigned long instructions;          /* Instruction lines encoded */
+    unsigned long dataWords;             /* Words of data (DC) */
+    unsigned long symbolLookups;         /* Symbol table lookups */
+    unsigned long macroExpansions;       /* Macro uses expanded */
+    unsigned long macroLookups;          /* Macro table lookups, after the fast-reject filter */
+    unsigned long macroProbes;           /* Macro table slots examined by the lookups */
+    unsigned long longestMacroProbe;     /* Most macro table slots examined by one lookup */
+    unsigned long memoryWords;           /* Memory words emitted (IC + DC) */
+    unsigned long bytesWritten;          /* Bytes of output files written, counted by the caller */
+} AsmStats;
+
+/* Output of one assembly. Everything it points to is owned by the context and stays valid until the
+ * next call to asm_assemble_buffer or asm_context_destroy on the same context. */
+typedef struct AsmResult
+{
+    int success;                     /* 1 if the source assembled without errors, 0 otherwise */
+    int instructionCount;            /* Number of instruction words (IC) */
+    int dataCount;                   /* Number of data words (DC) */
+    int baseAddress;                 /* Address of image[0] */
+    const unsigned short *image;     /* The encoded 14-bit words, instructions first, then data */
+    const AsmSymbolAddress *entries; /* The entry symbols and their addresses */
+    int entryCount;                  /* Number of entry symbols */
+    const AsmSymbolAddress *externs; /* Each use of an external symbol and the address of the word using it */
+    int externCount;                 /* Number of uses of external symbols */
+    const char *diagnostics;         /* Error messages, one or more lines each; empty if there were none */
+    size_t diagnosticsLength;        /* Number of characters in diagnostics */
+    const char *expanded;            /* The source after comment stripping and macro expansion */
+    size_t expandedLength;           /* Number of characters in expanded */
+    AsmStats stats;                  /* Timing and counters of the assembly */
+} AsmResult;
+
+/**
+ * @brief Creates an assembler context.
+ *
+ * @return The new context, or NULL if memory allocation fails.
+ */
+AsmContext *asm_context_create(void);
+
+/**
+ * @brief Sets the number of threads the first pass of a context reads the source on.
+ *
+ * A large source is split into line-aligned chunks read at the same time; the output is the same as
+ * with a single thread. Contexts start with 1, which reads the source in a single pass.
+ *
+ * @param ctx The context.
+ * @param threadCount The number of threads.
+ */
+void asm_context_set_pass_threads(AsmContext *ctx, int threadCount);
+
+/**
+ * @brief Sets the prelude whose macros and constants are defined before each source a context assembles.
+ *
+ * The prelude must outlive its use by the context. Contexts start without one.
+ *
+ * @param ctx The context.
+ * @param prelude The prelude, or NULL for none.
+ */
+void asm_context_set_prelude(AsmContext *ctx, const AsmPrelude *prelude);
+
+/**
+ * @brief Sets the name of the source a context assembles next.
+ *
+ * The .include directives of the source name files relative to its directory, and errors in them are
+ * reported with the name of the included file. The name must outlive its use by the context. Contexts
+ * start without one, so included files are found relative to the working directory.
+ *
+ * @param ctx The context.
+ * @param fileName The name of the source file, or NULL for a source without one.
+ */
+void asm_context_set_file_name(AsmContext *ctx, const char *fileName);
+
+/**
+ * @brief Restricts the files the .include directives of the sources of a context may name.
+ *
+ * When confined, a directive, in the source or in a file it includes, must name a relative path without
+ * a '..' component, so every included file stays inside the directory of the source; any other directive
+ * is reported as an error. Contexts start unconfined.
+ *
+ * @param ctx The context.
+ * @param confined Nonzero to accept only relative names without a '..' component.
+ */
+void asm_context_set_confined_includes(AsmContext *ctx, int confined);
+
+/**
+ * @brief Releases the included files the process keeps for later sources.
+ *
+ * Each file named by an .include directive is read once and shared by every later source, until it
+ * changes on disk. No context may be assembling at the time.
+ */
+void asm_clear_include_cache(void);
+
+/**
+ * @brief Assembles source code held in memory.
+ *
+ * Nothing is written to disk and nothing is printed. The image, the entry and extern lists and the
+ * diagnostics are returned in the result. When assembly fails only diagnostics and expanded are
+ * meaningful.
+ *
+ * @param ctx The context to assemble with. Anything left from its previous assembly is released.
+ * @param source The source code, as it would appear in a '.as' file.
+ * @param length The number of characters in the source.
+ * @param result Receives the output of the assembly.
+ * @return 1 if the source assembled without errors, 0 otherwise.
+ */
+int asm_assemble_buffer(AsmContext *ctx, const char *source, size_t length, AsmResult *result);
+
+/**
+ * @brief Releases an assembler context and every result it returned.
+ *
+ * @param ctx The context to destroy. May be NULL.
+ */
+void asm_context_destroy(AsmContext *ctx);
+
+#endif /* LIBASSEMBLER_H */
@@ -5,213 +5,509 @@
 #include "data.h"
 
 #include "macro_parser.h"
+#include "prelude.h"
+#include "conditional.h"
 
-Macro *macroTable[MACRO_TABLE_SIZE];
-int hasMcr;
+/* source line number: number of the line holding the character before end */
+static int sourceLineNumber(TextBuffer *source, size_t end)
+{
+  size_t i;
+  int lineNumber = 1;
+  for (i = 0; i + 1 < end; i++)
+  {
+    if (source->data[i] == '\n')
+    {
+      lineNumber++;
+    }
+  }
+  return lineNumber;
+}
 
-/* macro parser: first macro parsing of file */
-void macroParser(FILE *fp, char *fileName)
+/* find macro end: read the source up to and including the line that ends the macro, and return where
+   the body ends. words before endmcr on its line stay in the body */
+static size_t findMacroEnd(TextBuffer *source)
 {
   char line[MAX_LINE];
-  FILE *outFile;
+  const char *text;
+  size_t length, lineStart = source->position;
+  char *word, *savePtr;
+  int first; /* endmcr is the first word of its line */
+
+  while ((text = bufferNextLine(source, MAX_LINE - 1, &length)) != NULL)
+  {
+    memcpy(line, text, length);
+    line[length] = '\0';
+    first = 1;
+    for (word = strTokR(line, " \t", &savePtr); word != NULL; word = strTokR(NULL, " \t", &savePtr))
+    {
+      if (strncmp(word, "endmcr", 6) == 0)
+      {
+        return first ? lineStart : lineStart + (size_t)(word - line);
+      }
+      first = 0;
+    }
+    lineStart = source->position;
+  }
+  return source->length;
+}
+
+/* mentions mcr: without "mcr" anywhere in the text no macro can be defined, so nothing is expanded */
+static int mentionsMcr(const TextBuffer *source)
+{
+  const char *p, *end;
+
+  if (source->length < 3)
+  {
+    return 0;
+  }
+  end = source->data + source->length - 2; /* past the last place "mcr" can start */
+  for (p = source->data; (p = memchr(p, 'm', (size_t)(end - p))) != NULL; p++)
+  {
+    if (p[1] == 'c' && p[2] == 'r')
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* has word: whether a line holds anything but spaces, tabs and its newline; lines without words are dropped */
+static int hasWord(const char *text, size_t length)
+{
+  size_t i;
+  for (i = 0; i < length && text[i] != '\0'; i++)
+  {
+    if (text[i] != ' ' && text[i] != '\t' && text[i] != '\n')
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* length bit: the bit of a name length in the length filter */
+static unsigned long lengthBit(size_t length)
+{
+  return 1ul << (length < 31 ? length : 31);
+}
+
+/* line tracker: how far the macro parser has counted the lines of its source and of its output */
+typedef struct LineTracker
+{
+  const char *counted; /* the source is counted up to here */
+  int line;            /* line of the source at counted */
+  int outLines;        /* lines written to the output */
+} LineTracker;
+
+/* count newlines: number of lines ended in a text */
+static int countNewlines(const char *text, size_t length)
+{
+  const char *p, *end = text + length;
+  int lines = 0;
+  for (p = text; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++)
+  {
+    lines++;
+  }
+  return lines;
+}
+
+/* map output: when the source included files, record the file and line the text appended to the output
+   for a line of the source comes from. the lines of a macro body all come from the line using the macro */
+static void mapOutput(AssemblerContext *ctx, LineTracker *tracker, const char *text, const char *appended,
+                      size_t length, int advance)
+{
+  const char *fileName;
+  int fileLine;
+
+  if (ctx->lineMap == NULL)
+  {
+    return;
+  }
+  tracker->line += countNewlines(tracker->counted, (size_t)(text - tracker->counted));
+  tracker->counted = text;
+  fileLine = findLineOrigin(ctx->lineMap, tracker->line, &fileName);
+  addLineSpan(ctx, &ctx->expandedMap, tracker->outLines + 1, fileName, fileLine, advance);
+  tracker->outLines += countNewlines(appended, length);
+}
+
+/* end mapping: the line numbers reported from now on are those of the output */
+static void endMapping(AssemblerContext *ctx)
+{
+  if (ctx->lineMap != NULL)
+  {
+    ctx->lineMap = &ctx->expandedMap;
+  }
+}
+
+/* may be macro: check a word against the first characters and lengths of the macro names, so most
+   words are rejected without hashing them */
+static int mayBeMacro(AssemblerContext *ctx, const char *word)
+{
+  unsigned char first = (unsigned char)word[0];
+  if (!(ctx->macroInitials[first >> 3] & (1u << (first & 7))))
+  {
+    return 0;
+  }
+  return (ctx->macroLengths & lengthBit(strlen(word))) != 0;
+}
+
+/* macro parser: first macro parsing of source, expanded text is appended to out */
+void macroParser(AssemblerContext *ctx, TextBuffer *source, TextBuffer *out)
+{
+  char line[MAX_LINE];
+  char tempLine[MAX_LINE]; /* copy of the line split into words */
+  const char *text;        /* the line, inside the source */
+  size_t length;
   Macro *mc;
   int writeLine;
-  char *word, *tempLine;
-  outFile = fopen(strcat(fileName, ".am"), "w+");
-  initMacroTable();
-  hasMcr = 0;
-  if (outFile == NULL)
+  char *word, *savePtr;
+  const char *error;
+  LineTracker tracker;
+  size_t bodyStart;
+  int conditions = mentionsConditional(source->data + source->position, source->length - source->position);
+  initMacroTable(ctx);
+  applyPreludeMacros(ctx);
+  tracker.counted = source->data + source->position;
+  tracker.line = 1;
+  tracker.outLines = 0;
+  if (conditions)
   {
-    fprintf(stderr, "Failed to open output file in macroParser");
-    exit(1);
+    beginConditions(ctx); /* conditional blocks are selected here, before their macros are defined or used */
   }
 
-  while (fgets(line, MAX_LINE, fp) != NULL)
+  if (ctx->macros.count == 0 && !mentionsMcr(source) && !conditions)
   {
+    /* no macro: copy the lines that have words, as the loop below would */
+    while ((text = bufferNextLine(source, MAX_LINE - 1, &length)) != NULL)
+    {
+      ctx->linesRead++;
+      if (hasWord(text, length))
+      {
+        appendText(out, text, length);
+        mapOutput(ctx, &tracker, text, text, length, 1);
+      }
+    }
+    endMapping(ctx);
+    return;
+  }
+
+  while ((text = bufferNextLine(source, MAX_LINE - 1, &length)) != NULL)
+  {
+    ctx->linesRead++;
+    if (conditions)
+    {
+      if (processConditional(ctx, source, text, length))
+      {
+        continue;
+      }
+      noteDefinitions(ctx, text, length);
+    }
     writeLine = 1;
-    tempLine = strdup(line);
-    word = strtok(tempLine, " \t\n");
+    memcpy(tempLine, text, length);
+    tempLine[length] = '\0';
+    word = strTokR(tempLine, " \t\n", &savePtr);
 
     while (word != NULL)
     {
-      if ((mc = lookup(word)) != NULL)
+      if (mayBeMacro(ctx, word) && (mc = lookup(ctx, word)) != NULL)
       {
-        fputs(mc->content, outFile);
+        appendText(out, mc->body, mc->length);
+        mapOutput(ctx, &tracker, text, mc->body, mc->length, 0);
+        ctx->macroExpansions++;
+        if (conditions)
+        {
+          noteDefinitions(ctx, mc->body, mc->length);
+        }
       }
       else if (strcmp(word, "mcr") == 0)
       {
-        word = strtok(NULL, " \t\n");
+        word = strTokR(NULL, " \t\n", &savePtr);
 
-        if (lookup(word) != NULL)
+        error = NULL;
+        if (word == NULL)
         {
-          fprintf(stderr, "Duplicate macro name\n");
-          exit(1);
+          error = "Missing macro name";
+        }
+        else if (lookup(ctx, word) != NULL)
+        {
+          error = "Duplicate macro name";
         }
         else if (isReservedWord(word))
         {
-          fprintf(stderr, "Reserved word cannot be used as macro name\n");
-          exit(1);
+          error = "Reserved word cannot be used as macro name";
         }
 
+        if (error != NULL)
+        {
+          /* Report the error and drop the macro body, so the rest of the file is still checked */
+          memcpy(line, text, length);
+          line[length] = '\0';
+          trimLine(line);
+          ctx->lineErrorFlag = 0;
+          handleError(ctx, error, sourceLineNumber(source, source->position), line);
+          findMacroEnd(source);
+          break;
+        }
         else
         {
-          hasMcr = 1;
-          insertMacroToTable(fp, word);
-          hasMcr = 0;
+          bodyStart = source->position;
+          insertMacroToTable(ctx, source, word);
+          if (conditions && mentionsConditional(source->data + bodyStart, source->position - bodyStart))
+          {
+            /* the body is expanded after the blocks are selected, so it cannot open or close one */
+            memcpy(line, text, length);
+            line[length] = '\0';
+            trimLine(line);
+            ctx->lineErrorFlag = 0;
+            handleError(ctx, "Conditional directives cannot be used inside a macro", sourceLineNumber(source, bodyStart), line);
+          }
         }
       }
       else
       {
         if (writeLine)
         {
-          fputs(line, outFile);
+          appendText(out, text, length);
+          mapOutput(ctx, &tracker, text, text, length, 1);
           writeLine = 0;
         }
       }
-      word = strtok(NULL, " \t\n");
+      word = strTokR(NULL, " \t\n", &savePtr);
     }
   }
-
-  fclose(outFile);
+  if (conditions)
+  {
+    endConditions(ctx, source);
+  }
+  endMapping(ctx);
 }
 
-/* insert macro: insert macro to file */
-void insertMacroToTable(FILE *fp, char *macroName)
+/* find macro slot: the slot holding a name, or the empty slot where it would go. probes receives the
+   number of slots examined. the slots must be allocated */
+static unsigned long findMacroSlot(const MacroTable *table, const char *name, unsigned long hash, unsigned long *probes)
 {
-  char line[MAX_LINE];
-  char *content = NULL;
-  size_t contentLength = 0;
-  int endMcrFound = 0;
+  unsigned long slot;
+  const MacroSlot *entry;
 
-  while (!endMcrFound && fgets(line, MAX_LINE, fp) != NULL)
+  *probes = 1;
+  for (slot = hash & table->slotMask; (entry = &table->slots[slot])->macro != NULL; slot = (slot + 1) & table->slotMask)
   {
+    if (entry->hash == hash && strcmp(entry->macro->name, name) == 0)
+    {
+      break;
+    }
+    (*probes)++;
+  }
+  return slot;
+}
 
-    char *word = strtok(line, " \t");
-    while (word != NULL)
+/* reserve macro: make room for one more macro, doubling the slots when the table would be more than
+   half full. the old slots stay in the arena; they add up to less than the new ones */
+static int reserveMacro(MacroTable *table, Arena *arena)
+{
+  unsigned long slotCount = table->slots ? table->slotMask + 1 : 0;
+  unsigned long i, slot;
+  MacroSlot *slots;
+
+  if ((table->count + 1) * 2 <= slotCount)
+  {
+    return 1;
+  }
+  slotCount = slotCount ? slotCount * 2 : INITIAL_TABLE_SLOTS;
+  if ((slots = (MacroSlot *)arenaAlloc(arena, sizeof(MacroSlot) * slotCount)) == NULL)
+  {
+    return 0;
+  }
+  memset(slots, 0, sizeof(MacroSlot) * slotCount);
+  for (i = 0; table->slots != NULL && i <= table->slotMask; i++)
+  {
+    if (table->slots[i].macro != NULL)
     {
-      if (strncmp(word, "endmcr", 6) != 0)
+      slot = table->slots[i].hash & (slotCount - 1);
+      while (slots[slot].macro != NULL)
       {
-        size_t wordLength = strlen(word);
-        size_t newContentLength = contentLength + wordLength + 1;
+        slot = (slot + 1) & (slotCount - 1);
+      }
+      slots[slot] = table->slots[i];
+    }
+  }
+  table->slots = slots;
+  table->slotMask = slotCount - 1;
+  return 1;
+}
 
-        char *newContent = realloc(content, newContentLength + 1);
-        if (newContent == NULL)
-        {
-          fprintf(stderr, "Memory allocation error\n");
-          free(content);
-          return;
-        }
+/* new macro: add a macro to the table, in one block of the arena with its name and room for a body of
+   the given length. returns NULL, after reporting why, if the name is taken or memory runs out */
+static Macro *newMacro(AssemblerContext *ctx, char *name, size_t length)
+{
+  MacroTable *table = &ctx->macros;
+  struct Macro *mc;
+  size_t nameLength = strlen(name);
+  unsigned long slot, probes;
+  char message[MAX_MESSAGE_LENGTH];
 
-        content = newContent;
-        strcpy(content + contentLength, word);
+  if (lookup(ctx, name) != NULL)
+  {
+    sprintf(message, "%.80s already exists in the macro table\n", name);
+    reportMessage(ctx, message);
+    return NULL;
+  }
+  mc = (struct Macro *)arenaAlloc(&ctx->arena, sizeof(*mc) + nameLength + length + 3);
+  if (mc == NULL || !reserveMacro(table, &ctx->arena))
+  {
+    reportMessage(ctx, "Memory allocation error\n");
+    return NULL; /* Handle memory allocation failure */
+  }
+  mc->hash = hashSymbolName(name);
+  mc->nameLength = nameLength;
+  mc->name = (char *)(mc + 1);
+  memcpy(mc->name, name, nameLength + 1);
+  mc->body = mc->name + nameLength + 1;
+  mc->length = 0;
+  slot = findMacroSlot(table, name, mc->hash, &probes);
+  table->slots[slot].hash = mc->hash;
+  table->slots[slot].macro = mc;
+  table->count++;
+  ctx->macroInitials[(unsigned char)name[0] >> 3] |= (unsigned char)(1u << ((unsigned char)name[0] & 7));
+  ctx->macroLengths |= lengthBit(nameLength);
+  return mc;
+}
 
-        contentLength = newContentLength;
+/* end body: end the last line of a body with a newline if it has none, so the text after a use starts a line */
+static void endBody(Macro *mc)
+{
+  if (mc->length > 0 && mc->body[mc->length - 1] != '\n')
+  {
+    mc->body[mc->length++] = '\n';
+  }
+  mc->body[mc->length] = '\0';
+}
 
-        if (!endMcrFound)
-        {
-          content[contentLength - 1] = ' ';
-          content[contentLength] = '\0';
-        }
+/* join words: copy a body with its words separated by single spaces, as the first pass expects; a newline
+   stays at the end of its word and the next line starts with a space. the body is copied to out unless it
+   is NULL; returns its length */
+static size_t joinWords(const char *text, size_t length, char *out)
+{
+  size_t from, to = 0;
+  char last = '\0'; /* the last character of the copy */
+  int space = 0;     /* spaces were skipped since the last character of the copy */
 
-        word = strtok(NULL, " \t");
-      }
-      else
+  for (from = 0; from < length; from++)
+  {
+    if (text[from] == ' ' || text[from] == '\t')
+    {
+      space = 1;
+      continue;
+    }
+    if (to > 0 && (space || last == '\n'))
+    {
+      if (out != NULL)
       {
-        endMcrFound = 1;
-        break;
+        out[to] = ' ';
       }
+      to++;
     }
-  }
-  if (content != NULL && contentLength > 0)
-  {
-    if (content[contentLength - 1] == ' ')
+    if (out != NULL)
     {
-      content[contentLength - 1] = '\0';
+      out[to] = text[from];
     }
-    addMacro(macroName, content);
-    free(content);
+    last = text[from];
+    to++;
+    space = 0;
   }
+  return to;
 }
 
-/* hash function for macro names */
-unsigned int hashMacroName(char *name)
+/* insert macro: the body is the text of the source up to endmcr, measured and then joined into the arena */
+void insertMacroToTable(AssemblerContext *ctx, TextBuffer *source, char *macroName)
 {
-  unsigned int hashVal = 0;
-  for (; *name != '\0'; name++)
+  size_t bodyStart = source->position;
+  size_t bodyEnd = findMacroEnd(source);
+  const char *body = source->data + bodyStart;
+  size_t length;
+  Macro *mc;
+
+  while (bodyEnd > bodyStart && (source->data[bodyEnd - 1] == ' ' || source->data[bodyEnd - 1] == '\t'))
   {
-    hashVal = *name + 31 * hashVal;
+    bodyEnd--; /* the spaces before an endmcr that ends a line of the body */
+  }
+  if (bodyEnd > bodyStart)
+  {
+    length = joinWords(body, bodyEnd - bodyStart, NULL);
+    if ((mc = newMacro(ctx, macroName, length)) != NULL)
+    {
+      mc->length = joinWords(body, bodyEnd - bodyStart, mc->body);
+      endBody(mc);
+    }
   }
-  return hashVal % MACRO_TABLE_SIZE;
 }
 
 /* initialize macro table */
-void initMacroTable()
+void initMacroTable(AssemblerContext *ctx)
 {
-  int i;
-  for (i = 0; i < MACRO_TABLE_SIZE; i++)
+  MacroTable *table = &ctx->macros;
+
+  if (table->slots != NULL)
   {
-    macroTable[i] = NULL;
+    memset(table->slots, 0, sizeof(MacroSlot) * (table->slotMask + 1));
   }
+  table->count = 0;
+  table->lookups = 0;
+  table->probes = 0;
+  table->longestProbe = 0;
+  memset(ctx->macroInitials, 0, sizeof(ctx->macroInitials));
+  ctx->macroLengths = 0;
 }
 
-/* lookup: macro table lookup */
-struct Macro *lookup(char *name)
+/* lookup: macro table lookup. the names are only compared in the slots whose hash matches */
+struct Macro *lookup(AssemblerContext *ctx, char *name)
 {
-  struct Macro *mc;
-  for (mc = macroTable[hashMacroName(name)]; mc != NULL; mc = mc->next)
+  MacroTable *table = &ctx->macros;
+  unsigned long probes;
+  Macro *mc;
+
+  if (table->count == 0)
   {
-    if (strcmp(name, mc->name) == 0)
-    {
-      return mc; /* found */
-    }
+    return NULL;
   }
-  return NULL; /* not found */
+  mc = table->slots[findMacroSlot(table, name, hashSymbolName(name), &probes)].macro;
+  table->lookups++;
+  table->probes += probes;
+  if (probes > table->longestProbe)
+  {
+    table->longestProbe = probes;
+  }
+  return mc;
 }
 
-/* add macro to table */
-void addMacro(char *name, char *content)
+/* add macro to table: the body is copied as given */
+Macro *addMacro(AssemblerContext *ctx, char *name, const char *body, size_t length)
 {
-  unsigned int hashVal;
-  struct Macro *mc;
+  Macro *mc = newMacro(ctx, name, length);
 
-  if ((mc = lookup(name)) == NULL)
-  { /* not found */
-    mc = (struct Macro *)malloc(sizeof(*mc));
-    if (mc == NULL || (mc->name = strdup(name)) == NULL)
-    {
-      fprintf(stderr, "Memory allocation error\n");
-      return; /* Handle memory allocation failure */
-    }
-    mc->content = strdup(content);
-    hashVal = hashMacroName(name);
-    mc->next = macroTable[hashVal];
-    macroTable[hashVal] = mc;
-  }
-  else
+  if (mc != NULL)
   {
-    fprintf(stderr, "%s already exists in the macro table\n", name);
+    memcpy(mc->body, body, length);
+    mc->length = length;
+    endBody(mc);
   }
+  return mc;
 }
 
 /* print macro table */
 
-void printMacroTable(Macro *macroTable[])
+void printMacroTable(AssemblerContext *ctx)
 {
-  int i;
+  unsigned long i;
   Macro *mc;
   printf("Macro Table Content:\n");
-  for (i = 0; i < MACRO_TABLE_SIZE; i++)
+  for (i = 0; ctx->macros.slots != NULL && i <= ctx->macros.slotMask; i++)
   {
-    mc = macroTable[i];
-    if (mc != NULL)
+    if ((mc = ctx->macros.slots[i].macro) != NULL)
     {
-      printf("Bucket %d:\n", i);
-      while (mc != NULL)
-      {
-        printf("  Name: %s\n", mc->name);
-        printf("  Content:\n%s\n", mc->content);
-        mc = mc->next;
-      }
+      printf("Slot %lu:\n", i);
+      printf("  Name: %s\n", mc->name);
+      printf("  Content:\n%s\n", mc->body);
     }
   }
 }
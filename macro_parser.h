@@ -1,38 +1,38 @@
 #ifndef MACRO_PARSER_H
 #define MACRO_PARSER_H
 
+#include "text_buffer.h"
+#include "data.h"
+
+/* a macro is one block of the arena: the macro, then its name, then its body */
 typedef struct Macro
 {
-  char *name;
-  char *content;
-  struct Macro *next;
+  unsigned long hash; /* hash of the name */
+  size_t nameLength;  /* length of the name */
+  size_t length;      /* length of the body */
+  char *name;         /* the name, right after the macro */
+  char *body;         /* the lines of the body as written, right after the name */
 } Macro;
 
-#define MACRO_TABLE_SIZE 100
 #define MAX_LINE 1024
 
-extern Macro *macroTable[MACRO_TABLE_SIZE];
-
-/* macro parser: first parse of file for macro */
-void macroParser(FILE *, char *);
-
-/* insert macro: insert macro to file */
+/* macro parser: first parse of source for macro, expanded text is appended to the output buffer */
+void macroParser(AssemblerContext *, TextBuffer *, TextBuffer *);
 
-void insertMacroToTable(FILE *, char *);
+/* insert macro: read a macro body from the source and add it to the table */
 
-/* hash function for macro names */
-unsigned int hashMacroName(char *);
+void insertMacroToTable(AssemblerContext *, TextBuffer *, char *);
 
 /* initialize macro table */
-void initMacroTable();
+void initMacroTable(AssemblerContext *);
 
 /* macro table lookup */
-struct Macro *lookup(char *);
+struct Macro *lookup(AssemblerContext *, char *);
 
-/* add macro to table */
-void addMacro(char *, char *);
+/* add macro to table; the name and body are copied into the arena. returns the macro, or NULL */
+Macro *addMacro(AssemblerContext *, char *, const char *, size_t);
 
 /* print macro table */
-void printMacroTable(Macro **);
+void printMacroTable(AssemblerContext *);
 
 #endif
@@ -0,0 +1,334 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "object_file.h"
+
+#define ALIGN_4(offset) (((offset) + 3) / 4 * 4)
+
+/**
+ * @brief Stores a 32-bit number in little-endian order.
+ *
+ * @param out The four bytes receiving the number.
+ * @param value The number.
+ */
+static void putNumber(unsigned char *out, unsigned long value)
+{
+    out[0] = (unsigned char)(value & 0xFF);
+    out[1] = (unsigned char)(value >> 8 & 0xFF);
+    out[2] = (unsigned char)(value >> 16 & 0xFF);
+    out[3] = (unsigned char)(value >> 24 & 0xFF);
+}
+
+/**
+ * @brief Reads a 32-bit number stored in little-endian order.
+ *
+ * @param in The four bytes holding the number.
+ * @return The number.
+ */
+static unsigned long getNumber(const unsigned char *in)
+{
+    return (unsigned long)in[0] | (unsigned long)in[1] << 8 | (unsigned long)in[2] << 16 | (unsigned long)in[3] << 24;
+}
+
+/**
+ * @brief Writes the records of a symbol table and the names they refer to.
+ *
+ * Consecutive records with the same name, such as the uses of one external symbol, share a copy of it.
+ *
+ * @param base The start of the object file.
+ * @param records The offset of the table in the file.
+ * @param strings The offset of the string pool in the file.
+ * @param next The offset in the pool of the next free byte, moved past the names written.
+ * @param symbols The symbols.
+ * @param count The number of symbols.
+ */
+static void putSymbols(unsigned char *base, unsigned long records, unsigned long strings, unsigned long *next,
+                       const AsmSymbolAddress *symbols, int count)
+{
+    unsigned long nameOffset = 0;
+    size_t length;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (i == 0 || symbols[i].name != symbols[i - 1].name) /* The names of the result are interned */
+        {
+            length = strlen(symbols[i].name) + 1;
+            memcpy(base + strings + *next, symbols[i].name, length);
+            nameOffset = *next;
+            *next += length;
+        }
+        putNumber(base + records + (unsigned long)i * OBJECT_RECORD_SIZE, nameOffset);
+        putNumber(base + records + (unsigned long)i * OBJECT_RECORD_SIZE + 4, (unsigned long)symbols[i].address);
+    }
+}
+
+/**
+ * @brief Measures the names a symbol table adds to the string pool.
+ *
+ * @param symbols The symbols.
+ * @param count The number of symbols.
+ * @return The number of bytes of the names, null terminators included.
+ */
+static unsigned long measureSymbols(const AsmSymbolAddress *symbols, int count)
+{
+    unsigned long size = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (i == 0 || symbols[i].name != symbols[i - 1].name)
+        {
+            size += strlen(symbols[i].name) + 1;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Formats the output of an assembly as a binary object file.
+ *
+ * @param result The output of a successful assembly.
+ * @param out The buffer the content is appended to.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int formatObjectFile(const AsmResult *result, TextBuffer *out)
+{
+    unsigned long words = (unsigned long)(result->instructionCount + result->dataCount);
+    unsigned long entryOffset = ALIGN_4(OBJECT_HEADER_SIZE + 2 * words);
+    unsigned long externOffset = entryOffset + (unsigned long)result->entryCount * OBJECT_RECORD_SIZE;
+    unsigned long stringsOffset = externOffset + (unsigned long)result->externCount * OBJECT_RECORD_SIZE;
+    unsigned long stringsSize = measureSymbols(result->entries, result->entryCount) +
+                                measureSymbols(result->externs, result->externCount);
+    unsigned long size = stringsOffset + stringsSize;
+    unsigned long next = 0, i;
+    unsigned char *base;
+
+    if (!reserveText(out, out->length + size))
+    {
+        return 0;
+    }
+    base = (unsigned char *)out->data + out->length;
+    memset(base, 0, size);
+
+    memcpy(base, OBJECT_MAGIC, OBJECT_MAGIC_LENGTH);
+    putNumber(base + 4, OBJECT_VERSION);
+    putNumber(base + 8, (unsigned long)result->instructionCount);
+    putNumber(base + 12, (unsigned long)result->dataCount);
+    putNumber(base + 16, (unsigned long)result->baseAddress);
+    putNumber(base + 20, OBJECT_HEADER_SIZE);
+    putNumber(base + 24, entryOffset);
+    putNumber(base + 28, (unsigned long)result->entryCount);
+    putNumber(base + 32, externOffset);
+    putNumber(base + 36, (unsigned long)result->externCount);
+    putNumber(base + 40, stringsOffset);
+    putNumber(base + 44, stringsSize);
+
+    for (i = 0; i < words; i++)
+    {
+        base[OBJECT_HEADER_SIZE + 2 * i] = (unsigned char)(result->image[i] & 0xFF);
+        base[OBJECT_HEADER_SIZE + 2 * i + 1] = (unsigned char)(result->image[i] >> 8);
+    }
+    putSymbols(base, entryOffset, stringsOffset, &next, result->entries, result->entryCount);
+    putSymbols(base, externOffset, stringsOffset, &next, result->externs, result->externCount);
+
+    out->length += size;
+    out->data[out->length] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Checks that a section lies inside the file.
+ *
+ * @param size The number of bytes in the file.
+ * @param offset The offset of the section.
+ * @param count The number of items in the section.
+ * @param itemSize The number of bytes of each item.
+ * @return 1 if the section fits, 0 otherwise.
+ */
+static int sectionFits(size_t size, unsigned long offset, unsigned long count, unsigned long itemSize)
+{
+    return offset <= size && count <= (size - offset) / itemSize;
+}
+
+/**
+ * @brief Checks that every record of a symbol table names a string of the pool.
+ *
+ * @param records The table.
+ * @param count The number of records.
+ * @param stringsSize The number of bytes of the string pool.
+ * @return 1 if every name offset is inside the pool, 0 otherwise.
+ */
+static int namesFit(const unsigned char *records, unsigned long count, unsigned long stringsSize)
+{
+    unsigned long i;
+    for (i = 0; i < count; i++)
+    {
+        if (getNumber(records + i * OBJECT_RECORD_SIZE) >= stringsSize)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Validates a binary object file held in memory.
+ *
+ * @param object Receives the object file. It points into data, which must outlive it.
+ * @param data The content of the file.
+ * @param size The number of bytes in the content.
+ * @return 1 if the content is a valid object file, 0 otherwise.
+ */
+int loadObjectFile(ObjectFile *object, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long imageOffset, entryOffset, externOffset, stringsOffset, stringsSize;
+
+    memset(object, 0, sizeof(ObjectFile));
+    if (size < OBJECT_HEADER_SIZE || memcmp(bytes, OBJECT_MAGIC, OBJECT_MAGIC_LENGTH) != 0 ||
+        getNumber(bytes + 4) != OBJECT_VERSION)
+    {
+        return 0;
+    }
+    object->data = bytes;
+    object->size = size;
+    object->instructionCount = getNumber(bytes + 8);
+    object->dataCount = getNumber(bytes + 12);
+    object->baseAddress = getNumber(bytes + 16);
+    imageOffset = getNumber(bytes + 20);
+    entryOffset = getNumber(bytes + 24);
+    object->entryCount = getNumber(bytes + 28);
+    externOffset = getNumber(bytes + 32);
+    object->externCount = getNumber(bytes + 36);
+    stringsOffset = getNumber(bytes + 40);
+    stringsSize = getNumber(bytes + 44);
+
+    if (imageOffset % 2 != 0 || entryOffset % 4 != 0 || externOffset % 4 != 0 ||
+        object->instructionCount > (unsigned long)-1 - object->dataCount ||
+        !sectionFits(size, imageOffset, object->instructionCount + object->dataCount, 2) ||
+        !sectionFits(size, entryOffset, object->entryCount, OBJECT_RECORD_SIZE) ||
+        !sectionFits(size, externOffset, object->externCount, OBJECT_RECORD_SIZE) ||
+        !sectionFits(size, stringsOffset, stringsSize, 1) ||
+        (stringsSize > 0 && bytes[stringsOffset + stringsSize - 1] != '\0') || /* The last name is terminated */
+        !namesFit(bytes + entryOffset, object->entryCount, stringsSize) ||
+        !namesFit(bytes + externOffset, object->externCount, stringsSize))
+    {
+        memset(object, 0, sizeof(ObjectFile));
+        return 0;
+    }
+    object->image = bytes + imageOffset;
+    object->entries = bytes + entryOffset;
+    object->externs = bytes + externOffset;
+    object->strings = (const char *)bytes + stringsOffset;
+    return 1;
+}
+
+/**
+ * @brief Maps a binary object file into memory and validates it.
+ *
+ * @param object Receives the object file. Release it with closeObjectFile.
+ * @param fileName The name of the file.
+ * @return 1 on success, 0 if the file could not be mapped or is not a valid object file.
+ */
+int openObjectFile(ObjectFile *object, const char *fileName)
+{
+    struct stat info;
+    void *data;
+    int fd;
+
+    memset(object, 0, sizeof(ObjectFile));
+    if ((fd = open(fileName, O_RDONLY)) < 0)
+    {
+        return 0;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size < OBJECT_HEADER_SIZE)
+    {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping stays valid after the file is closed */
+    if (data == MAP_FAILED)
+    {
+        return 0;
+    }
+    if (!loadObjectFile(object, data, (size_t)info.st_size))
+    {
+        munmap(data, (size_t)info.st_size);
+        return 0;
+    }
+    object->mapped = 1;
+    return 1;
+}
+
+/**
+ * @brief Releases an object file opened with openObjectFile.
+ *
+ * @param object The object file.
+ */
+void closeObjectFile(ObjectFile *object)
+{
+    if (object->mapped)
+    {
+        munmap((void *)object->data, object->size);
+    }
+    memset(object, 0, sizeof(ObjectFile));
+}
+
+/**
+ * @brief Reads a word of the memory image.
+ *
+ * @param object The object file.
+ * @param index The index of the word, below IC + DC.
+ * @return The word.
+ */
+unsigned int objectWord(const ObjectFile *object, unsigned long index)
+{
+    return (unsigned int)object->image[2 * index] | (unsigned int)object->image[2 * index + 1] << 8;
+}
+
+/**
+ * @brief Reads a record of a symbol table.
+ *
+ * @param object The object file.
+ * @param record The record.
+ * @return The name, inside the string pool, and the address of the record.
+ */
+static AsmSymbolAddress readRecord(const ObjectFile *object, const unsigned char *record)
+{
+    AsmSymbolAddress symbol;
+    symbol.name = object->strings + getNumber(record);
+    symbol.address = (int)getNumber(record + 4);
+    return symbol;
+}
+
+/**
+ * @brief Reads an entry symbol.
+ *
+ * @param object The object file.
+ * @param index The index of the entry, below entryCount.
+ * @return The name of the symbol, inside the string pool, and its address.
+ */
+AsmSymbolAddress objectEntry(const ObjectFile *object, unsigned long index)
+{
+    return readRecord(object, object->entries + index * OBJECT_RECORD_SIZE);
+}
+
+/**
+ * @brief Reads a use of an external symbol.
+ *
+ * @param object The object file.
+ * @param index The index of the use, below externCount.
+ * @return The name of the symbol, inside the string pool, and the address of the word using it.
+ */
+AsmSymbolAddress objectExtern(const ObjectFile *object, unsigned long index)
+{
+    return readRecord(object, object->externs + index * OBJECT_RECORD_SIZE);
+}
@@ -0,0 +1,108 @@
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+#include <stddef.h>
+
+#include "libassembler.h"
+#include "text_buffer.h"
+
+/* Layout of a binary object file. Every number is little-endian; offsets are from the start of the file.
+ *
+ *   0  magic "ASOB"             24  entry table offset (4 bytes)
+ *   4  version (4 bytes)        28  number of entries (4 bytes)
+ *   8  IC (4 bytes)             32  extern table offset (4 bytes)
+ *  12  DC (4 bytes)             36  number of extern uses (4 bytes)
+ *  16  base address (4 bytes)   40  string pool offset (4 bytes)
+ *  20  image offset (4 bytes)   44  string pool size (4 bytes)
+ *
+ * The image is IC + DC 16-bit words. Each record of the entry and extern tables is the offset of a
+ * null-terminated name in the string pool and an address, 4 bytes each. The tables are aligned to 4 bytes. */
+#define OBJECT_MAGIC "ASOB"
+#define OBJECT_MAGIC_LENGTH 4
+#define OBJECT_VERSION 1
+#define OBJECT_HEADER_SIZE 48
+#define OBJECT_RECORD_SIZE 8
+
+/* A validated binary object file. The tables are read in place, without copying or parsing. */
+typedef struct ObjectFile
+{
+    const unsigned char *data;      /* The content of the file */
+    size_t size;                    /* Number of bytes in the content */
+    int mapped;                     /* Nonzero if data is a mapping owned by the object */
+    unsigned long instructionCount; /* Number of instruction words (IC) */
+    unsigned long dataCount;        /* Number of data words (DC) */
+    unsigned long baseAddress;      /* Address of the first word of the image */
+    unsigned long entryCount;       /* Number of entry symbols */
+    unsigned long externCount;      /* Number of uses of external symbols */
+    const unsigned char *image;     /* The memory image */
+    const unsigned char *entries;   /* The entry table */
+    const unsigned char *externs;   /* The extern table */
+    const char *strings;            /* The string pool */
+} ObjectFile;
+
+/**
+ * @brief Formats the output of an assembly as a binary object file.
+ *
+ * @param result The output of a successful assembly.
+ * @param out The buffer the content is appended to.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int formatObjectFile(const AsmResult *result, TextBuffer *out);
+
+/**
+ * @brief Validates a binary object file held in memory.
+ *
+ * The header, the bounds of every section and every name offset are checked, so the accessors
+ * below need no further checks.
+ *
+ * @param object Receives the object file. It points into data, which must outlive it.
+ * @param data The content of the file.
+ * @param size The number of bytes in the content.
+ * @return 1 if the content is a valid object file, 0 otherwise.
+ */
+int loadObjectFile(ObjectFile *object, const void *data, size_t size);
+
+/**
+ * @brief Maps a binary object file into memory and validates it.
+ *
+ * @param object Receives the object file. Release it with closeObjectFile.
+ * @param fileName The name of the file.
+ * @return 1 on success, 0 if the file could not be mapped or is not a valid object file.
+ */
+int openObjectFile(ObjectFile *object, const char *fileName);
+
+/**
+ * @brief Releases an object file opened with openObjectFile.
+ *
+ * @param object The object file.
+ */
+void closeObjectFile(ObjectFile *object);
+
+/**
+ * @brief Reads a word of the memory image.
+ *
+ * @param object The object file.
+ * @param index The index of the word, below IC + DC.
+ * @return The word.
+ */
+unsigned int objectWord(const ObjectFile *object, unsigned long index);
+
+/**
+ * @brief Reads an entry symbol.
+ *
+ * @param object The object file.
+ * @param index The index of the entry, below entryCount.
+ * @return The name of the symbol, inside the string pool, and its address.
+ */
+AsmSymbolAddress objectEntry(const ObjectFile *object, unsigned long index);
+
+/**
+ * @brief Reads a use of an external symbol.
+ *
+ * @param object The object file.
+ * @param index The index of the use, below externCount.
+ * @return The name of the symbol, inside the string pool, and the address of the word using it.
+ */
+AsmSymbolAddress objectExtern(const ObjectFile *object, unsigned long index);
+
+#endif /* OBJECT_FILE_H */
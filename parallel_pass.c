@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "parallel_pass.h"
+#include "first_pass.h"
+#include "job_pool.h"
+#include "lexer.h"
+#include "utils.h"
+#include "prelude.h"
+
+/* A chunk of the source, with the context it is read into */
+typedef struct PassChunk
+{
+    AssemblerContext *ctx;         /* The context the chunk is read into */
+    TextBuffer text;               /* The lines of the chunk, inside the source */
+    int firstLine;                 /* Number of lines before the chunk */
+    const Symbol *constants;       /* The constants defined before the chunk, in the order they were defined */
+    int constantCount;             /* Number of constants */
+    int instructionOffset;         /* Instruction words of the chunks before this one */
+    int dataOffset;                /* Data words of the chunks before this one */
+} PassChunk;
+
+/**
+ * @brief Adds the constant defined by a line, if it defines one, to the constants found so far.
+ *
+ * Only the lines a chunk cannot do without are read: a constant may be used by any line after it, even
+ * in a later chunk.
+ *
+ * @param constants The context collecting the constants.
+ * @param text The line, inside the source.
+ * @param length Number of characters of the line, newline included.
+ * @param lineNum The number of the line.
+ */
+static void collectConstant(AssemblerContext *constants, const char *text, size_t length, int lineNum)
+{
+    char line[MAX_LINE_LENGTH];
+    LineTokens tokens;
+    size_t i = 0;
+
+    while (i < length && isspace((unsigned char)text[i]))
+    {
+        i++;
+    }
+    if (i == length || text[i] != '.' || length - (text[length - 1] == '\n') > MAX_LINE_LENGTH - 2)
+    {
+        return; /* Not a directive, or too long to be read */
+    }
+    memcpy(line, text, length);
+    line[length] = '\0';
+    trimLine(line);
+    tokenizeLine(line, &tokens);
+    constants->lineNum = lineNum;
+    constants->lineErrorFlag = 0;
+    if (classifyLine(constants, &tokens, 0) == LINE_DEFINITION)
+    {
+        processDefinition(constants, line);
+    }
+}
+
+/**
+ * @brief Splits the source into chunks that start at the beginning of a line.
+ *
+ * The chunks are about the same size. The constants each chunk starts with are collected on the way.
+ *
+ * @param source The source text.
+ * @param chunks Receives the chunks.
+ * @param count The number of chunks wanted.
+ * @param constants The context collecting the constants.
+ * @return The number of chunks, which is less than count when the lines are too long to split further.
+ */
+static int splitSource(TextBuffer *source, PassChunk *chunks, int count, AssemblerContext *constants)
+{
+    TextBuffer reader = *source;
+    size_t target = source->length / count; /* Characters in a chunk */
+    size_t start = 0;                        /* Start of the current chunk */
+    const char *text;
+    size_t length;
+    int chunk = 0, lines = 0;
+
+    reader.position = 0;
+    memset(chunks, 0, sizeof(PassChunk) * count);
+    chunks[0].constantCount = constants->symbolTable.count; /* The constants of the prelude */
+    while ((text = bufferNextLine(&reader, reader.length, &length)) != NULL)
+    {
+        collectConstant(constants, text, length, ++lines);
+        if (chunk + 1 < count && reader.position >= (chunk + 1) * target && reader.position < reader.length)
+        {
+            chunks[chunk].text.data = source->data + start;
+            chunks[chunk].text.length = reader.position - start;
+            start = reader.position;
+            chunk++;
+            chunks[chunk].firstLine = lines;
+            chunks[chunk].constantCount = constants->symbolTable.count;
+        }
+    }
+    chunks[chunk].text.data = source->data + start;
+    chunks[chunk].text.length = source->length - start;
+    return chunk + 1;
+}
+
+/**
+ * @brief Reads a chunk into its context, starting from the constants defined before it.
+ *
+ * @param job The PassChunk to read.
+ */
+static void readChunk(void *job)
+{
+    PassChunk *chunk = (PassChunk *)job;
+    AssemblerContext *ctx = chunk->ctx;
+    int i;
+
+    initSymbolTable(ctx);
+    initMemoryImage(ctx);
+    for (i = 0; i < chunk->constantCount; i++)
+    {
+        addSymbol(ctx, chunk->constants[i].symbolName, mdefine, chunk->constants[i].value);
+    }
+    ctx->symbolLookups = 0;
+    ctx->lineNum = chunk->firstLine;
+    firstPassLines(ctx, &chunk->text);
+}
+
+/**
+ * @brief Checks whether a name is a symbol defined by one of the chunks before a chunk.
+ *
+ * The constants a chunk starts with are not its own: they belong to the chunk that defined them.
+ *
+ * @param chunks The chunks.
+ * @param count The number of chunks before the chunk.
+ * @param name The name to look for.
+ * @return 1 if an earlier chunk defines the name, 0 otherwise.
+ */
+static int definedBefore(PassChunk *chunks, int count, const char *name)
+{
+    Symbol *symbol;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        symbol = findSymbol(&chunks[i].ctx->symbolTable, name); /* Not a lookup of the assembly itself */
+        if (symbol != NULL && symbol - chunks[i].ctx->symbolTable.symbols >= chunks[i].constantCount)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks whether an .entry directive of one of the chunks before a chunk declares a name.
+ *
+ * @param chunks The chunks.
+ * @param count The number of chunks before the chunk.
+ * @param name The name to look for.
+ * @return 1 if an earlier chunk declares the name as an entry, 0 otherwise.
+ */
+static int enteredBefore(PassChunk *chunks, int count, const char *name)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (isEntryLabel(chunks[i].ctx, (char *)name))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks that the chunks read on their own give what a single pass would, and places them.
+ *
+ * A chunk must have no errors, must not redefine a symbol or an entry of an earlier chunk, and must not
+ * have looked up a label an earlier chunk defines. The offsets of the chunks in the image are set on the way.
+ *
+ * @param chunks The chunks, once read.
+ * @param count The number of chunks.
+ * @return 1 if the chunks can be merged, 0 if the source must be read by a single pass.
+ */
+static int chunksAgree(PassChunk *chunks, int count)
+{
+    AssemblerContext *ctx;
+    const Symbol *symbol;
+    const MissedName *missed;
+    int i, k, instructions = 0, dataWords = 0;
+    unsigned long slot;
+
+    for (k = 0; k < count; k++)
+    {
+        ctx = chunks[k].ctx;
+        if (ctx->errorFlag || ctx->diagnostics.length > 0 || ctx->chunkConflict)
+        {
+            return 0;
+        }
+        for (i = 0; i < ctx->symbolTable.count; i++)
+        {
+            symbol = &ctx->symbolTable.symbols[i];
+            if (i < chunks[k].constantCount)
+            {
+                if (symbol->symbolType != mdefine)
+                {
+                    return 0; /* An .extern directive redeclared a constant */
+                }
+            }
+            else if (definedBefore(chunks, k, symbol->symbolName) ||
+                     (symbol->symbolType == external && enteredBefore(chunks, k, symbol->symbolName)))
+            {
+                return 0;
+            }
+        }
+        for (missed = ctx->missedNames; missed != NULL; missed = missed->next)
+        {
+            if (definedBefore(chunks, k, missed->name))
+            {
+                return 0;
+            }
+        }
+        for (slot = 0; ctx->names.slots != NULL && slot <= ctx->names.slotMask; slot++)
+        {
+            if (ctx->names.entries[slot] && enteredBefore(chunks, k, ctx->names.slots[slot]))
+            {
+                return 0;
+            }
+        }
+        chunks[k].instructionOffset = instructions;
+        chunks[k].dataOffset = dataWords;
+        instructions += ctx->IC;
+        dataWords += ctx->DC;
+    }
+    return instructions + dataWords < MAX_DATA;
+}
+
+/**
+ * @brief Merges the chunks into the context, in order, as if a single pass had read them.
+ *
+ * Instruction words move up by the instruction words of the chunks before them. A data word goes where
+ * a single pass would have stored it, after the instructions known at the time; words later covered by
+ * instructions are dropped, as they would have been overwritten.
+ *
+ * @param ctx The assembler context.
+ * @param chunks The chunks, once checked.
+ * @param count The number of chunks.
+ */
+static void mergeChunks(AssemblerContext *ctx, PassChunk *chunks, int count)
+{
+    AssemblerContext *chunk;
+    const Symbol *symbol;
+    const QueuedEntry *queued;
+    const FixupChain *chain;
+    const Fixup *fixup;
+    int i, k, instructions, dataWords, address, offset;
+    unsigned long slot;
+
+    ctx->IC = 0;
+    ctx->DC = 0;
+    initSymbolTable(ctx);
+    initMemoryImage(ctx);
+    applyPreludeConstants(ctx);
+    instructions = chunks[count - 1].instructionOffset + chunks[count - 1].ctx->IC;
+    dataWords = chunks[count - 1].dataOffset + chunks[count - 1].ctx->DC;
+
+    for (k = 0; k < count; k++)
+    {
+        chunk = chunks[k].ctx;
+        memcpy(ctx->image + chunks[k].instructionOffset, chunk->image, sizeof(Word) * chunk->IC);
+        memcpy(ctx->wordTypes + chunks[k].instructionOffset, chunk->wordTypes, chunk->IC);
+        for (i = 0; i < chunk->DC; i++)
+        {
+            address = chunks[k].instructionOffset + chunk->dataLog[i].IC + chunks[k].dataOffset + i;
+            if (address >= instructions)
+            {
+                ctx->image[address] = chunk->dataLog[i].value;
+            }
+        }
+        for (i = chunks[k].constantCount; i < chunk->symbolTable.count; i++)
+        {
+            symbol = &chunk->symbolTable.symbols[i];
+            offset = 0;
+            if (symbol->symbolType == code)
+            {
+                offset = chunks[k].instructionOffset;
+            }
+            else if (symbol->symbolType == data)
+            {
+                offset = chunks[k].dataOffset;
+            }
+            addSymbolUncounted(ctx, symbol->symbolName, symbol->symbolType, symbol->value + offset);
+        }
+        for (slot = 0; chunk->names.slots != NULL && slot <= chunk->names.slotMask; slot++)
+        {
+            if (chunk->names.entries[slot])
+            {
+                addEntryLabel(ctx, chunk->names.slots[slot]);
+            }
+        }
+        for (queued = chunk->entryQueue; queued != NULL; queued = queued->next)
+        {
+            queueEntry(ctx, queued->name, queued->lineNum);
+        }
+        for (chain = chunk->fixupChains; chain != NULL; chain = chain->next)
+        {
+            for (fixup = chain->fixups; fixup != NULL; fixup = fixup->next)
+            {
+                addFixup(ctx, fixup->address + chunks[k].instructionOffset, chain->symbol);
+            }
+        }
+        ctx->instructionLines += chunk->instructionLines;
+        ctx->symbolLookups += chunk->symbolLookups;
+    }
+    ctx->IC = instructions;
+    ctx->DC = dataWords;
+    ctx->lineNum = chunks[count - 1].ctx->lineNum;
+    ctx->lineErrorFlag = 0;
+    updateSymbolValues(ctx);
+}
+
+/**
+ * @brief Performs the first pass over line-aligned chunks of the source, read at the same time.
+ *
+ * @param ctx The assembler context.
+ * @param source The macro-expanded source text.
+ * @param threadCount The number of threads to read the chunks on.
+ */
+void parallelFirstPass(AssemblerContext *ctx, TextBuffer *source, int threadCount)
+{
+    PassChunk chunks[MAX_PASS_CHUNKS];
+    AssemblerContext *constants;
+    int count = threadCount, i, ready, merged = 0;
+
+    if ((size_t)count > source->length / PASS_CHUNK_MIN_SIZE)
+    {
+        count = (int)(source->length / PASS_CHUNK_MIN_SIZE);
+    }
+    if (count > MAX_PASS_CHUNKS)
+    {
+        count = MAX_PASS_CHUNKS;
+    }
+    if (count < 2 || (constants = createAssemblerContext()) == NULL)
+    {
+        firstPass(ctx, source);
+        return;
+    }
+
+    constants->prelude = ctx->prelude;
+    initSymbolTable(constants);
+    applyPreludeConstants(constants);
+    count = splitSource(source, chunks, count, constants);
+    for (i = 0, ready = count > 1; i < count; i++)
+    {
+        chunks[i].constants = constants->symbolTable.symbols;
+        chunks[i].firstLine += ctx->lineNum;
+        if ((chunks[i].ctx = createAssemblerContext()) == NULL)
+        {
+            ready = 0;
+            continue;
+        }
+        /* A line stores at most one data word per character, so the characters of the chunk bound its data */
+        chunks[i].ctx->dataLogCapacity = chunks[i].text.length < MAX_DATA ? (int)chunks[i].text.length : MAX_DATA;
+        if ((chunks[i].ctx->dataLog = malloc(sizeof(DataWord) * chunks[i].ctx->dataLogCapacity)) == NULL)
+        {
+            ready = 0;
+        }
+        chunks[i].ctx->chunked = i > 0;
+    }
+    if (ready)
+    {
+        runJobs(chunks, sizeof(PassChunk), count, count, readChunk);
+        if (chunksAgree(chunks, count))
+        {
+            mergeChunks(ctx, chunks, count);
+            merged = 1;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (chunks[i].ctx != NULL)
+        {
+            free(chunks[i].ctx->dataLog);
+            destroyAssemblerContext(chunks[i].ctx);
+        }
+    }
+    destroyAssemblerContext(constants);
+    if (!merged)
+    {
+        firstPass(ctx, source);
+    }
+}
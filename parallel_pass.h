@@ -0,0 +1,26 @@
+#ifndef PARALLEL_PASS_H
+#define PARALLEL_PASS_H
+
+#include "data.h"
+#include "text_buffer.h"
+
+#define MAX_PASS_CHUNKS 64         /* Most chunks a source is split into */
+#define PASS_CHUNK_MIN_SIZE 16384  /* Fewest characters worth a chunk of its own */
+
+/**
+ * @brief Performs the first pass over line-aligned chunks of the source, read at the same time.
+ *
+ * Each chunk is read into a context of its own, counting its instructions and data from zero. The
+ * chunks are then merged in order: a prefix sum of their counters gives each chunk its place in the
+ * image, and the labels of each chunk are checked against those of the chunks before it. The result is
+ * the one firstPass would give. A source that is too small to split, a chunk with errors or a chunk that
+ * needs a label of another chunk to be read is read again by firstPass, so the messages come out as
+ * they would from a single pass.
+ *
+ * @param ctx The assembler context.
+ * @param source The macro-expanded source text.
+ * @param threadCount The number of threads to read the chunks on.
+ */
+void parallelFirstPass(AssemblerContext *ctx, TextBuffer *source, int threadCount);
+
+#endif /* PARALLEL_PASS_H */
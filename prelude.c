@@ -0,0 +1,400 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prelude.h"
+#include "macro_parser.h"
+#include "first_pass.h"
+#include "utils.h"
+
+#define PRELUDE_RECORD_SIZE 8
+
+/**
+ * @brief Stores a 32-bit number in little-endian order.
+ *
+ * @param out The four bytes receiving the number.
+ * @param value The number.
+ */
+static void putNumber(unsigned char *out, unsigned long value)
+{
+    out[0] = (unsigned char)(value & 0xFF);
+    out[1] = (unsigned char)(value >> 8 & 0xFF);
+    out[2] = (unsigned char)(value >> 16 & 0xFF);
+    out[3] = (unsigned char)(value >> 24 & 0xFF);
+}
+
+/**
+ * @brief Reads a 32-bit number stored in little-endian order.
+ *
+ * @param in The four bytes holding the number.
+ * @return The number.
+ */
+static unsigned long getNumber(const unsigned char *in)
+{
+    return (unsigned long)in[0] | (unsigned long)in[1] << 8 | (unsigned long)in[2] << 16 | (unsigned long)in[3] << 24;
+}
+
+/**
+ * @brief Computes the hash a snapshot records of its prelude source.
+ *
+ * @param source The prelude source.
+ * @param length The number of characters in the source.
+ * @param hash Buffer of at least PRELUDE_HASH_LENGTH + 1 characters receiving the hash.
+ */
+void hashPrelude(const char *source, size_t length, char hash[])
+{
+    Sha256 sha;
+    sha256Init(&sha);
+    sha256Update(&sha, source, length);
+    sha256FinalHex(&sha, hash);
+}
+
+/**
+ * @brief Checks that an assembled prelude defined nothing but macros and constants.
+ *
+ * @param ctx The context that assembled the prelude.
+ * @return 1 if the prelude emitted no words, defined no labels and declared no entries, 0 otherwise.
+ */
+static int definesOnly(const AssemblerContext *ctx)
+{
+    int i;
+
+    if (ctx->IC != 0 || ctx->DC != 0 || ctx->entryQueue != NULL)
+    {
+        return 0;
+    }
+    for (i = 0; i < ctx->symbolTable.count; i++)
+    {
+        if (ctx->symbolTable.symbols[i].symbolType != mdefine)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Appends a record to a snapshot: two numbers, a name with its null terminator, then a body.
+ *
+ * @param out The snapshot, with room reserved for the record.
+ * @param name The name.
+ * @param nameLength The number of characters in the name.
+ * @param second The second number of the record.
+ * @param body The body, or NULL if the record has none.
+ * @param bodyLength The number of characters in the body.
+ */
+static void putRecord(TextBuffer *out, const char *name, size_t nameLength, unsigned long second,
+                      const char *body, size_t bodyLength)
+{
+    unsigned char *base = (unsigned char *)out->data + out->length;
+
+    putNumber(base, (unsigned long)nameLength);
+    putNumber(base + 4, second);
+    memcpy(base + PRELUDE_RECORD_SIZE, name, nameLength + 1);
+    if (body != NULL)
+    {
+        memcpy(base + PRELUDE_RECORD_SIZE + nameLength + 1, body, bodyLength);
+    }
+    out->length += PRELUDE_RECORD_SIZE + nameLength + 1 + bodyLength;
+}
+
+/**
+ * @brief Formats the macros and constants of an assembled prelude as a snapshot.
+ *
+ * @param ctx The context that assembled the prelude.
+ * @param hash The hash of the prelude source.
+ * @param out The buffer the snapshot is appended to.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+static int formatPrelude(const AssemblerContext *ctx, const char *hash, TextBuffer *out)
+{
+    const MacroTable *macros = &ctx->macros;
+    const Macro *mc;
+    const Symbol *symbol;
+    size_t size = PRELUDE_HEADER_SIZE;
+    unsigned long slot;
+    unsigned char *base;
+    int i;
+
+    for (slot = 0; macros->slots != NULL && slot <= macros->slotMask; slot++)
+    {
+        if ((mc = macros->slots[slot].macro) != NULL)
+        {
+            size += PRELUDE_RECORD_SIZE + mc->nameLength + 1 + mc->length;
+        }
+    }
+    for (i = 0; i < ctx->symbolTable.count; i++)
+    {
+        size += PRELUDE_RECORD_SIZE + strlen(ctx->symbolTable.symbols[i].symbolName) + 1;
+    }
+    if (!reserveText(out, out->length + size))
+    {
+        return 0;
+    }
+
+    base = (unsigned char *)out->data + out->length;
+    memset(base, 0, PRELUDE_HEADER_SIZE);
+    memcpy(base, PRELUDE_MAGIC, PRELUDE_MAGIC_LENGTH);
+    putNumber(base + 4, PRELUDE_VERSION);
+    memcpy(base + 8, ASM_VERSION, sizeof(ASM_VERSION));
+    memcpy(base + 24, hash, PRELUDE_HASH_LENGTH);
+    putNumber(base + 88, macros->count);
+    putNumber(base + 92, (unsigned long)ctx->symbolTable.count);
+    out->length += PRELUDE_HEADER_SIZE;
+
+    for (slot = 0; macros->slots != NULL && slot <= macros->slotMask; slot++)
+    {
+        if ((mc = macros->slots[slot].macro) != NULL)
+        {
+            putRecord(out, mc->name, mc->nameLength, (unsigned long)mc->length, mc->body, mc->length);
+        }
+    }
+    for (i = 0; i < ctx->symbolTable.count; i++) /* In the order they were defined */
+    {
+        symbol = &ctx->symbolTable.symbols[i];
+        putRecord(out, symbol->symbolName, strlen(symbol->symbolName), (unsigned long)symbol->value, NULL, 0);
+    }
+    out->data[out->length] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Assembles a prelude source into a snapshot.
+ *
+ * The prelude goes through comment stripping, macro expansion and the first pass like any source, so
+ * its definitions are checked the same way.
+ *
+ * @param source The prelude source.
+ * @param length The number of characters in the source.
+ * @param hash The hash of the source, from hashPrelude.
+ * @param snapshot The buffer the snapshot is appended to.
+ * @param diagnostics The buffer the error messages are appended to.
+ * @return 1 on success, 0 if the prelude has errors or memory allocation failed.
+ */
+int buildPrelude(const char *source, size_t length, const char *hash, TextBuffer *snapshot, TextBuffer *diagnostics)
+{
+    AssemblerContext *ctx;
+    TextBuffer stripped, expanded;
+    int ok;
+
+    if ((ctx = createAssemblerContext()) == NULL)
+    {
+        appendString(diagnostics, "Memory allocation failed\n");
+        return 0;
+    }
+    initTextBuffer(&stripped);
+    initTextBuffer(&expanded);
+    stripComments(source, length, 0, &stripped);
+    macroParser(ctx, &stripped, &expanded);
+    if (!ctx->errorFlag)
+    {
+        firstPass(ctx, &expanded);
+    }
+    if (!ctx->errorFlag && !definesOnly(ctx))
+    {
+        reportMessage(ctx, "The prelude may only define macros and constants\n");
+        ctx->errorFlag = 1;
+    }
+    if (!ctx->errorFlag && !formatPrelude(ctx, hash, snapshot))
+    {
+        reportMessage(ctx, "Memory allocation failed\n");
+        ctx->errorFlag = 1;
+    }
+    ok = !ctx->errorFlag;
+    if (ctx->diagnostics.length > 0)
+    {
+        appendText(diagnostics, ctx->diagnostics.data, ctx->diagnostics.length);
+    }
+
+    freeTextBuffer(&stripped);
+    freeTextBuffer(&expanded);
+    destroyAssemblerContext(ctx);
+    return ok;
+}
+
+/**
+ * @brief Checks the records of a snapshot and finds where they end.
+ *
+ * @param data The first record.
+ * @param size The number of bytes left in the snapshot.
+ * @param count The number of records.
+ * @param withBody Nonzero if the second number of each record is the length of a body that follows the name.
+ * @return The number of bytes of the records, or size + 1 if they do not fit or a name is malformed.
+ */
+static size_t checkRecords(const unsigned char *data, size_t size, unsigned long count, int withBody)
+{
+    size_t offset = 0;
+    unsigned long i, nameLength, bodyLength;
+
+    for (i = 0; i < count; i++)
+    {
+        if (size - offset < PRELUDE_RECORD_SIZE)
+        {
+            return size + 1;
+        }
+        nameLength = getNumber(data + offset);
+        bodyLength = withBody ? getNumber(data + offset + 4) : 0;
+        offset += PRELUDE_RECORD_SIZE;
+        if (nameLength == 0 || nameLength >= size - offset || bodyLength > size - offset - nameLength - 1 ||
+            data[offset + nameLength] != '\0' || memchr(data + offset, '\0', nameLength) != NULL)
+        {
+            return size + 1;
+        }
+        offset += nameLength + 1 + bodyLength;
+    }
+    return offset;
+}
+
+/**
+ * @brief Validates a prelude snapshot held in memory.
+ *
+ * @param prelude Receives the prelude. It points into data, which must outlive it.
+ * @param data The content of the snapshot.
+ * @param size The number of bytes in the content.
+ * @param hash The hash of the prelude source the snapshot must have been built from.
+ * @return 1 if the content is a valid snapshot of this version of the assembler and of that source, 0 otherwise.
+ */
+int loadPrelude(Prelude *prelude, const void *data, size_t size, const char *hash)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t macroSize, constantSize;
+
+    memset(prelude, 0, sizeof(Prelude));
+    if (size < PRELUDE_HEADER_SIZE || memcmp(bytes, PRELUDE_MAGIC, PRELUDE_MAGIC_LENGTH) != 0 ||
+        getNumber(bytes + 4) != PRELUDE_VERSION ||
+        strncmp((const char *)bytes + 8, ASM_VERSION, PRELUDE_VERSION_LENGTH) != 0 ||
+        memcmp(bytes + 24, hash, PRELUDE_HASH_LENGTH) != 0)
+    {
+        return 0;
+    }
+    prelude->macroCount = getNumber(bytes + 88);
+    prelude->constantCount = getNumber(bytes + 92);
+    macroSize = checkRecords(bytes + PRELUDE_HEADER_SIZE, size - PRELUDE_HEADER_SIZE, prelude->macroCount, 1);
+    if (macroSize > size - PRELUDE_HEADER_SIZE)
+    {
+        memset(prelude, 0, sizeof(Prelude));
+        return 0;
+    }
+    constantSize = checkRecords(bytes + PRELUDE_HEADER_SIZE + macroSize, size - PRELUDE_HEADER_SIZE - macroSize,
+                                prelude->constantCount, 0);
+    if (constantSize != size - PRELUDE_HEADER_SIZE - macroSize) /* Nothing follows the records */
+    {
+        memset(prelude, 0, sizeof(Prelude));
+        return 0;
+    }
+    prelude->data = bytes;
+    prelude->size = size;
+    prelude->macros = bytes + PRELUDE_HEADER_SIZE;
+    prelude->constants = bytes + PRELUDE_HEADER_SIZE + macroSize;
+    memcpy(prelude->hash, hash, PRELUDE_HASH_LENGTH);
+    prelude->hash[PRELUDE_HASH_LENGTH] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Maps a prelude snapshot into memory and validates it.
+ *
+ * @param prelude Receives the prelude. Release it with closePrelude.
+ * @param fileName The name of the snapshot.
+ * @param hash The hash of the prelude source the snapshot must have been built from.
+ * @return 1 on success, 0 if the file could not be mapped, is not a valid snapshot or is out of date.
+ */
+int openPrelude(Prelude *prelude, const char *fileName, const char *hash)
+{
+    struct stat info;
+    void *data;
+    int fd;
+
+    memset(prelude, 0, sizeof(Prelude));
+    if ((fd = open(fileName, O_RDONLY)) < 0)
+    {
+        return 0;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size < PRELUDE_HEADER_SIZE)
+    {
+        close(fd);
+        return 0;
+    }
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping stays valid after the file is closed */
+    if (data == MAP_FAILED)
+    {
+        return 0;
+    }
+    if (!loadPrelude(prelude, data, (size_t)info.st_size, hash))
+    {
+        munmap(data, (size_t)info.st_size);
+        return 0;
+    }
+    prelude->mapped = 1;
+    return 1;
+}
+
+/**
+ * @brief Releases a prelude opened with openPrelude.
+ *
+ * @param prelude The prelude.
+ */
+void closePrelude(Prelude *prelude)
+{
+    if (prelude->mapped)
+    {
+        munmap((void *)prelude->data, prelude->size);
+    }
+    memset(prelude, 0, sizeof(Prelude));
+}
+
+/**
+ * @brief Adds the macros of the prelude of a context, if it has one, to its macro table.
+ *
+ * The bodies are stored expanded, so they are copied as they are.
+ *
+ * @param ctx The assembler context, with an empty macro table.
+ */
+void applyPreludeMacros(AssemblerContext *ctx)
+{
+    const unsigned char *record;
+    unsigned long i, nameLength, bodyLength;
+
+    if (ctx->prelude == NULL)
+    {
+        return;
+    }
+    record = ctx->prelude->macros;
+    for (i = 0; i < ctx->prelude->macroCount; i++)
+    {
+        nameLength = getNumber(record);
+        bodyLength = getNumber(record + 4);
+        addMacro(ctx, (char *)record + PRELUDE_RECORD_SIZE, (const char *)record + PRELUDE_RECORD_SIZE + nameLength + 1,
+                 bodyLength);
+        record += PRELUDE_RECORD_SIZE + nameLength + 1 + bodyLength;
+    }
+}
+
+/**
+ * @brief Adds the constants of the prelude of a context, if it has one, to its symbol table.
+ *
+ * @param ctx The assembler context, with an empty symbol table.
+ */
+void applyPreludeConstants(AssemblerContext *ctx)
+{
+    const unsigned char *record;
+    unsigned long i, nameLength;
+
+    if (ctx->prelude == NULL)
+    {
+        return;
+    }
+    record = ctx->prelude->constants;
+    for (i = 0; i < ctx->prelude->constantCount; i++)
+    {
+        nameLength = getNumber(record);
+        addSymbol(ctx, (const char *)record + PRELUDE_RECORD_SIZE, mdefine, (unsigned int)getNumber(record + 4));
+        record += PRELUDE_RECORD_SIZE + nameLength + 1;
+    }
+}
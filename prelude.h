@@ -0,0 +1,115 @@
+#ifndef PRELUDE_H
+#define PRELUDE_H
+
+#include <stddef.h>
+
+#include "libassembler.h"
+#include "data.h"
+#include "text_buffer.h"
+#include "sha256.h"
+
+#define PRELUDE_OPTION "--prelude"
+
+/* Layout of a prelude snapshot. Every number is little-endian; offsets are from the start of the file.
+ *
+ *   0  magic "ASPL"                      88  number of macros (4 bytes)
+ *   4  format version (4 bytes)          92  number of constants (4 bytes)
+ *   8  assembler version, null-padded (16 bytes)
+ *  24  SHA-256 of the prelude source, in hex (64 bytes)
+ *
+ * The macro records follow the header, then the constant records. A macro record is the length of the
+ * name and of the body, 4 bytes each, then the name with a null terminator and the body, expanded as
+ * the macro parser stores it. A constant record is the length of the name and the value, 4 bytes each,
+ * then the name with a null terminator. */
+#define PRELUDE_MAGIC "ASPL"
+#define PRELUDE_MAGIC_LENGTH 4
+#define PRELUDE_VERSION 1
+#define PRELUDE_VERSION_LENGTH 16
+#define PRELUDE_HASH_LENGTH SHA256_HEX_LENGTH
+#define PRELUDE_HEADER_SIZE 96
+
+/* A validated prelude snapshot: the macros and the constants a shared block of source defines, ready to
+ * be added to every file assembled after it. The records are read in place, without parsing. */
+struct AsmPrelude
+{
+    const unsigned char *data;           /* The content of the snapshot */
+    size_t size;                         /* Number of bytes in the content */
+    int mapped;                          /* Nonzero if data is a mapping owned by the prelude */
+    unsigned long macroCount;            /* Number of macros */
+    unsigned long constantCount;         /* Number of constants */
+    const unsigned char *macros;         /* The first macro record */
+    const unsigned char *constants;      /* The first constant record */
+    char hash[PRELUDE_HASH_LENGTH + 1];  /* SHA-256 of the prelude source */
+};
+typedef struct AsmPrelude Prelude;
+
+/**
+ * @brief Computes the hash a snapshot records of its prelude source.
+ *
+ * @param source The prelude source.
+ * @param length The number of characters in the source.
+ * @param hash Buffer of at least PRELUDE_HASH_LENGTH + 1 characters receiving the hash.
+ */
+void hashPrelude(const char *source, size_t length, char hash[]);
+
+/**
+ * @brief Assembles a prelude source into a snapshot.
+ *
+ * The prelude may define macros and constants only: anything that would emit words or define a label
+ * is an error.
+ *
+ * @param source The prelude source.
+ * @param length The number of characters in the source.
+ * @param hash The hash of the source, from hashPrelude.
+ * @param snapshot The buffer the snapshot is appended to.
+ * @param diagnostics The buffer the error messages are appended to.
+ * @return 1 on success, 0 if the prelude has errors or memory allocation failed.
+ */
+int buildPrelude(const char *source, size_t length, const char *hash, TextBuffer *snapshot, TextBuffer *diagnostics);
+
+/**
+ * @brief Validates a prelude snapshot held in memory.
+ *
+ * The header and the bounds of every record are checked, so the records can be applied without
+ * further checks.
+ *
+ * @param prelude Receives the prelude. It points into data, which must outlive it.
+ * @param data The content of the snapshot.
+ * @param size The number of bytes in the content.
+ * @param hash The hash of the prelude source the snapshot must have been built from.
+ * @return 1 if the content is a valid snapshot of this version of the assembler and of that source, 0 otherwise.
+ */
+int loadPrelude(Prelude *prelude, const void *data, size_t size, const char *hash);
+
+/**
+ * @brief Maps a prelude snapshot into memory and validates it.
+ *
+ * @param prelude Receives the prelude. Release it with closePrelude.
+ * @param fileName The name of the snapshot.
+ * @param hash The hash of the prelude source the snapshot must have been built from.
+ * @return 1 on success, 0 if the file could not be mapped, is not a valid snapshot or is out of date.
+ */
+int openPrelude(Prelude *prelude, const char *fileName, const char *hash);
+
+/**
+ * @brief Releases a prelude opened with openPrelude.
+ *
+ * @param prelude The prelude.
+ */
+void closePrelude(Prelude *prelude);
+
+/**
+ * @brief Adds the macros of the prelude of a context, if it has one, to its macro table.
+ *
+ * @param ctx The assembler context, with an empty macro table.
+ */
+void applyPreludeMacros(AssemblerContext *ctx);
+
+/**
+ * @brief Adds the constants of the prelude of a context, if it has one, to its symbol table.
+ *
+ * @param ctx The assembler context, with an empty symbol table.
+ */
+void applyPreludeConstants(AssemblerContext *ctx);
+
+#endif /* PRELUDE_H */
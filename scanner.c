@@ -0,0 +1,247 @@
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "scanner.h"
+
+/**
+ * @brief Prepares a set of characters to scan for.
+ *
+ * @param set Receives the set.
+ * @param chars The characters, at most SCAN_SET_SIZE of them.
+ */
+void initScanSet(ScanSet *set, const char *chars)
+{
+    size_t count = strlen(chars);
+
+    set->count = (int)(count < SCAN_SET_SIZE ? count : SCAN_SET_SIZE);
+    memcpy(set->chars, chars, (size_t)set->count);
+}
+
+/* The operations on a block of SCAN_BLOCK_SIZE bytes */
+#if defined(__AVX2__)
+typedef __m256i Block;
+#define loadBlock(p) _mm256_loadu_si256((const __m256i *)(p))
+#define fillBlock(c) _mm256_set1_epi8(c)
+#define emptyBlock() _mm256_setzero_si256()
+#define matchBlock(a, b) _mm256_cmpeq_epi8((a), (b))
+#define mergeBlocks(a, b) _mm256_or_si256((a), (b))
+#define blockMask(a) ((unsigned long)(unsigned int)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+typedef __m128i Block;
+#define loadBlock(p) _mm_loadu_si128((const __m128i *)(p))
+#define fillBlock(c) _mm_set1_epi8(c)
+#define emptyBlock() _mm_setzero_si128()
+#define matchBlock(a, b) _mm_cmpeq_epi8((a), (b))
+#define mergeBlocks(a, b) _mm_or_si128((a), (b))
+#define blockMask(a) ((unsigned long)(unsigned int)_mm_movemask_epi8(a))
+#endif
+
+/* A scan set ready for matching: each character repeated across a block, or a membership table */
+typedef struct Matcher
+{
+#if defined(__AVX2__) || defined(__SSE2__)
+    Block chars[SCAN_SET_SIZE]; /* Each character of the set, in every byte of a block */
+    int count;                  /* Number of characters */
+#else
+    unsigned char member[256]; /* Nonzero for the characters of the set */
+#endif
+} Matcher;
+
+/**
+ * @brief Prepares a scan set for matching.
+ *
+ * @param matcher Receives the prepared set.
+ * @param set The set.
+ */
+static void initMatcher(Matcher *matcher, const ScanSet *set)
+{
+    int i;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (i = 0; i < set->count; i++)
+    {
+        matcher->chars[i] = fillBlock(set->chars[i]);
+    }
+    matcher->count = set->count;
+#else
+    memset(matcher->member, 0, sizeof(matcher->member));
+    for (i = 0; i < set->count; i++)
+    {
+        matcher->member[(unsigned char)set->chars[i]] = 1;
+    }
+#endif
+}
+
+/**
+ * @brief Finds the characters of a set in a block of SCAN_BLOCK_SIZE bytes.
+ *
+ * Each character of the set is compared against the whole block at once and the matches are
+ * combined, so the cost depends on the size of the set rather than on the text.
+ *
+ * @param block The block. All SCAN_BLOCK_SIZE bytes must be readable.
+ * @param matcher The characters to look for.
+ * @return A mask with bit i set if byte i of the block is in the set.
+ */
+static unsigned long scanBlock(const char *block, const Matcher *matcher)
+{
+#if defined(__AVX2__) || defined(__SSE2__)
+    Block bytes = loadBlock(block);
+    Block found = emptyBlock();
+    int i;
+
+    for (i = 0; i < matcher->count; i++)
+    {
+        found = mergeBlocks(found, matchBlock(bytes, matcher->chars[i]));
+    }
+    return blockMask(found);
+#else
+    unsigned long mask = 0;
+    int i;
+
+    for (i = 0; i < SCAN_BLOCK_SIZE; i++)
+    {
+        mask |= (unsigned long)matcher->member[(unsigned char)block[i]] << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Finds the lowest set bit of a mask.
+ *
+ * @param mask A nonzero mask.
+ * @return The index of the lowest set bit.
+ */
+static int lowestBit(unsigned long mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzl(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Finds the first character of a set in a text, a block of bytes at a time.
+ *
+ * @param text The text. It need not be null-terminated.
+ * @param length The number of characters in the text.
+ * @param set The characters to look for.
+ * @return The offset of the first character of the set, or length if there is none.
+ */
+size_t scanNext(const char *text, size_t length, const ScanSet *set)
+{
+    Matcher matcher;
+    unsigned long mask;
+    size_t block, i;
+
+    initMatcher(&matcher, set);
+    for (block = 0; block + SCAN_BLOCK_SIZE <= length; block += SCAN_BLOCK_SIZE)
+    {
+        if ((mask = scanBlock(text + block, &matcher)) != 0)
+        {
+            return block + (size_t)lowestBit(mask);
+        }
+    }
+    /* The tail is shorter than a block, and reading a whole block could run past the text */
+    for (i = block; i < length; i++)
+    {
+        if (memchr(set->chars, text[i], (size_t)set->count) != NULL)
+        {
+            return i;
+        }
+    }
+    return length;
+}
+
+/* The DELIMITER_ kind of every character, 0 for characters that are not delimiters */
+#define S DELIMITER_SPACE
+#define P DELIMITER_PUNCTUATION
+#define Q DELIMITER_QUOTE
+#define C DELIMITER_COLON
+static const unsigned char delimiterKinds[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    S, 0, Q, 0, 0, 0, 0, 0, 0, 0, 0, 0, P, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, C, 0, 0, P, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, P, 0, P, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* The upper half of the table, characters 128 to 255, holds no delimiters */
+};
+#undef S
+#undef P
+#undef Q
+#undef C
+
+/**
+ * @brief Appends a delimiter to a line index.
+ *
+ * @param index The index.
+ * @param kind The DELIMITER_ kind of the delimiter.
+ * @param position The offset of the delimiter in the line.
+ */
+static void addDelimiter(LineIndex *index, int kind, size_t position)
+{
+    index->positions[index->count] = (unsigned char)position;
+    index->kinds[index->count] = (unsigned char)kind;
+    index->count++;
+    index->colonCount += kind == DELIMITER_COLON;
+}
+
+/**
+ * @brief Records the positions of the delimiters of a line: whitespace, ',', '[', ']', '=', '"' and ':'.
+ *
+ * @param line The line.
+ * @param length The number of characters in the line.
+ * @param index Receives the delimiters.
+ */
+void indexLine(const char *line, size_t length, LineIndex *index)
+{
+    ScanSet delimiters;
+    Matcher matcher;
+    unsigned long mask;
+    size_t block, i;
+    int kind;
+
+    if (length > MAX_LINE_LENGTH - 1)
+    {
+        length = MAX_LINE_LENGTH - 1; /* Every position fits in the index */
+    }
+    index->count = 0;
+    index->colonCount = 0;
+    index->length = length;
+    if (length >= SCAN_BLOCK_SIZE) /* Short lines are left to the loop over the tail */
+    {
+        initScanSet(&delimiters, " \t\n\v\f\r,[]=\":");
+        initMatcher(&matcher, &delimiters);
+    }
+
+    for (block = 0; block + SCAN_BLOCK_SIZE <= length; block += SCAN_BLOCK_SIZE)
+    {
+        for (mask = scanBlock(line + block, &matcher); mask != 0; mask &= mask - 1)
+        {
+            i = block + (size_t)lowestBit(mask);
+            addDelimiter(index, delimiterKinds[(unsigned char)line[i]], i);
+        }
+    }
+    for (i = block; i < length; i++)
+    {
+        if ((kind = delimiterKinds[(unsigned char)line[i]]) != 0)
+        {
+            addDelimiter(index, kind, i);
+        }
+    }
+}
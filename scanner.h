@@ -0,0 +1,69 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stddef.h>
+
+#include "data.h"
+
+/* Bytes examined at a time: 32 with AVX2, 16 with SSE2 and in the portable version */
+#if defined(__AVX2__)
+#define SCAN_BLOCK_SIZE 32
+#else
+#define SCAN_BLOCK_SIZE 16
+#endif
+
+#define SCAN_SET_SIZE 16 /* The most characters a scan looks for at once */
+
+/* Kinds of delimiters recorded in a line index */
+#define DELIMITER_SPACE 1       /* Whitespace, as isspace sees it in the C locale */
+#define DELIMITER_PUNCTUATION 2 /* ',', '[', ']' or '=' */
+#define DELIMITER_QUOTE 4       /* '"' */
+#define DELIMITER_COLON 8       /* ':' */
+
+/* The characters a scan looks for */
+typedef struct ScanSet
+{
+    char chars[SCAN_SET_SIZE]; /* The characters */
+    int count;                 /* Number of characters */
+} ScanSet;
+
+/* The delimiters of a line, in order, so the tokenizer can jump from one to the next */
+typedef struct LineIndex
+{
+    unsigned char positions[MAX_LINE_LENGTH]; /* Offset of each delimiter in the line */
+    unsigned char kinds[MAX_LINE_LENGTH];     /* The DELIMITER_ kind of each delimiter */
+    int count;                                /* Number of delimiters */
+    int colonCount;                           /* Number of ':' characters in the line */
+    size_t length;                            /* Number of characters indexed */
+} LineIndex;
+
+/**
+ * @brief Prepares a set of characters to scan for.
+ *
+ * @param set Receives the set.
+ * @param chars The characters, at most SCAN_SET_SIZE of them.
+ */
+void initScanSet(ScanSet *set, const char *chars);
+
+/**
+ * @brief Finds the first character of a set in a text, a block of bytes at a time.
+ *
+ * @param text The text. It need not be null-terminated.
+ * @param length The number of characters in the text.
+ * @param set The characters to look for.
+ * @return The offset of the first character of the set, or length if there is none.
+ */
+size_t scanNext(const char *text, size_t length, const ScanSet *set);
+
+/**
+ * @brief Records the positions of the delimiters of a line: whitespace, ',', '[', ']', '=', '"' and ':'.
+ *
+ * At most MAX_LINE_LENGTH - 1 characters are indexed; the length of the index tells how many.
+ *
+ * @param line The line.
+ * @param length The number of characters in the line.
+ * @param index Receives the delimiters.
+ */
+void indexLine(const char *line, size_t length, LineIndex *index);
+
+#endif /* SCANNER_H */
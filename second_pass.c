@@ -7,113 +7,81 @@
 #include "data.h"
 #include "utils.h"
 /**
- * Performs the second pass of the assembler over the source file.
- * This pass processes each line of the assembly source code to resolve symbols and finalize instruction encoding.
- * It handles directives and instructions specifically, ignoring blank lines and comments.
+ * Performs the second pass of the assembler.
+ * The source is not read again: the first pass queued the names of the entry directives and linked each
+ * word that refers to a symbol into the fixup chain of that symbol. This pass marks the entries, then
+ * resolves each symbol once and patches the words of its chain.
  *
- * @param fp Pointer to the source file being read.
+ * @param ctx The assembler context.
  */
-void secondPass(FILE *fp)
+void secondPass(AssemblerContext *ctx)
 {
-    char line[MAX_LINE_LENGTH]; /* Buffer to store each line from the file */
-    lineNum = 0;                /* Reset line number counter for accurate error reporting */
-                                /* Reset line error flag */
-
-    while (fgets(line, MAX_LINE_LENGTH, fp) != NULL) /* Read each line until the end of the file */
-    {
-        lineErrorFlag = 0;
-        lineNum++;      /* Increment line number with each new line */
-        trimLine(line); /* Remove leading and trailing whitespace */
-
-        switch (getLineType(line)) /* Determine the type of the current line */
-        {
-        case LINE_BLANK:
-        case LINE_COMMENT:
-        case LINE_DEFINITION:
-            /* Ignore blank, comment, and definition lines */
-            break;
-        case LINE_DIRECTIVE:
-            handleDirective(line); /* Handle directives */
-            break;
-
-        case LINE_INSTRUCTION:
-        case LINE_LABEL:
-
-            break;
-        case INVALID_LINE:
-            handleError("Invalid line format", lineNum, line);
-            break;
-        }
-    }
-    encodeRemainingInstruction(); /* Encode any remaining instructions that need it */
-    storeMemoryLine();            /* Finalize storage of memory lines */
+    resolveEntries(ctx);             /* Mark the symbols named by entry directives */
+    encodeRemainingInstruction(ctx); /* Encode the words that refer to symbols */
 }
 /**
- * Processes assembly language directives based on the first token of a given line.
- * This function handles different types of directives: data, string, extern, define, and entry.
- * It delegates processing to other functions based on the type of directive encountered.
+ * Resolves the names queued by the entry directives of the first pass to the symbols they mark as entries.
+ * A name that is not defined, or that is external, is reported with the line of its directive; as when
+ * the lines were read, at most one error is reported per line.
  *
- * @param line The line from the assembly source code to process for directives.
+ * @param ctx The assembler context.
  */
-void handleDirective(char *line)
+void resolveEntries(AssemblerContext *ctx)
 {
-    char *token, *symbolName;
-    token = strtok(line, " \t\n"); /* Extract the first token which is expected to be the directive */
-    if (token == NULL)
-    {
-        handleError("Invalid line format", lineNum, line); /* Handle error if line is empty or malformed */
-        return;
-    }
-    switch (getDirectiveType(line)) /* Determine the type of directive based on the first token */
+    QueuedEntry *queued;
+    Symbol *sym;
+    int lineNum = 0; /* Line of the directive being resolved */
+
+    for (queued = ctx->entryQueue; queued != NULL; queued = queued->next)
     {
-    case DATA_DIRECTIVE:
-    case STRING_DIRECTIVE:
-    case EXTERN_DIRECTIVE:
-    case DEFINE_DIRECTIVE:
-        break;
-    case ENTRY_DIRECTIVE:
-        /* Process each symbol declared as an entry */
-        while ((symbolName = strtok(NULL, " \t\n")) != NULL) /*Fetch next tokens as symbol names*/
+        if (queued->lineNum != lineNum)
         {
-            Symbol *sym = lookupSymbol(symbolName); /* Look up the symbol in the symbol table */
-            if (sym)                                /* Check if symbol is already defined */
-            {
-                if (sym->symbolType == external)
-                {
-                    handleError("Cannot declare external symbol as entry", lineNum, symbolName); /* Handle error if symbol is external */
-                }
-                else
-                {
-                    updateSymbolType(symbolName, entry);
-                }
-            }
-            else
-            {
-                handleError("Symbol not found", lineNum, symbolName); /* Handle error if symbol not found */
-            }
+            ctx->lineErrorFlag = 0; /* A new directive line */
+            lineNum = queued->lineNum;
+        }
+        sym = lookupSymbol(ctx, queued->name); /* Look up the symbol in the symbol table */
+        if (sym == NULL)
+        {
+            handleError(ctx, "Symbol not found", lineNum, (char *)queued->name); /* Handle error if symbol not found */
+        }
+        else if (sym->symbolType == external)
+        {
+            handleError(ctx, "Cannot declare external symbol as entry", lineNum, (char *)queued->name); /* Handle error if symbol is external */
+        }
+        else
+        {
+            queued->symbol = (int)(sym - ctx->symbolTable.symbols);
         }
-        break;
-    case INVALID_DIRECTIVE: /* Handle invalid directive error */
-        break;
     }
+    ctx->lineErrorFlag = 0;
 }
 
 /**
  * Encodes all remaining instructions in the memory that require encoding.
- * This function iterates through memory lines and encodes any symbols that have not been previously encoded.
- * It updates the value of each memory line with the new encoded value if needed.
+ * This function walks the fixup chains recorded by the first pass. Each symbol is looked up once, and its
+ * encoded value is written into every word of its chain; the rest of the image is not visited.
+ * The direct operands of an external symbol are appended to its list of uses, in address order.
+ *
+ * @param ctx The assembler context.
  */
-void encodeRemainingInstruction()
+void encodeRemainingInstruction(AssemblerContext *ctx)
 {
-    int i;
-    int newValue;
-    for (i = 0; i < IC + DC; i++) /* Iterate over all memory lines */
+    const FixupChain *chain;
+    const Fixup *fixup;
+    Symbol *externalSymbol;
+    Word value;
+
+    for (chain = ctx->fixupChains; chain != NULL; chain = chain->next)
     {
-        if (memoryLines[i].needEncoding) /* Check if the current memory line needs encoding */
+        value = (Word)encodeSymbol(ctx, chain->symbol); /* Encode the symbol once */
+        externalSymbol = (value & 0x03) == 0x01 ? lookupSymbol(ctx, chain->symbol) : NULL; /* ARE bits 01 */
+        for (fixup = chain->fixups; fixup != NULL; fixup = fixup->next)
         {
-            newValue = encodeSymbol(memoryLines[i].symbol); /* Encode the symbol associated with the memory line */
-            memoryLines[i].value = newValue;                /* Update the memory line's value with the encoded symbol */
-            memoryLines[i].needEncoding = 0;                /* Mark the memory line as encoded */
+            ctx->image[fixup->address] = value; /* Patch each word that refers to it */
+            if (externalSymbol != NULL && ctx->wordTypes[fixup->address] == DIRECT_ADDRESSING)
+            {
+                recordExternalSymbolUsage(ctx, externalSymbol, fixup->address);
+            }
         }
     }
 }
@@ -124,12 +92,13 @@ void encodeRemainingInstruction()
  * - Relocatable symbols get ARE bits set to 10.
  * If the symbol is not found, an error is handled and -1 is returned.
  *
+ * @param ctx The assembler context.
  * @param symbol The name of the symbol to encode.
  * @return The encoded value of the symbol, or -1 if the symbol cannot be found.
  */
-int encodeSymbol(char *symbol)
+int encodeSymbol(AssemblerContext *ctx, const char *symbol)
 {
-    Symbol *sym = lookupSymbol(symbol); /* Look up the symbol in the symbol table */
+    Symbol *sym = lookupSymbol(ctx, symbol); /* Look up the symbol in the symbol table */
     unsigned int areBits;
     int encodedValue;
     if (sym != NULL)
@@ -141,7 +110,7 @@ int encodeSymbol(char *symbol)
     }
     else
     {
-        handleError("Symbol not found", lineNum, symbol); /* Handle error if symbol is not found */
+        handleError(ctx, "Symbol not found", ctx->lineNum, (char *)symbol); /* Handle error if symbol is not found */
         return -1;
     }
 }
@@ -7,21 +7,22 @@
 #include "utils.h"
 #include "data.h"
 /**
- * Performs the second pass of the assembler over the source file.
- * This pass processes each line of the assembly source code to resolve symbols and finalize instruction encoding.
- * It handles directives and instructions specifically, ignoring blank lines and comments.
+ * Performs the second pass of the assembler.
+ * The source is not read again: the first pass queued the names of the entry directives and linked each
+ * word that refers to a symbol into the fixup chain of that symbol. This pass marks the entries, then
+ * resolves each symbol once and patches the words of its chain.
  *
- * @param fp Pointer to the source file being read.
+ * @param ctx The assembler context.
  */
-void secondPass(FILE *fp);
+void secondPass(AssemblerContext *ctx);
 /**
- * Processes assembly language directives based on the first token of a given line.
- * This function handles different types of directives: data, string, extern, define, and entry.
- * It delegates processing to other functions based on the type of directive encountered.
+ * Marks the symbols queued by the entry directives of the first pass as entries.
+ * A name that is not defined, or that is external, is reported with the line of its directive; as when
+ * the lines were read, at most one error is reported per line.
  *
- * @param line The line from the assembly source code to process for directives.
+ * @param ctx The assembler context.
  */
-void handleDirective(char *line);
+void resolveEntries(AssemblerContext *ctx);
 /**
  * Encodes a symbol's value with additional addressing bits based on its type.
  * This function looks up the symbol in the symbol table and, if found, encodes it based on its type:
@@ -29,10 +30,11 @@ void handleDirective(char *line);
  * - Relocatable symbols get ARE bits set to 10.
  * If the symbol is not found, an error is handled and -1 is returned.
  *
+ * @param ctx The assembler context.
  * @param symbol The name of the symbol to encode.
  * @return The encoded value of the symbol, or -1 if the symbol cannot be found.
  */
-int encodeSymbol(char *symbol);
+int encodeSymbol(AssemblerContext *ctx, const char *symbol);
 /**
  * Encodes an integer value with Additional Relocation Encoding (ARE) bits.
  * This function adjusts a given value to fit within 12 bits, and then appends 2 ARE bits at the lowest order.
@@ -44,9 +46,11 @@ int encodeSymbol(char *symbol);
 int setValue(int value, unsigned int areBits);
 /**
  * Encodes all remaining instructions in the memory that require encoding.
- * This function iterates through memory lines and encodes any symbols that have not been previously encoded.
- * It updates the value of each memory line with the new encoded value if needed.
+ * This function walks the fixup chains recorded by the first pass. Each symbol is looked up once, and its
+ * encoded value is written into every word of its chain; the rest of the image is not visited.
+ *
+ * @param ctx The assembler context.
  */
-void encodeRemainingInstruction();
+void encodeRemainingInstruction(AssemblerContext *ctx);
 
 #endif
\ No newline at end of file
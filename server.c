@@ -0,0 +1,508 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "assembler.h"
+#include "libassembler.h"
+#include "file_builder.h"
+#include "text_buffer.h"
+#include "data.h"
+#include "include.h"
+
+#define CONNECTION_BUFFER_SIZE 4096
+#define MAX_REQUEST_LINE (MAX_FILENAME_LEN + 16)
+
+/* State shared by every connection of the server */
+typedef struct Server
+{
+    pthread_mutex_t lock;                  /* Protects the idle contexts and the connection count */
+    pthread_cond_t closed;                 /* Signaled when a connection closes */
+    AsmContext *idle[MAX_IDLE_CONTEXTS];   /* Warm contexts waiting for a request */
+    int idleCount;                         /* Number of idle contexts */
+    int connections;                       /* Number of connections being served */
+} Server;
+
+/* A client connection and the bytes received from it but not consumed yet */
+typedef struct Connection
+{
+    Server *server;                        /* The server the connection belongs to */
+    int fd;                                /* The connected socket */
+    char buffer[CONNECTION_BUFFER_SIZE];   /* Bytes received from the client */
+    size_t start;                          /* First unconsumed byte in the buffer */
+    size_t end;                            /* End of the received bytes in the buffer */
+} Connection;
+
+/**
+ * @brief Takes a warm context from the server, or creates one if none is idle.
+ *
+ * @param server The server.
+ * @return The context, or NULL if memory allocation fails.
+ */
+static AsmContext *acquireContext(Server *server)
+{
+    AsmContext *ctx = NULL;
+
+    pthread_mutex_lock(&server->lock);
+    if (server->idleCount > 0)
+    {
+        ctx = server->idle[--server->idleCount];
+    }
+    pthread_mutex_unlock(&server->lock);
+    return ctx != NULL ? ctx : asm_context_create();
+}
+
+/**
+ * @brief Gives a context back to the server so the next request can reuse it.
+ *
+ * @param server The server.
+ * @param ctx The context to give back.
+ */
+static void releaseContext(Server *server, AsmContext *ctx)
+{
+    pthread_mutex_lock(&server->lock);
+    if (server->idleCount < MAX_IDLE_CONTEXTS)
+    {
+        server->idle[server->idleCount++] = ctx;
+        ctx = NULL;
+    }
+    pthread_mutex_unlock(&server->lock);
+    asm_context_destroy(ctx);
+}
+
+/**
+ * @brief Receives more bytes from the client into the connection buffer.
+ *
+ * @param conn The connection.
+ * @return 1 if bytes were received, 0 on end of stream or error.
+ */
+static int receiveMore(Connection *conn)
+{
+    ssize_t count;
+
+    if (conn->start == conn->end)
+    {
+        conn->start = conn->end = 0;
+    }
+    else if (conn->end == sizeof(conn->buffer))
+    {
+        memmove(conn->buffer, conn->buffer + conn->start, conn->end - conn->start);
+        conn->end -= conn->start;
+        conn->start = 0;
+    }
+    do
+    {
+        count = read(conn->fd, conn->buffer + conn->end, sizeof(conn->buffer) - conn->end);
+    } while (count < 0 && errno == EINTR);
+
+    if (count <= 0)
+    {
+        return 0;
+    }
+    conn->end += (size_t)count;
+    return 1;
+}
+
+/**
+ * @brief Reads the header line of a request, without its newline.
+ *
+ * @param conn The connection.
+ * @param line The destination for the line.
+ * @param size The size of the destination.
+ * @return 1 on success, 0 on end of stream, error or a line that does not fit.
+ */
+static int receiveLine(Connection *conn, char *line, size_t size)
+{
+    size_t length = 0;
+
+    for (;;)
+    {
+        while (conn->start < conn->end)
+        {
+            char c = conn->buffer[conn->start++];
+            if (c == '\n')
+            {
+                line[length] = '\0';
+                return 1;
+            }
+            if (length + 1 == size)
+            {
+                return 0;
+            }
+            line[length++] = c;
+        }
+        if (!receiveMore(conn))
+        {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Reads the payload of a request into a buffer.
+ *
+ * @param conn The connection.
+ * @param dest The buffer receiving the payload.
+ * @param length The number of bytes to read.
+ * @return 1 on success, 0 on end of stream, error or memory allocation failure.
+ */
+static int receivePayload(Connection *conn, TextBuffer *dest, size_t length)
+{
+    while (length > 0)
+    {
+        size_t available;
+        if (conn->start == conn->end && !receiveMore(conn))
+        {
+            return 0;
+        }
+        available = conn->end - conn->start;
+        if (available > length)
+        {
+            available = length;
+        }
+        if (!appendText(dest, conn->buffer + conn->start, available))
+        {
+            return 0;
+        }
+        conn->start += available;
+        length -= available;
+    }
+    return 1;
+}
+
+/**
+ * @brief Sends a whole buffer to the client.
+ *
+ * @param fd The connected socket.
+ * @param data The bytes to send.
+ * @param length The number of bytes to send.
+ * @return 1 on success, 0 if the client went away.
+ */
+static int sendAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t count = write(fd, data, length);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return 0;
+        }
+        data += count;
+        length -= (size_t)count;
+    }
+    return 1;
+}
+
+/**
+ * @brief Appends a named section of the reply: a header line with its length, then its bytes.
+ *
+ * @param reply The reply being built.
+ * @param name The name of the section.
+ * @param data The content of the section.
+ * @param length The number of bytes in the content.
+ */
+static void appendSection(TextBuffer *reply, const char *name, const char *data, size_t length)
+{
+    char header[MAX_MESSAGE_LENGTH];
+    sprintf(header, "%s %lu\n", name, (unsigned long)length);
+    appendString(reply, header);
+    appendText(reply, data, length);
+}
+
+/**
+ * @brief Builds the reply to an assembled request.
+ *
+ * @param result The output of the assembly.
+ * @param reply The buffer receiving the reply.
+ */
+static void buildReply(const AsmResult *result, TextBuffer *reply)
+{
+    TextBuffer text;
+
+    initTextBuffer(&text);
+    appendString(reply, result->success ? "STATUS ok\n" : "STATUS error\n");
+    if (result->success)
+    {
+        formatObFile(result, &text);
+    }
+    appendSection(reply, "OB", text.data, text.length);
+    clearTextBuffer(&text);
+    formatEntryFile(result, &text);
+    appendSection(reply, "ENT", text.data, text.length);
+    clearTextBuffer(&text);
+    formatExtFile(result, &text);
+    appendSection(reply, "EXT", text.data, text.length);
+    appendSection(reply, "DIAG", result->diagnostics, result->diagnosticsLength);
+    appendString(reply, "END\n");
+    freeTextBuffer(&text);
+}
+
+/**
+ * @brief Builds the reply to a request that failed before it could be assembled.
+ *
+ * @param message The reason, as a diagnostics line.
+ * @param reply The buffer receiving the reply.
+ */
+static void buildFailureReply(const char *message, TextBuffer *reply)
+{
+    appendString(reply, "STATUS error\n");
+    appendSection(reply, "OB", "", 0);
+    appendSection(reply, "ENT", "", 0);
+    appendSection(reply, "EXT", "", 0);
+    appendSection(reply, "DIAG", message, strlen(message));
+    appendString(reply, "END\n");
+}
+
+/**
+ * @brief Reads one request of a connection and builds its reply.
+ *
+ * @param conn The connection.
+ * @param source A scratch buffer for the source code.
+ * @param reply The buffer receiving the reply.
+ * @return 1 if the connection may carry another request, 0 if it should be closed.
+ */
+static int serveRequest(Connection *conn, TextBuffer *source, TextBuffer *reply)
+{
+    char line[MAX_REQUEST_LINE];
+    char message[MAX_MESSAGE_LENGTH + MAX_REQUEST_LINE];
+    char fileName[MAX_REQUEST_LINE + sizeof(EXTENTION)];
+    const char *sourceName = NULL; /* The file of a FILE request, which its includes are relative to */
+    AsmContext *ctx;
+    AsmResult result;
+
+    clearTextBuffer(source);
+    if (!receiveLine(conn, line, sizeof(line)))
+    {
+        return 0;
+    }
+
+    if (strncmp(line, "SOURCE ", 7) == 0)
+    {
+        char *end;
+        long length = strtol(line + 7, &end, 10);
+        if (*end != '\0' || end == line + 7 || length < 0 || length > MAX_REQUEST_SOURCE)
+        {
+            appendString(reply, "ERROR invalid source length\n");
+            return 0;
+        }
+        if (!receivePayload(conn, source, (size_t)length))
+        {
+            return 0;
+        }
+    }
+    else if (strncmp(line, "FILE ", 5) == 0)
+    {
+        FILE *fp;
+
+        if (!isConfinedPath(line + 5, strlen(line + 5))) /* Stay inside the directory of the server */
+        {
+            sprintf(message, "File path must be relative and without '..': %s\n", line + 5);
+            buildFailureReply(message, reply);
+            return 1;
+        }
+        strcpy(fileName, line + 5);
+        strcat(fileName, EXTENTION);
+        sourceName = fileName;
+        fp = fopen(fileName, "r");
+        if (fp == NULL)
+        {
+            sprintf(message, "Couldn't open file: %s\n", fileName);
+            buildFailureReply(message, reply);
+            return 1;
+        }
+        if (!appendFile(source, fp))
+        {
+            sprintf(message, "Couldn't read file: %s\n", fileName);
+            buildFailureReply(message, reply);
+            fclose(fp);
+            return 1;
+        }
+        fclose(fp);
+    }
+    else
+    {
+        appendString(reply, "ERROR unknown request\n");
+        return 0;
+    }
+
+    if ((ctx = acquireContext(conn->server)) == NULL)
+    {
+        buildFailureReply("Memory allocation failed\n", reply);
+        return 1;
+    }
+    asm_context_set_file_name(ctx, sourceName);
+    asm_context_set_confined_includes(ctx, 1); /* Included files follow the rule of FILE paths */
+    asm_assemble_buffer(ctx, source->data ? source->data : "", source->length, &result);
+    asm_context_set_file_name(ctx, NULL);
+    buildReply(&result, reply);
+    releaseContext(conn->server, ctx);
+    return 1;
+}
+
+/**
+ * @brief Serves the requests of one client until it disconnects.
+ *
+ * @param arg The Connection, which is released when the client is done.
+ * @return Always NULL.
+ */
+static void *serveConnection(void *arg)
+{
+    Connection *conn = (Connection *)arg;
+    TextBuffer source, reply;
+    int more = 1;
+
+    initTextBuffer(&source);
+    initTextBuffer(&reply);
+    while (more)
+    {
+        clearTextBuffer(&reply);
+        more = serveRequest(conn, &source, &reply);
+        if (reply.length > 0 && !sendAll(conn->fd, reply.data, reply.length))
+        {
+            more = 0;
+        }
+    }
+    close(conn->fd);
+    freeTextBuffer(&source);
+    freeTextBuffer(&reply);
+
+    pthread_mutex_lock(&conn->server->lock);
+    conn->server->connections--;
+    pthread_cond_signal(&conn->server->closed);
+    pthread_mutex_unlock(&conn->server->lock);
+    free(conn);
+    return NULL;
+}
+
+/**
+ * @brief Creates the listening socket, replacing a stale socket left at the same path.
+ *
+ * @param socketPath The path of the socket.
+ * @return The listening socket, or -1 on failure.
+ */
+static int openListener(const char *socketPath)
+{
+    struct sockaddr_un address;
+    struct stat info;
+    mode_t mask;
+    int fd, bound;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    if (stat(socketPath, &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        unlink(socketPath);
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    /* Only the owner may connect: a client can have any file the server can read assembled */
+    mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || listen(fd, SOMAXCONN) < 0)
+    {
+        perror(socketPath);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Listens on a Unix domain socket and assembles the requests of every client.
+ *
+ * @param socketPath The path of the socket. A stale socket at this path is replaced.
+ * @return EXIT_FAILURE if the socket could not be set up.
+ */
+int runServer(const char *socketPath)
+{
+    static Server server;
+    struct sigaction ignore;
+    pthread_attr_t detached;
+    pthread_t thread;
+    int listener;
+
+    /* A client that goes away mid-reply must not take the server down */
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, NULL);
+
+    if ((listener = openListener(socketPath)) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.closed, NULL);
+    server.idleCount = 0;
+    server.connections = 0;
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+
+    for (;;)
+    {
+        Connection *conn;
+        int fd;
+
+        /* Leave the next clients in the listen backlog until a connection closes */
+        pthread_mutex_lock(&server.lock);
+        while (server.connections >= MAX_CONNECTIONS)
+        {
+            pthread_cond_wait(&server.closed, &server.lock);
+        }
+        pthread_mutex_unlock(&server.lock);
+
+        fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
+            {
+                perror("accept");
+            }
+            continue;
+        }
+        conn = malloc(sizeof(Connection));
+        if (conn == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        conn->server = &server;
+        conn->fd = fd;
+        conn->start = conn->end = 0;
+        pthread_mutex_lock(&server.lock);
+        server.connections++;
+        pthread_mutex_unlock(&server.lock);
+
+        /* Serve the client on a thread of its own, or right here if no thread can be started */
+        if (pthread_create(&thread, &detached, serveConnection, conn) != 0)
+        {
+            serveConnection(conn);
+        }
+    }
+}
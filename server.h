@@ -0,0 +1,46 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVE_OPTION "--serve"
+#define MAX_REQUEST_SOURCE (16L * 1024 * 1024) /* Largest inline source accepted, in bytes */
+#define MAX_IDLE_CONTEXTS 64                   /* Warm contexts kept between requests */
+#define MAX_CONNECTIONS 64                     /* Clients served at once; others wait to be accepted */
+
+/*
+ * Protocol, over a Unix domain stream socket. A connection carries any number of requests, each
+ * answered before the next is read.
+ *
+ * Requests, each a header line optionally followed by a payload:
+ *   SOURCE <length>\n<length bytes of source>   Assemble inline source.
+ *   FILE <path>\n                               Assemble <path>.as, read by the server. The path must
+ *                                               be relative to the directory of the server, without '..'.
+ *
+ * The .include directives of a request follow the same rule: each must name a relative path without a
+ * '..' component, resolved from the file holding it (the directory of the server for SOURCE). A request
+ * with any other directive is answered with STATUS error and the message in DIAG.
+ *
+ * Reply:
+ *   STATUS ok|error\n
+ *   OB <length>\n<bytes>     Content of the '.ob' file (empty when assembly failed).
+ *   ENT <length>\n<bytes>    Content of the '.ent' file (empty when there are no entries).
+ *   EXT <length>\n<bytes>    Content of the '.ext' file (empty when no external is used).
+ *   DIAG <length>\n<bytes>   Error messages, as the command line tool prints them.
+ *   END\n
+ *
+ * A malformed request is answered with "ERROR <reason>\n" and the connection is closed.
+ */
+
+/**
+ * @brief Listens on a Unix domain socket and assembles the requests of every client.
+ *
+ * Each connection is served by a thread of its own, for at most MAX_CONNECTIONS connections at once;
+ * the next ones are accepted as earlier ones close. The socket is created for the owner of the process
+ * only. Assembler contexts are kept warm between requests and reused. The function returns only if the
+ * socket cannot be set up.
+ *
+ * @param socketPath The path of the socket. A stale socket at this path is replaced.
+ * @return EXIT_FAILURE if the socket could not be set up.
+ */
+int runServer(const char *socketPath);
+
+#endif /* SERVER_H */
@@ -0,0 +1,167 @@
+#include <string.h>
+
+#include "sha256.h"
+
+#define MASK32 0xFFFFFFFFUL
+#define ROTR(x, n) ((((x) >> (n)) | ((x) << (32 - (n)))) & MASK32)
+
+/* Round constants: the first 32 bits of the fractional parts of the cube roots of the first 64 primes */
+static const unsigned long roundConstants[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL, 0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL, 0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL};
+
+/**
+ * @brief Mixes one 64-byte block into the hash words.
+ *
+ * @param sha The running state.
+ * @param block The block to process.
+ */
+static void processBlock(Sha256 *sha, const unsigned char block[])
+{
+    unsigned long w[64];
+    unsigned long a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = ((unsigned long)block[4 * i] << 24) | ((unsigned long)block[4 * i + 1] << 16) |
+               ((unsigned long)block[4 * i + 2] << 8) | (unsigned long)block[4 * i + 3];
+    }
+    for (i = 16; i < 64; i++)
+    {
+        unsigned long s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned long s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = (w[i - 16] + s0 + w[i - 7] + s1) & MASK32;
+    }
+
+    a = sha->state[0];
+    b = sha->state[1];
+    c = sha->state[2];
+    d = sha->state[3];
+    e = sha->state[4];
+    f = sha->state[5];
+    g = sha->state[6];
+    h = sha->state[7];
+    for (i = 0; i < 64; i++)
+    {
+        t1 = (h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + roundConstants[i] + w[i]) & MASK32;
+        t2 = ((ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c))) & MASK32;
+        h = g;
+        g = f;
+        f = e;
+        e = (d + t1) & MASK32;
+        d = c;
+        c = b;
+        b = a;
+        a = (t1 + t2) & MASK32;
+    }
+    sha->state[0] = (sha->state[0] + a) & MASK32;
+    sha->state[1] = (sha->state[1] + b) & MASK32;
+    sha->state[2] = (sha->state[2] + c) & MASK32;
+    sha->state[3] = (sha->state[3] + d) & MASK32;
+    sha->state[4] = (sha->state[4] + e) & MASK32;
+    sha->state[5] = (sha->state[5] + f) & MASK32;
+    sha->state[6] = (sha->state[6] + g) & MASK32;
+    sha->state[7] = (sha->state[7] + h) & MASK32;
+}
+
+/**
+ * @brief Starts a new SHA-256 computation.
+ *
+ * @param sha The state to initialize.
+ */
+void sha256Init(Sha256 *sha)
+{
+    sha->state[0] = 0x6a09e667UL;
+    sha->state[1] = 0xbb67ae85UL;
+    sha->state[2] = 0x3c6ef372UL;
+    sha->state[3] = 0xa54ff53aUL;
+    sha->state[4] = 0x510e527fUL;
+    sha->state[5] = 0x9b05688cUL;
+    sha->state[6] = 0x1f83d9abUL;
+    sha->state[7] = 0x5be0cd19UL;
+    sha->lengthLow = 0;
+    sha->lengthHigh = 0;
+    sha->blockLength = 0;
+}
+
+/**
+ * @brief Adds bytes to the message being hashed.
+ *
+ * @param sha The running state.
+ * @param data The bytes to add.
+ * @param length The number of bytes to add.
+ */
+void sha256Update(Sha256 *sha, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    while (length > 0)
+    {
+        size_t count = sizeof(sha->block) - sha->blockLength;
+        if (count > length)
+        {
+            count = length;
+        }
+        memcpy(sha->block + sha->blockLength, bytes, count);
+        sha->blockLength += count;
+        bytes += count;
+        length -= count;
+
+        /* Count the length in two 32-bit halves, since C90 has no 64-bit type */
+        sha->lengthLow = (sha->lengthLow + count) & MASK32;
+        if (sha->lengthLow < count)
+        {
+            sha->lengthHigh++;
+        }
+        if (sha->blockLength == sizeof(sha->block))
+        {
+            processBlock(sha, sha->block);
+            sha->blockLength = 0;
+        }
+    }
+}
+
+/**
+ * @brief Finishes the computation and writes the digest as lowercase hexadecimal.
+ *
+ * @param sha The running state. It must be initialized again before reuse.
+ * @param hex Buffer of at least SHA256_HEX_LENGTH + 1 characters receiving the digest.
+ */
+void sha256FinalHex(Sha256 *sha, char hex[])
+{
+    static const char digits[] = "0123456789abcdef";
+    unsigned long bitsHigh = ((sha->lengthHigh << 3) | (sha->lengthLow >> 29)) & MASK32;
+    unsigned long bitsLow = (sha->lengthLow << 3) & MASK32;
+    int i;
+
+    /* Pad with a single 1 bit, zeros, and the message length in bits */
+    sha->block[sha->blockLength++] = 0x80;
+    if (sha->blockLength > 56)
+    {
+        memset(sha->block + sha->blockLength, 0, sizeof(sha->block) - sha->blockLength);
+        processBlock(sha, sha->block);
+        sha->blockLength = 0;
+    }
+    memset(sha->block + sha->blockLength, 0, 56 - sha->blockLength);
+    for (i = 0; i < 4; i++)
+    {
+        sha->block[56 + i] = (unsigned char)(bitsHigh >> (24 - 8 * i));
+        sha->block[60 + i] = (unsigned char)(bitsLow >> (24 - 8 * i));
+    }
+    processBlock(sha, sha->block);
+
+    for (i = 0; i < SHA256_DIGEST_LENGTH; i++)
+    {
+        unsigned int byte = (unsigned int)(sha->state[i / 4] >> (24 - 8 * (i % 4))) & 0xFF;
+        hex[2 * i] = digits[byte >> 4];
+        hex[2 * i + 1] = digits[byte & 0xF];
+    }
+    hex[SHA256_HEX_LENGTH] = '\0';
+}
@@ -0,0 +1,43 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+
+#define SHA256_DIGEST_LENGTH 32
+#define SHA256_HEX_LENGTH (2 * SHA256_DIGEST_LENGTH)
+
+/* Running state of a SHA-256 computation */
+typedef struct Sha256
+{
+    unsigned long state[8];       /* Hash words, 32 bits each */
+    unsigned long lengthLow;      /* Low 32 bits of the message length in bytes */
+    unsigned long lengthHigh;     /* High bits of the message length in bytes */
+    unsigned char block[64];      /* Bytes waiting for a full block */
+    size_t blockLength;           /* Number of bytes in block */
+} Sha256;
+
+/**
+ * @brief Starts a new SHA-256 computation.
+ *
+ * @param sha The state to initialize.
+ */
+void sha256Init(Sha256 *sha);
+
+/**
+ * @brief Adds bytes to the message being hashed.
+ *
+ * @param sha The running state.
+ * @param data The bytes to add.
+ * @param length The number of bytes to add.
+ */
+void sha256Update(Sha256 *sha, const void *data, size_t length);
+
+/**
+ * @brief Finishes the computation and writes the digest as lowercase hexadecimal.
+ *
+ * @param sha The running state. It must be initialized again before reuse.
+ * @param hex Buffer of at least SHA256_HEX_LENGTH + 1 characters receiving the digest.
+ */
+void sha256FinalHex(Sha256 *sha, char hex[]);
+
+#endif /* SHA256_H */
@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source_file.h"
+
+/**
+ * @brief Empties a source before it is filled.
+ *
+ * @param source The source.
+ */
+static void initSourceFile(SourceFile *source)
+{
+    source->data = "";
+    source->length = 0;
+    source->mapping = NULL;
+    initTextBuffer(&source->buffer);
+}
+
+/**
+ * @brief Reads the rest of a stream, such as standard input, into a source.
+ *
+ * @param source Receives the text. Release it with closeSourceFile, whatever the result.
+ * @param fp The stream to read.
+ * @return SOURCE_OPENED, or SOURCE_READ_FAILED if the stream could not be read.
+ */
+int readSourceStream(SourceFile *source, FILE *fp)
+{
+    initSourceFile(source);
+    if (!appendFile(&source->buffer, fp))
+    {
+        return SOURCE_READ_FAILED;
+    }
+    if (source->buffer.data != NULL)
+    {
+        source->data = source->buffer.data;
+        source->length = source->buffer.length;
+    }
+    return SOURCE_OPENED;
+}
+
+/**
+ * @brief Opens a source file, mapping it when it is a regular file.
+ *
+ * An empty file is not mapped, since there is nothing to map.
+ *
+ * @param source Receives the text. Release it with closeSourceFile, whatever the result.
+ * @param fileName The name of the file.
+ * @return SOURCE_OPENED, SOURCE_OPEN_FAILED or SOURCE_READ_FAILED.
+ */
+int openSourceFile(SourceFile *source, const char *fileName)
+{
+    struct stat info;
+    FILE *fp;
+    void *mapping;
+    int fd, status;
+
+    initSourceFile(source);
+    if ((fd = open(fileName, O_RDONLY)) < 0)
+    {
+        return SOURCE_OPEN_FAILED;
+    }
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+    {
+        if (info.st_size == 0)
+        {
+            close(fd);
+            return SOURCE_OPENED;
+        }
+        mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            close(fd); /* The mapping stays valid after the file is closed */
+            source->mapping = mapping;
+            source->data = (const char *)mapping;
+            source->length = (size_t)info.st_size;
+            return SOURCE_OPENED;
+        }
+    }
+
+    /* Not a regular file, or the mapping failed: read it instead */
+    if ((fp = fdopen(fd, "r")) == NULL)
+    {
+        close(fd);
+        return SOURCE_READ_FAILED;
+    }
+    status = readSourceStream(source, fp);
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Releases the text of a source.
+ *
+ * @param source The source to close.
+ */
+void closeSourceFile(SourceFile *source)
+{
+    if (source->mapping != NULL)
+    {
+        munmap(source->mapping, source->length);
+    }
+    freeTextBuffer(&source->buffer);
+    initSourceFile(source);
+}
@@ -0,0 +1,48 @@
+#ifndef SOURCE_FILE_H
+#define SOURCE_FILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "text_buffer.h"
+
+#define SOURCE_OPENED 1       /* The source was opened */
+#define SOURCE_OPEN_FAILED 0  /* The file could not be opened */
+#define SOURCE_READ_FAILED -1 /* The file was opened but could not be read */
+
+/* The text of a source file. A regular file is mapped read-only and used in place; anything that
+ * cannot be mapped, such as a pipe or standard input, is read into a growable buffer. */
+typedef struct SourceFile
+{
+    const char *data;  /* The text of the file */
+    size_t length;     /* Number of characters in the text */
+    void *mapping;     /* The mapping of the file, or NULL if the text is in buffer */
+    TextBuffer buffer; /* The text of a file that was read rather than mapped */
+} SourceFile;
+
+/**
+ * @brief Opens a source file, mapping it when it is a regular file.
+ *
+ * @param source Receives the text. Release it with closeSourceFile, whatever the result.
+ * @param fileName The name of the file.
+ * @return SOURCE_OPENED, SOURCE_OPEN_FAILED or SOURCE_READ_FAILED.
+ */
+int openSourceFile(SourceFile *source, const char *fileName);
+
+/**
+ * @brief Reads the rest of a stream, such as standard input, into a source.
+ *
+ * @param source Receives the text. Release it with closeSourceFile, whatever the result.
+ * @param fp The stream to read.
+ * @return SOURCE_OPENED, or SOURCE_READ_FAILED if the stream could not be read.
+ */
+int readSourceStream(SourceFile *source, FILE *fp);
+
+/**
+ * @brief Releases the text of a source.
+ *
+ * @param source The source to close.
+ */
+void closeSourceFile(SourceFile *source);
+
+#endif /* SOURCE_FILE_H */
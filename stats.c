@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+/* Names of the phases, in AsmPhase order */
+static const char *phaseNames[ASM_PHASE_COUNT] = {"strip", "macro", "first_pass", "second_pass", "output"};
+
+/**
+ * @brief Reads a clock in seconds.
+ *
+ * @param clockId The clock to read.
+ * @return The reading, or 0 if the clock is not available.
+ */
+static double readClock(clockid_t clockId)
+{
+    struct timespec now;
+    if (clock_gettime(clockId, &now) != 0)
+    {
+        return 0;
+    }
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Starts timing a phase.
+ *
+ * @param timer Receives the clock readings.
+ */
+void startPhase(PhaseTimer *timer)
+{
+    timer->wall = readClock(CLOCK_MONOTONIC);
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timer->cpu = readClock(CLOCK_THREAD_CPUTIME_ID);
+#else
+    timer->cpu = (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * @brief Stops timing a phase and adds the time spent to the statistics.
+ *
+ * @param timer The readings taken by startPhase.
+ * @param stats The statistics to update.
+ * @param phase The phase that ended.
+ */
+void endPhase(const PhaseTimer *timer, AsmStats *stats, AsmPhase phase)
+{
+    PhaseTimer now;
+    startPhase(&now);
+    stats->wallSeconds[phase] += now.wall - timer->wall;
+    stats->cpuSeconds[phase] += now.cpu - timer->cpu;
+}
+
+/**
+ * @brief Appends a JSON string literal, escaping the characters JSON requires.
+ *
+ * @param text The buffer to append to.
+ * @param value The string to quote.
+ */
+static void appendJsonString(TextBuffer *text, const char *value)
+{
+    char escape[8];
+
+    appendChar(text, '"');
+    for (; *value != '\0'; value++)
+    {
+        if (*value == '"' || *value == '\\')
+        {
+            appendChar(text, '\\');
+            appendChar(text, *value);
+        }
+        else if ((unsigned char)*value < 0x20)
+        {
+            sprintf(escape, "\\u%04x", (unsigned int)(unsigned char)*value);
+            appendString(text, escape);
+        }
+        else
+        {
+            appendChar(text, *value);
+        }
+    }
+    appendChar(text, '"');
+}
+
+/**
+ * @brief Formats the statistics of one file as human-readable text.
+ *
+ * @param fileName The name of the file the statistics belong to.
+ * @param stats The statistics.
+ * @param cached Nonzero if the outputs were restored from the cache.
+ * @param text The buffer the report is appended to.
+ */
+void formatStatsText(const char *fileName, const AsmStats *stats, int cached, TextBuffer *text)
+{
+    char line[160];
+    int i;
+
+    sprintf(line, "Statistics for %.100s%s\n", fileName, cached ? " (restored from cache)" : "");
+    appendString(text, line);
+    appendString(text, "  phase            wall ms     cpu ms\n");
+    for (i = 0; i < ASM_PHASE_COUNT; i++)
+    {
+        sprintf(line, "  %-12s %10.3f %10.3f\n", phaseNames[i], stats->wallSeconds[i] * 1e3, stats->cpuSeconds[i] * 1e3);
+        appendString(text, line);
+    }
+    sprintf(line, "  lines read %lu, instructions %lu, data words %lu, memory words %lu\n",
+            stats->linesRead, stats->instructions, stats->dataWords, stats->memoryWords);
+    appendString(text, line);
+    sprintf(line, "  symbol lookups %lu, macro expansions %lu, bytes written %lu\n",
+            stats->symbolLookups, stats->macroExpansions, stats->bytesWritten);
+    appendString(text, line);
+    sprintf(line, "  macro lookups %lu, macro probes %lu, longest macro probe %lu\n",
+            stats->macroLookups, stats->macroProbes, stats->longestMacroProbe);
+    appendString(text, line);
+}
+
+/**
+ * @brief Formats the statistics of one file as a JSON object.
+ *
+ * @param fileName The name of the file the statistics belong to.
+ * @param stats The statistics.
+ * @param cached Nonzero if the outputs were restored from the cache.
+ * @param text The buffer the object is appended to.
+ */
+void formatStatsJson(const char *fileName, const AsmStats *stats, int cached, TextBuffer *text)
+{
+    char field[160];
+    int i;
+
+    appendString(text, "{\"file\": ");
+    appendJsonString(text, fileName);
+    appendString(text, cached ? ", \"cached\": true, \"phases\": {" : ", \"cached\": false, \"phases\": {");
+    for (i = 0; i < ASM_PHASE_COUNT; i++)
+    {
+        sprintf(field, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i > 0 ? ", " : "", phaseNames[i],
+                stats->wallSeconds[i] * 1e3, stats->cpuSeconds[i] * 1e3);
+        appendString(text, field);
+    }
+    sprintf(field, "}, \"counters\": {\"lines_read\": %lu, \"instructions\": %lu, \"data_words\": %lu, ",
+            stats->linesRead, stats->instructions, stats->dataWords);
+    appendString(text, field);
+    sprintf(field, "\"symbol_lookups\": %lu, \"macro_expansions\": %lu, \"memory_words\": %lu, \"bytes_written\": %lu, ",
+            stats->symbolLookups, stats->macroExpansions, stats->memoryWords, stats->bytesWritten);
+    appendString(text, field);
+    sprintf(field, "\"macro_lookups\": %lu, \"macro_probes\": %lu, \"longest_macro_probe\": %lu}}",
+            stats->macroLookups, stats->macroProbes, stats->longestMacroProbe);
+    appendString(text, field);
+}
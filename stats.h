@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "libassembler.h"
+#include "text_buffer.h"
+
+#define STATS_OPTION "--stats"
+#define STATS_JSON_OPTION "--stats=json"
+
+/* How the statistics are reported, if at all */
+typedef enum StatsFormat
+{
+    STATS_NONE,
+    STATS_TEXT,
+    STATS_JSON
+} StatsFormat;
+
+/* Clock readings taken when a phase starts */
+typedef struct PhaseTimer
+{
+    double wall; /* Elapsed time, in seconds since an arbitrary point */
+    double cpu;  /* CPU time of the calling thread, in seconds */
+} PhaseTimer;
+
+/**
+ * @brief Starts timing a phase.
+ *
+ * @param timer Receives the clock readings.
+ */
+void startPhase(PhaseTimer *timer);
+
+/**
+ * @brief Stops timing a phase and adds the time spent to the statistics.
+ *
+ * @param timer The readings taken by startPhase.
+ * @param stats The statistics to update.
+ * @param phase The phase that ended.
+ */
+void endPhase(const PhaseTimer *timer, AsmStats *stats, AsmPhase phase);
+
+/**
+ * @brief Formats the statistics of one file as human-readable text.
+ *
+ * @param fileName The name of the file the statistics belong to.
+ * @param stats The statistics.
+ * @param cached Nonzero if the outputs were restored from the cache.
+ * @param text The buffer the report is appended to.
+ */
+void formatStatsText(const char *fileName, const AsmStats *stats, int cached, TextBuffer *text);
+
+/**
+ * @brief Formats the statistics of one file as a JSON object.
+ *
+ * @param fileName The name of the file the statistics belong to.
+ * @param stats The statistics.
+ * @param cached Nonzero if the outputs were restored from the cache.
+ * @param text The buffer the object is appended to.
+ */
+void formatStatsJson(const char *fileName, const AsmStats *stats, int cached, TextBuffer *text);
+
+#endif /* STATS_H */
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_buffer.h"
+
+/**
+ * @brief Initializes an empty text buffer.
+ *
+ * @param buffer The buffer to initialize.
+ */
+void initTextBuffer(TextBuffer *buffer)
+{
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->position = 0;
+}
+
+/**
+ * @brief Releases the memory held by a text buffer and resets it to empty.
+ *
+ * @param buffer The buffer to free.
+ */
+void freeTextBuffer(TextBuffer *buffer)
+{
+    free(buffer->data);
+    initTextBuffer(buffer);
+}
+
+/**
+ * @brief Empties a text buffer but keeps its memory for reuse.
+ *
+ * @param buffer The buffer to clear.
+ */
+void clearTextBuffer(TextBuffer *buffer)
+{
+    buffer->length = 0;
+    buffer->position = 0;
+    if (buffer->data != NULL)
+    {
+        buffer->data[0] = '\0';
+    }
+}
+
+/**
+ * @brief Makes sure the buffer can hold at least the requested number of characters plus a null terminator.
+ *
+ * The capacity is doubled on each growth so that appending is amortized constant time.
+ *
+ * @param buffer The buffer to grow.
+ * @param required The number of characters the buffer must be able to hold.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int reserveText(TextBuffer *buffer, size_t required)
+{
+    size_t newCapacity;
+    char *newData;
+
+    if (required + 1 <= buffer->capacity)
+    {
+        return 1;
+    }
+    newCapacity = buffer->capacity ? buffer->capacity : TEXT_BUFFER_INITIAL_CAPACITY;
+    while (newCapacity < required + 1)
+    {
+        newCapacity *= 2;
+    }
+    newData = realloc(buffer->data, newCapacity);
+    if (newData == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    buffer->data = newData;
+    buffer->capacity = newCapacity;
+    return 1;
+}
+
+/**
+ * @brief Appends a sequence of characters to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param text The characters to append.
+ * @param length The number of characters to append.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int appendText(TextBuffer *buffer, const char *text, size_t length)
+{
+    if (!reserveText(buffer, buffer->length + length))
+    {
+        return 0;
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Appends the rest of a file to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param fp The file to read from.
+ * @return 1 on success, 0 if memory allocation or reading failed.
+ */
+int appendFile(TextBuffer *buffer, FILE *fp)
+{
+    char chunk[BUFSIZ];
+    size_t count;
+
+    while ((count = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        if (!appendText(buffer, chunk, count))
+        {
+            return 0;
+        }
+    }
+    return !ferror(fp);
+}
+
+/**
+ * @brief Appends a null-terminated string to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param text The string to append.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int appendString(TextBuffer *buffer, const char *text)
+{
+    return appendText(buffer, text, strlen(text));
+}
+
+/**
+ * @brief Appends a single character to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param c The character to append.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int appendChar(TextBuffer *buffer, char c)
+{
+    return appendText(buffer, &c, 1);
+}
+
+/**
+ * @brief Reads the next line from a text buffer, with the same semantics as fgets.
+ *
+ * @param line The destination for the line.
+ * @param size The size of the destination.
+ * @param buffer The buffer to read from.
+ * @return line on success, or NULL when the end of the buffer is reached.
+ */
+char *bufferGets(char *line, int size, TextBuffer *buffer)
+{
+    int i = 0;
+
+    if (size <= 0 || buffer->position >= buffer->length)
+    {
+        return NULL;
+    }
+    while (i < size - 1 && buffer->position < buffer->length)
+    {
+        char c = buffer->data[buffer->position++];
+        line[i++] = c;
+        if (c == '\n')
+        {
+            break;
+        }
+    }
+    line[i] = '\0';
+    return line;
+}
+
+/**
+ * @brief Hands out the next line of a text buffer in place, without copying it.
+ *
+ * @param buffer The buffer to read from.
+ * @param limit The most characters to hand out.
+ * @param length Receives the number of characters in the line.
+ * @return The start of the line inside the buffer, or NULL when the end of the buffer is reached.
+ */
+const char *bufferNextLine(TextBuffer *buffer, size_t limit, size_t *length)
+{
+    const char *start, *newline;
+    size_t available;
+
+    if (buffer->position >= buffer->length || limit == 0)
+    {
+        return NULL;
+    }
+    start = buffer->data + buffer->position;
+    available = buffer->length - buffer->position;
+    if (available > limit)
+    {
+        available = limit;
+    }
+    newline = memchr(start, '\n', available);
+    *length = newline != NULL ? (size_t)(newline - start) + 1 : available;
+    buffer->position += *length;
+    return start;
+}
+
+/**
+ * @brief Reads the next character from a text buffer, with the same semantics as fgetc.
+ *
+ * @param buffer The buffer to read from.
+ * @return The character read, or EOF when the end of the buffer is reached.
+ */
+int bufferGetc(TextBuffer *buffer)
+{
+    if (buffer->position >= buffer->length)
+    {
+        return EOF;
+    }
+    return (unsigned char)buffer->data[buffer->position++];
+}
+
+/**
+ * @brief Moves the read position of a text buffer back to its beginning.
+ *
+ * @param buffer The buffer to rewind.
+ */
+void rewindTextBuffer(TextBuffer *buffer)
+{
+    buffer->position = 0;
+}
+
+/**
+ * @brief Writes the content of a text buffer to a file.
+ *
+ * @param buffer The buffer to write.
+ * @param fileName The name of the file to create or overwrite.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int writeTextBuffer(const TextBuffer *buffer, const char *fileName)
+{
+    FILE *fp = fopen(fileName, "w");
+    int ok;
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to open file %s\n", fileName);
+        return 0;
+    }
+    ok = buffer->length == 0 || fwrite(buffer->data, 1, buffer->length, fp) == buffer->length;
+    if (fclose(fp) != 0)
+    {
+        ok = 0;
+    }
+    return ok;
+}
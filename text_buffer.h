@@ -0,0 +1,139 @@
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define TEXT_BUFFER_INITIAL_CAPACITY 4096
+
+/* Growable in-memory text used to pass source code between the assembler stages */
+typedef struct TextBuffer
+{
+    char *data;      /* Null-terminated text content */
+    size_t length;   /* Number of characters stored (excluding the null terminator) */
+    size_t capacity; /* Number of bytes allocated for data */
+    size_t position; /* Read position used by bufferGets and bufferGetc */
+} TextBuffer;
+
+/**
+ * @brief Initializes an empty text buffer.
+ *
+ * No memory is allocated until the first append.
+ *
+ * @param buffer The buffer to initialize.
+ */
+void initTextBuffer(TextBuffer *buffer);
+
+/**
+ * @brief Releases the memory held by a text buffer and resets it to empty.
+ *
+ * @param buffer The buffer to free.
+ */
+void freeTextBuffer(TextBuffer *buffer);
+
+/**
+ * @brief Empties a text buffer but keeps its memory for reuse.
+ *
+ * @param buffer The buffer to clear.
+ */
+void clearTextBuffer(TextBuffer *buffer);
+
+/**
+ * @brief Makes sure the buffer can hold at least the requested number of characters plus a null terminator.
+ *
+ * Lets a caller render text straight into the buffer: it writes past the current length and then
+ * updates the length and the terminator itself.
+ *
+ * @param buffer The buffer to grow.
+ * @param required The number of characters the buffer must be able to hold.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int reserveText(TextBuffer *buffer, size_t required);
+
+/**
+ * @brief Appends a sequence of characters to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param text The characters to append.
+ * @param length The number of characters to append.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int appendText(TextBuffer *buffer, const char *text, size_t length);
+
+/**
+ * @brief Appends the rest of a file to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param fp The file to read from.
+ * @return 1 on success, 0 if memory allocation or reading failed.
+ */
+int appendFile(TextBuffer *buffer, FILE *fp);
+
+/**
+ * @brief Appends a null-terminated string to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param text The string to append.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int appendString(TextBuffer *buffer, const char *text);
+
+/**
+ * @brief Appends a single character to the end of a text buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param c The character to append.
+ * @return 1 on success, 0 if memory allocation failed.
+ */
+int appendChar(TextBuffer *buffer, char c);
+
+/**
+ * @brief Reads the next line from a text buffer, with the same semantics as fgets.
+ *
+ * At most size - 1 characters are copied. Reading stops after a newline, which is kept.
+ *
+ * @param line The destination for the line.
+ * @param size The size of the destination.
+ * @param buffer The buffer to read from.
+ * @return line on success, or NULL when the end of the buffer is reached.
+ */
+char *bufferGets(char *line, int size, TextBuffer *buffer);
+
+/**
+ * @brief Hands out the next line of a text buffer in place, without copying it.
+ *
+ * The line runs up to and including its newline, or to the end of the buffer. A line longer than
+ * limit is cut after limit characters and the rest is handed out by the next call.
+ *
+ * @param buffer The buffer to read from.
+ * @param limit The most characters to hand out.
+ * @param length Receives the number of characters in the line.
+ * @return The start of the line inside the buffer, or NULL when the end of the buffer is reached.
+ */
+const char *bufferNextLine(TextBuffer *buffer, size_t limit, size_t *length);
+
+/**
+ * @brief Reads the next character from a text buffer, with the same semantics as fgetc.
+ *
+ * @param buffer The buffer to read from.
+ * @return The character read, or EOF when the end of the buffer is reached.
+ */
+int bufferGetc(TextBuffer *buffer);
+
+/**
+ * @brief Moves the read position of a text buffer back to its beginning.
+ *
+ * @param buffer The buffer to rewind.
+ */
+void rewindTextBuffer(TextBuffer *buffer);
+
+/**
+ * @brief Writes the content of a text buffer to a file.
+ *
+ * @param buffer The buffer to write.
+ * @param fileName The name of the file to create or overwrite.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int writeTextBuffer(const TextBuffer *buffer, const char *fileName);
+
+#endif /* TEXT_BUFFER_H */
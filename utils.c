@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include "utils.h"
 #include "data.h"
+#include "scanner.h"
 
 /**
  * @brief Duplicates a string by allocating memory for the new string and copying the content.
@@ -58,39 +59,75 @@ void printFile(FILE *fp)
 }
 
 /**
- * @brief Skips comments and copies the remaining content from the source file to the destination file.
+ * @brief Copies text to an in-memory buffer without its comments.
  *
- * Comments are lines starting with ';' and are not copied to the destination.
+ * Comments start with ';' and run until the end of the line. The newline that ends a comment is kept
+ * so that line numbers of the stripped text still match the source. The text may be given in
+ * several chunks, passing the returned state on to the next call. The text is scanned a block of
+ * characters at a time for the next ';' and, inside a comment, for the newline that ends it.
  *
- * @param source Pointer to the source file.
- * @param dest Pointer to the destination file.
+ * @param text The text to copy.
+ * @param length The number of characters in the text.
+ * @param inComment Nonzero if the previous chunk ended inside a comment, 0 for the first chunk.
+ * @param dest Pointer to the buffer receiving the stripped text.
+ * @return Nonzero if the text ends inside a comment.
  */
-void skipAndCopy(FILE *source, FILE *dest)
+int stripComments(const char *text, size_t length, int inComment, TextBuffer *dest)
 {
-    int c, inComment = 0;
+    ScanSet commentStart, newline;
+    size_t i = 0, end;
 
-    while ((c = fgetc(source)) != EOF)
+    initScanSet(&commentStart, ";");
+    initScanSet(&newline, "\n");
+    while (i < length)
     {
         if (inComment)
         {
-            if (c == '\n')
-            {
-                inComment = 0;
-                fputc(c, dest);
-            }
+            i += scanNext(text + i, length - i, &newline); /* The newline itself is copied with the next run */
+            inComment = i == length;
         }
         else
         {
-            if (c == ';')
-            {
-                inComment = 1;
-            }
-            else
-            {
-                fputc(c, dest);
-            }
+            end = i + scanNext(text + i, length - i, &commentStart);
+            appendText(dest, text + i, end - i);
+            inComment = end < length;
+            i = end + inComment;
         }
     }
+    return inComment;
+}
+
+/**
+ * @brief Skips comments and copies the remaining content from the source file to an in-memory buffer.
+ *
+ * @param source Pointer to the source file.
+ * @param dest Pointer to the buffer receiving the stripped text.
+ */
+void skipAndCopy(FILE *source, TextBuffer *dest)
+{
+    char chunk[BUFSIZ];
+    size_t count;
+    int inComment = 0;
+
+    while ((count = fread(chunk, 1, sizeof(chunk), source)) > 0)
+    {
+        inComment = stripComments(chunk, count, inComment, dest);
+    }
+}
+
+/**
+ * @brief Copies a string view into a null-terminated buffer.
+ *
+ * @param view The view to copy.
+ * @param buffer Buffer of at least MAX_LINE_LENGTH characters; longer views are truncated.
+ * @return The buffer.
+ */
+char *copyView(StringView view, char buffer[])
+{
+    size_t length = view.length < MAX_LINE_LENGTH ? view.length : MAX_LINE_LENGTH - 1;
+    memcpy(buffer, view.start, length);
+    buffer[length] = '\0';
+    return buffer;
 }
 
 /**
@@ -142,20 +179,106 @@ void skipWhiteLines(FILE *fp)
 }
 
 /**
- * @brief Handles and prints an error message along with the line number and the problematic line.
+ * @brief Records an error message along with the line number and the problematic line.
  *
+ * The message is appended to the diagnostics of the context; the caller decides when to print them.
+ * When the source included other files, the line number is mapped back to the file it was read from.
+ *
+ * @param ctx The assembler context.
  * @param errorMessage The error message to print.
  * @param lineNumber The line number where the error occurred.
  * @param line The actual line from the source file where the error occurred.
  */
-void handleError(const char *errorMessage, int lineNumber, char *line)
+void handleError(AssemblerContext *ctx, const char *errorMessage, int lineNumber, char *line)
 {
-    if (!lineErrorFlag)
+    const char *fileName = NULL;
+    if (ctx->lineMap != NULL)
+    {
+        lineNumber = findLineOrigin(ctx->lineMap, lineNumber, &fileName);
+    }
+    handleFileError(ctx, errorMessage, fileName, lineNumber, line);
+}
+
+/**
+ * @brief Records an error message along with the file and the line where the error occurred.
+ *
+ * @param ctx The assembler context.
+ * @param errorMessage The error message to print.
+ * @param fileName The included file the line was read from, or NULL for the source itself.
+ * @param lineNumber The line number in that file.
+ * @param line The actual line from the file where the error occurred.
+ */
+void handleFileError(AssemblerContext *ctx, const char *errorMessage, const char *fileName, int lineNumber, char *line)
+{
+    char prefix[MAX_MESSAGE_LENGTH];
+    if (!ctx->lineErrorFlag)
+    {
+        ctx->errorFlag = 1;
+        ctx->lineErrorFlag = 1;
+        if (fileName != NULL)
+        {
+            sprintf(prefix, "ERROR >> in line %d of %.100s: ", lineNumber, fileName);
+        }
+        else
+        {
+            sprintf(prefix, "ERROR >> in line %d: ", lineNumber);
+        }
+        appendString(&ctx->diagnostics, prefix);
+        appendString(&ctx->diagnostics, errorMessage);
+        appendString(&ctx->diagnostics, "\n\t");
+        appendString(&ctx->diagnostics, line);
+        appendString(&ctx->diagnostics, "\n");
+    }
+}
+
+/**
+ * @brief Records a message in the diagnostics of the context.
+ *
+ * @param ctx The assembler context.
+ * @param message The message to record, including its trailing newline.
+ */
+void reportMessage(AssemblerContext *ctx, const char *message)
+{
+    appendString(&ctx->diagnostics, message);
+}
+
+/**
+ * @brief Splits a string into tokens, like strtok, keeping its position in savePtr instead of a static variable.
+ *
+ * @param str The string to tokenize on the first call, or NULL to continue with the same string.
+ * @param delim The delimiter characters.
+ * @param savePtr Where the position between calls is kept.
+ * @return The next token, or NULL if there are no more tokens.
+ */
+char *strTokR(char *str, const char *delim, char **savePtr)
+{
+    char *token;
+    if (str == NULL)
+    {
+        str = *savePtr;
+    }
+    if (str == NULL)
+    {
+        return NULL;
+    }
+    str += strspn(str, delim); /* Skip leading delimiters */
+    if (*str == '\0')
+    {
+        *savePtr = str;
+        return NULL;
+    }
+    token = str;
+    str = strpbrk(token, delim); /* Find the end of the token */
+    if (str == NULL)
+    {
+        *savePtr = token + strlen(token);
+    }
+    else
     {
-        errorFlag = 1;
-        lineErrorFlag = 1;
-        fprintf(stderr, "ERROR >> in line %d: %s\n\t%s\n", lineNumber, errorMessage, line);
+        *str = '\0';
+        *savePtr = str + 1;
     }
+    return token;
 }
 
 /**
@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <stdio.h>
+#include "text_buffer.h"
+#include "data.h"
 
 /**
  * @brief Converts an integer to its binary string representation.
@@ -50,12 +52,23 @@ void fileCopy(FILE *src, FILE *dest);
 void printFile(FILE *fp);
 
 /**
- * @brief Skips white lines and copies the content from the source file to the destination file.
+ * @brief Copies text to an in-memory buffer without its comments.
+ *
+ * @param text The text to copy.
+ * @param length The number of characters in the text.
+ * @param inComment Nonzero if the previous chunk ended inside a comment, 0 for the first chunk.
+ * @param dest Pointer to the buffer receiving the stripped text.
+ * @return Nonzero if the text ends inside a comment.
+ */
+int stripComments(const char *text, size_t length, int inComment, TextBuffer *dest);
+
+/**
+ * @brief Skips comments and copies the content from the source file to an in-memory buffer.
  *
  * @param src The source file to read from.
- * @param dest The destination file to write to.
+ * @param dest The buffer receiving the stripped text.
  */
-void skipAndCopy(FILE *src, FILE *dest);
+void skipAndCopy(FILE *src, TextBuffer *dest);
 
 /**
  * @brief Skips white lines in the file.
@@ -65,13 +78,52 @@ void skipAndCopy(FILE *src, FILE *dest);
 void skipWhiteLines(FILE *fp);
 
 /**
- * @brief Handles errors by printing an error message along with the line number and the line where the error occurred.
+ * @brief Handles errors by recording an error message along with the line number and the line where the error occurred.
  *
+ * @param ctx The assembler context receiving the message.
  * @param errorMessage The error message to be printed.
  * @param lineNumber The line number where the error occurred.
  * @param line The line of code that caused the error.
  */
-void handleError(const char *errorMessage, int lineNumber, char *line);
+void handleError(AssemblerContext *ctx, const char *errorMessage, int lineNumber, char *line);
+
+/**
+ * @brief Records an error message along with the file and the line where the error occurred.
+ *
+ * @param ctx The assembler context receiving the message.
+ * @param errorMessage The error message to be printed.
+ * @param fileName The included file the line was read from, or NULL for the source itself.
+ * @param lineNumber The line number in that file.
+ * @param line The line of code that caused the error.
+ */
+void handleFileError(AssemblerContext *ctx, const char *errorMessage, const char *fileName, int lineNumber, char *line);
+
+/**
+ * @brief Records a message in the diagnostics of the context.
+ *
+ * @param ctx The assembler context receiving the message.
+ * @param message The message to record, including its trailing newline.
+ */
+void reportMessage(AssemblerContext *ctx, const char *message);
+
+/**
+ * @brief Splits a string into tokens, like strtok, but keeps its position in savePtr so it is re-entrant.
+ *
+ * @param str The string to tokenize on the first call, or NULL to continue with the same string.
+ * @param delim The delimiter characters.
+ * @param savePtr Where the position between calls is kept.
+ * @return The next token, or NULL if there are no more tokens.
+ */
+char *strTokR(char *str, const char *delim, char **savePtr);
+
+/**
+ * @brief Copies a string view into a null-terminated buffer.
+ *
+ * @param view The view to copy.
+ * @param buffer Buffer of at least MAX_LINE_LENGTH characters; longer views are truncated.
+ * @return The buffer.
+ */
+char *copyView(StringView view, char buffer[]);
 
 /**
  * @brief Trims leading and trailing whitespace from a string.